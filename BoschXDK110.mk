@@ -40,10 +40,31 @@ NACL_OBJS = ubirch-mbed-nacl-cm0/source/nacl/crypto_hash/sha512.o \
 			ubirch-mbed-nacl-cm0/source/nacl/shared/fe25519.o \
 			ubirch-mbed-nacl-cm0/source/randombytes/randombytes.o
 # ubirch-protocol dependencies and objects
-UBIRCH_DEPS = ubirch/digest/sha512.h ubirch/digest/config.h \
-			  ubirch/ubirch_protocol.h ubirch/ubirch_protocol_kex.h ubirch/ubirch_ed25519.h
+UBIRCH_DEPS = ubirch/digest/sha512.h ubirch/digest/sha512_mb.h ubirch/digest/config.h \
+			  ubirch/ed25519/ed25519_math.h ubirch/ed25519/ed25519_batch.h ubirch/ed25519/ed25519_keys.h \
+			  ubirch/ed25519/ed25519_base.h \
+			  ubirch/ubirch_protocol.h ubirch/ubirch_protocol_kex.h ubirch/ubirch_protocol_pool.h \
+			  ubirch/ubirch_protocol_chain.h ubirch/ubirch_protocol_chain_file.h \
+			  ubirch/ubirch_protocol_log.h ubirch/ubirch_protocol_view.h \
+			  ubirch/ubirch_protocol_chain_verify.h ubirch/ubirch_protocol_verifier.h \
+			  ubirch/ubirch_protocol_batch.h ubirch/ubirch_protocol_iov.h \
+			  ubirch/ubirch_ed25519.h
 UBIRCH_OBJS = ubirch/digest/sha512.o \
-			  ubirch/ubirch_protocol_kex.o
+			  ubirch/digest/sha512_process.o \
+			  ubirch/digest/sha512_mb.o \
+			  ubirch/ed25519/ed25519_math.o \
+			  ubirch/ed25519/ed25519_batch.o \
+			  ubirch/ed25519/ed25519_keys.o \
+			  ubirch/ubirch_protocol_kex.o \
+			  ubirch/ubirch_protocol_pool.o \
+			  ubirch/ubirch_protocol_chain.o \
+			  ubirch/ubirch_protocol_chain_file.o \
+			  ubirch/ubirch_protocol_log.o \
+			  ubirch/ubirch_protocol_view.o \
+			  ubirch/ubirch_protocol_chain_verify.o \
+			  ubirch/ubirch_protocol_verifier.o \
+			  ubirch/ubirch_protocol_batch.o \
+			  ubirch/ubirch_protocol_iov.o
 
 
 DEPS = $(MSGPACK_DEPS) $(NACL_DEPS) $(UBIRCH_DEPS)
@@ -0,0 +1,209 @@
+#include <unity/unity.h>
+#include <ubirch/ubirch_protocol_batch.h>
+#include <ubirch/ubirch_protocol_view.h>
+#include <ubirch/ubirch_ed25519.h>
+
+#include "utest/utest.h"
+#include "greentea-client/test_env.h"
+
+using namespace utest::v1;
+
+static const unsigned char UUID[16] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p'};
+
+unsigned char ed25519_secret_key[crypto_sign_SECRETKEYBYTES] = {
+        0x69, 0x09, 0xcb, 0x3d, 0xff, 0x94, 0x43, 0x26, 0xed, 0x98, 0x72, 0x60,
+        0x1e, 0xb3, 0x3c, 0xb2, 0x2d, 0x9e, 0x20, 0xdb, 0xbb, 0xe8, 0x17, 0x34,
+        0x1c, 0x81, 0x33, 0x53, 0xda, 0xc9, 0xef, 0xbb, 0x7c, 0x76, 0xc4, 0x7c,
+        0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87, 0x01, 0x0f, 0x32, 0x4b,
+        0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf, 0x8f, 0xfd, 0xaa, 0x55,
+        0x93, 0xe6, 0x3e, 0x6a
+};
+unsigned char ed25519_public_key[crypto_sign_PUBLICKEYBYTES] = {
+        0x7c, 0x76, 0xc4, 0x7c, 0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87,
+        0x01, 0x0f, 0x32, 0x4b, 0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf,
+        0x8f, 0xfd, 0xaa, 0x55, 0x93, 0xe6, 0x3e, 0x6a
+};
+
+/**
+ * Pack the payload of message i (a raw string that grows with the index).
+ */
+static void pack_payload(msgpack_packer *pk, int i) {
+    msgpack_pack_raw(pk, (size_t) i * 10);
+    for (int j = 0; j < i * 10; j++) msgpack_pack_raw_body(pk, "x", 1);
+}
+
+/**
+ * Count the writes to a buffer, to check that a flush is a single write.
+ */
+static int writes = 0;
+
+static int counting_write(void *data, const char *buf, size_t len) {
+    writes++;
+    return msgpack_sbuffer_write(data, buf, len);
+}
+
+static int failing_write(void *data, const char *buf, size_t len) {
+    (void) data;
+    (void) buf;
+    (void) len;
+    return -1;
+}
+
+void TestBatchChained() {
+    // the same messages, written one by one
+    msgpack_sbuffer *expected = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 expected, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    for (int i = 0; i < 20; i++) {
+        ubirch_protocol_start(proto, pk);
+        pack_payload(pk, i);
+        ubirch_protocol_finish(proto, pk);
+    }
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN, sbuf, msgpack_sbuffer_write,
+                                ed25519_sign, UUID);
+    ubirch_batch *batch = ubirch_batch_new(64, 4);
+    TEST_ASSERT_NOT_NULL(batch);
+    pk = msgpack_packer_new(batch, ubirch_batch_write);
+    for (int i = 0; i < 20; i++) {
+        TEST_ASSERT_EQUAL_INT(0, ubirch_batch_start(batch, proto));
+        pack_payload(pk, i);
+        TEST_ASSERT_EQUAL_INT(0, ubirch_batch_finish(batch));
+    }
+    TEST_ASSERT_EQUAL_UINT(20, batch->count);
+    TEST_ASSERT_EQUAL_UINT(expected->size, batch->len);
+
+    // the entries point to the messages and their signatures
+    ubirch_protocol_view view;
+    size_t offset = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        const ubirch_batch_entry *entry = &batch->entries[i];
+        TEST_ASSERT_EQUAL_UINT(offset, entry->offset);
+        TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_parse(batch->buf + entry->offset, batch->len - entry->offset, &view));
+        TEST_ASSERT_EQUAL_UINT(view.len, entry->len);
+        TEST_ASSERT_EQUAL_PTR(view.signature, batch->buf + entry->signature);
+        if (i > 0) {
+            TEST_ASSERT_EQUAL_HEX8_ARRAY(batch->buf + batch->entries[i - 1].signature, view.previous,
+                                         UBIRCH_PROTOCOL_SIGN_SIZE);
+        }
+        offset += entry->len;
+    }
+
+    // a single write, with the same messages
+    writes = 0;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_batch_flush(batch, counting_write, sbuf));
+    TEST_ASSERT_EQUAL_INT(1, writes);
+    TEST_ASSERT_EQUAL_UINT(expected->size, sbuf->size);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected->data, sbuf->data, expected->size);
+    TEST_ASSERT_EQUAL_UINT(0, batch->count);
+    TEST_ASSERT_EQUAL_UINT(0, batch->len);
+
+    msgpack_packer_free(pk);
+    ubirch_batch_free(batch);
+    ubirch_protocol_free(proto);
+    msgpack_sbuffer_free(sbuf);
+    msgpack_sbuffer_free(expected);
+}
+
+void TestBatchContexts() {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *signed_proto = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                        sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    ubirch_protocol *plain_proto = ubirch_protocol_new(proto_plain, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                       sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    ubirch_batch *batch = ubirch_batch_new(16, 1);
+
+    // already encoded payloads of different contexts
+    const unsigned char payload[] = {0xa5, 'h', 'e', 'l', 'l', 'o'};
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_EQUAL_INT(0, ubirch_batch_add(batch, i % 2 ? plain_proto : signed_proto, payload, sizeof(payload)));
+    }
+    TEST_ASSERT_EQUAL_UINT(10, batch->count);
+
+    ubirch_protocol_view view;
+    for (size_t i = 0; i < batch->count; i++) {
+        const ubirch_batch_entry *entry = &batch->entries[i];
+        TEST_ASSERT_EQUAL_INT(i % 2 ? -2 : 0, ubirch_protocol_verify_view(batch->buf + entry->offset, entry->len,
+                                                                           ed25519_verify_ctx, ed25519_public_key,
+                                                                           &view));
+        TEST_ASSERT_EQUAL_UINT(i % 2 ? 0 : entry->offset + entry->len - UBIRCH_PROTOCOL_SIGN_SIZE, entry->signature);
+        TEST_ASSERT_EQUAL_UINT(sizeof(payload), view.payload_len);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(payload, view.payload, sizeof(payload));
+    }
+
+    // the buffer is kept when cleared
+    unsigned char *buf = batch->buf;
+    ubirch_batch_clear(batch);
+    TEST_ASSERT_EQUAL_UINT(0, batch->count);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_batch_add(batch, signed_proto, payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL_PTR(buf, batch->buf);
+
+    ubirch_batch_free(batch);
+    ubirch_protocol_free(plain_proto);
+    ubirch_protocol_free(signed_proto);
+    msgpack_sbuffer_free(sbuf);
+}
+
+void TestBatchErrors() {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    ubirch_batch *batch = ubirch_batch_new(256, 4);
+    msgpack_packer *pk = msgpack_packer_new(batch, ubirch_batch_write);
+
+    TEST_ASSERT_EQUAL_INT(-1, ubirch_batch_start(batch, NULL));
+    TEST_ASSERT_EQUAL_INT(-2, ubirch_batch_finish(batch));
+    TEST_ASSERT_EQUAL_INT(-1, msgpack_pack_int(pk, 1));
+
+    TEST_ASSERT_EQUAL_INT(0, ubirch_batch_start(batch, proto));
+    msgpack_pack_int(pk, 1);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_batch_finish(batch));
+    const size_t len = batch->len;
+
+    // a started message stays in the batch when flushing, and a failed flush keeps all messages
+    TEST_ASSERT_EQUAL_INT(0, ubirch_batch_start(batch, proto));
+    TEST_ASSERT_EQUAL_INT(-2, ubirch_batch_start(batch, proto));
+    msgpack_pack_int(pk, 2);
+    TEST_ASSERT_EQUAL_INT(-1, ubirch_batch_flush(batch, failing_write, NULL));
+    TEST_ASSERT_EQUAL_UINT(1, batch->count);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_batch_flush(batch, msgpack_sbuffer_write, sbuf));
+    TEST_ASSERT_EQUAL_UINT(len, sbuf->size);
+    TEST_ASSERT_EQUAL_UINT(0, batch->count);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_batch_finish(batch));
+    TEST_ASSERT_EQUAL_UINT(1, batch->count);
+    TEST_ASSERT_EQUAL_UINT(0, batch->entries[0].offset);
+    TEST_ASSERT_EQUAL_UINT(len, batch->entries[0].len);
+
+    ubirch_protocol_view view;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_verify_view(batch->buf, batch->len, ed25519_verify_ctx,
+                                                         ed25519_public_key, &view));
+    TEST_ASSERT_EQUAL_UINT(2, view.payload[0]);
+
+    msgpack_packer_free(pk);
+    ubirch_batch_free(batch);
+    ubirch_protocol_free(proto);
+    msgpack_sbuffer_free(sbuf);
+}
+
+utest::v1::status_t greentea_test_setup(const size_t number_of_cases) {
+    GREENTEA_SETUP(600, "default_auto");
+    return greentea_test_setup_handler(number_of_cases);
+}
+
+int main() {
+    Case cases[] = {
+            Case("ubirch protocol [batch] chained messages",
+                 TestBatchChained, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [batch] messages of several contexts",
+                 TestBatchContexts, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [batch] errors",
+                 TestBatchErrors, greentea_case_failure_abort_handler),
+    };
+
+    Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
+    Harness::run(specification);
+}
@@ -0,0 +1,260 @@
+#include <unity/unity.h>
+#include <ubirch/ubirch_protocol_chain.h>
+#include <ubirch/ubirch_protocol_chain_file.h>
+#include <ubirch/ubirch_ed25519.h>
+
+#include "utest/utest.h"
+#include "greentea-client/test_env.h"
+
+using namespace utest::v1;
+
+static const unsigned char UUID[16] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p'};
+
+unsigned char ed25519_secret_key[crypto_sign_SECRETKEYBYTES] = {
+        0x69, 0x09, 0xcb, 0x3d, 0xff, 0x94, 0x43, 0x26, 0xed, 0x98, 0x72, 0x60,
+        0x1e, 0xb3, 0x3c, 0xb2, 0x2d, 0x9e, 0x20, 0xdb, 0xbb, 0xe8, 0x17, 0x34,
+        0x1c, 0x81, 0x33, 0x53, 0xda, 0xc9, 0xef, 0xbb, 0x7c, 0x76, 0xc4, 0x7c,
+        0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87, 0x01, 0x0f, 0x32, 0x4b,
+        0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf, 0x8f, 0xfd, 0xaa, 0x55,
+        0x93, 0xe6, 0x3e, 0x6a
+};
+unsigned char ed25519_public_key[crypto_sign_PUBLICKEYBYTES] = {
+        0x7c, 0x76, 0xc4, 0x7c, 0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87,
+        0x01, 0x0f, 0x32, 0x4b, 0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf,
+        0x8f, 0xfd, 0xaa, 0x55, 0x93, 0xe6, 0x3e, 0x6a
+};
+
+#define CHAIN_DEVICES 1000
+
+static void device_uuid(unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE], unsigned int n) {
+    memcpy(uuid, UUID, UBIRCH_PROTOCOL_UUID_SIZE);
+    uuid[14] = (unsigned char) (n >> 8);
+    uuid[15] = (unsigned char) n;
+}
+
+void TestChainStore() {
+    ubirch_chain_store *store = ubirch_chain_store_new(4, 0);
+    TEST_ASSERT_NOT_NULL(store);
+
+    unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE], signature[UBIRCH_PROTOCOL_SIGN_SIZE];
+    unsigned int type;
+
+    // the shards grow beyond their initial capacity
+    for (unsigned int i = 0; i < CHAIN_DEVICES; i++) {
+        device_uuid(uuid, i);
+        memset(signature, (int) i, sizeof(signature));
+        TEST_ASSERT_EQUAL_INT(0, ubirch_chain_put(store, uuid, i, i % 2 ? signature : NULL));
+    }
+    TEST_ASSERT_EQUAL_INT(CHAIN_DEVICES, ubirch_chain_count(store));
+
+    // remove every third device
+    for (unsigned int i = 0; i < CHAIN_DEVICES; i += 3) {
+        device_uuid(uuid, i);
+        TEST_ASSERT_EQUAL_INT(0, ubirch_chain_remove(store, uuid));
+        TEST_ASSERT_EQUAL_INT(-1, ubirch_chain_remove(store, uuid));
+    }
+
+    for (unsigned int i = 0; i < CHAIN_DEVICES; i++) {
+        device_uuid(uuid, i);
+        TEST_ASSERT_TRUE(ubirch_chain_shard_index(store, uuid) < 4);
+        if (i % 3 == 0) {
+            TEST_ASSERT_EQUAL_INT(-1, ubirch_chain_get(store, uuid, &type, signature));
+            continue;
+        }
+        TEST_ASSERT_EQUAL_INT(0, ubirch_chain_get(store, uuid, &type, signature));
+        TEST_ASSERT_EQUAL_UINT(i, type);
+        TEST_ASSERT_EQUAL_HEX8(i % 2 ? (unsigned char) i : 0, signature[UBIRCH_PROTOCOL_SIGN_SIZE - 1]);
+    }
+
+    ubirch_chain_store_free(store);
+}
+
+void TestChainMessages() {
+    unsigned char uuid2[UBIRCH_PROTOCOL_UUID_SIZE];
+    device_uuid(uuid2, 2);
+
+    // reference: one context per device
+    msgpack_sbuffer *expected = msgpack_sbuffer_new();
+    ubirch_protocol *device1 = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                   expected, msgpack_sbuffer_write, ed25519_sign, UUID);
+    ubirch_protocol *device2 = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_REG,
+                                                   expected, msgpack_sbuffer_write, ed25519_sign, uuid2);
+
+    // a single working context switched between devices
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    ubirch_chain_store *store = ubirch_chain_store_new(2, 2);
+    ubirch_chain_put(store, UUID, UBIRCH_PROTOCOL_TYPE_BIN, NULL);
+    ubirch_chain_put(store, uuid2, UBIRCH_PROTOCOL_TYPE_REG, NULL);
+
+    for (int i = 0; i < 3; i++) {
+        ubirch_protocol *devices[2] = {device1, device2};
+        const unsigned char *uuids[2] = {UUID, uuid2};
+        for (int d = 0; d < 2; d++) {
+            msgpack_packer *dpk = msgpack_packer_new(devices[d], ubirch_protocol_write);
+            ubirch_protocol_start(devices[d], dpk);
+            msgpack_pack_int(dpk, i);
+            ubirch_protocol_finish(devices[d], dpk);
+            msgpack_packer_free(dpk);
+
+            TEST_ASSERT_EQUAL_INT(0, ubirch_chain_start(store, proto, pk, uuids[d]));
+            msgpack_pack_int(pk, i);
+            TEST_ASSERT_EQUAL_INT(0, ubirch_chain_finish(store, proto, pk));
+        }
+    }
+
+    TEST_ASSERT_EQUAL_INT(expected->size, sbuf->size);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected->data, sbuf->data, expected->size);
+
+    unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE];
+    ubirch_chain_get(store, uuid2, NULL, signature);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(device2->signature, signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+
+    // a context with a message in flight is not switched to another device
+    TEST_ASSERT_EQUAL_INT(0, ubirch_chain_start(store, proto, pk, UUID));
+    msgpack_pack_int(pk, 3);
+    TEST_ASSERT_EQUAL_INT(-2, ubirch_chain_start(store, proto, pk, uuid2));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(UUID, proto->uuid, UBIRCH_PROTOCOL_UUID_SIZE);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_chain_finish(store, proto, pk));
+    ubirch_chain_get(store, UUID, NULL, signature);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(proto->signature, signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+    ubirch_chain_get(store, uuid2, NULL, signature);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(device2->signature, signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+
+    // unknown devices and other variants are rejected
+    unsigned char unknown[UBIRCH_PROTOCOL_UUID_SIZE];
+    device_uuid(unknown, 3);
+    TEST_ASSERT_EQUAL_INT(-5, ubirch_chain_start(store, proto, pk, unknown));
+
+    // a message of a device removed in the meantime is not signed
+    TEST_ASSERT_EQUAL_INT(0, ubirch_chain_start(store, proto, pk, uuid2));
+    msgpack_pack_int(pk, 3);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_chain_remove(store, uuid2));
+    const size_t written = sbuf->size;
+    TEST_ASSERT_EQUAL_INT(-5, ubirch_chain_finish(store, proto, pk));
+    TEST_ASSERT_EQUAL_INT(written, sbuf->size);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(device2->signature, proto->signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+    ubirch_protocol_init(proto, proto_signed, UBIRCH_PROTOCOL_TYPE_BIN, sbuf, msgpack_sbuffer_write,
+                         ed25519_sign, UUID);
+    TEST_ASSERT_EQUAL_INT(-6, ubirch_chain_start(store, proto, pk, UUID));
+
+    ubirch_chain_store_free(store);
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+    ubirch_protocol_free(device1);
+    ubirch_protocol_free(device2);
+    msgpack_sbuffer_free(sbuf);
+    msgpack_sbuffer_free(expected);
+}
+
+#ifdef UBIRCH_CHAIN_FILE
+#include <unistd.h>
+
+#define CHAIN_FILE "chain_state.test"
+
+void TestChainFile() {
+    unlink(CHAIN_FILE);
+    ubirch_chain_file *file = ubirch_chain_file_open(CHAIN_FILE, 4, 0);
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_chain_file_put(file, UUID, UBIRCH_PROTOCOL_TYPE_BIN, NULL));
+
+    // reference context, chained over the restarts
+    msgpack_sbuffer *expected = msgpack_sbuffer_new();
+    ubirch_protocol *device = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                  expected, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *dpk = msgpack_packer_new(device, ubirch_protocol_write);
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+
+    for (int i = 0; i < 3; i++) {
+        ubirch_protocol_start(device, dpk);
+        msgpack_pack_int(dpk, i);
+        ubirch_protocol_finish(device, dpk);
+
+        TEST_ASSERT_EQUAL_INT(0, ubirch_chain_file_start(file, proto, pk, UUID));
+        msgpack_pack_int(pk, i);
+        TEST_ASSERT_EQUAL_INT(0, ubirch_chain_file_finish(file, proto, pk));
+
+        // restart, the second time with a larger capacity (rebuilds the file)
+        ubirch_chain_file_close(file);
+        file = ubirch_chain_file_open(CHAIN_FILE, i == 1 ? 100 : 4, 1);
+        TEST_ASSERT_NOT_NULL(file);
+    }
+    TEST_ASSERT_TRUE(file->header->capacity >= 128);
+
+    TEST_ASSERT_EQUAL_INT(expected->size, sbuf->size);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected->data, sbuf->data, expected->size);
+
+    unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE];
+    unsigned int type;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_chain_file_get(file, UUID, &type, signature));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(device->signature, signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+    TEST_ASSERT_EQUAL_UINT(UBIRCH_PROTOCOL_TYPE_BIN, type);
+
+    // a context with a message in flight is not switched to another device
+    unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE];
+    device_uuid(uuid, 1001);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_chain_file_put(file, uuid, UBIRCH_PROTOCOL_TYPE_BIN, NULL));
+    TEST_ASSERT_EQUAL_INT(0, ubirch_chain_file_start(file, proto, pk, UUID));
+    msgpack_pack_int(pk, 3);
+    TEST_ASSERT_EQUAL_INT(-2, ubirch_chain_file_start(file, proto, pk, uuid));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(UUID, proto->uuid, UBIRCH_PROTOCOL_UUID_SIZE);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_chain_file_finish(file, proto, pk));
+    TEST_ASSERT_EQUAL_INT(0, ubirch_chain_file_get(file, UUID, NULL, signature));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(proto->signature, signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+
+    // a message of an unknown device is not signed
+    device_uuid(uuid, 1000);
+    memcpy(proto->uuid, uuid, UBIRCH_PROTOCOL_UUID_SIZE);
+    ubirch_protocol_start(proto, pk);
+    msgpack_pack_int(pk, 3);
+    const size_t written = sbuf->size;
+    TEST_ASSERT_EQUAL_INT(-5, ubirch_chain_file_finish(file, proto, pk));
+    TEST_ASSERT_EQUAL_INT(written, sbuf->size);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(signature, proto->signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+
+    // the file is full at 3/4 of its capacity
+    size_t devices = 2;
+    for (unsigned int i = 0; i < 1000; i++) {
+        device_uuid(uuid, i);
+        if (ubirch_chain_file_put(file, uuid, UBIRCH_PROTOCOL_TYPE_BIN, NULL)) break;
+        devices++;
+    }
+    TEST_ASSERT_EQUAL_INT(file->header->capacity * 3 / 4, devices);
+
+    ubirch_chain_file_close(file);
+    msgpack_packer_free(pk);
+    msgpack_packer_free(dpk);
+    ubirch_protocol_free(proto);
+    ubirch_protocol_free(device);
+    msgpack_sbuffer_free(sbuf);
+    msgpack_sbuffer_free(expected);
+    unlink(CHAIN_FILE);
+}
+#endif
+
+utest::v1::status_t greentea_test_setup(const size_t number_of_cases) {
+    GREENTEA_SETUP(600, "default_auto");
+    return greentea_test_setup_handler(number_of_cases);
+}
+
+
+int main() {
+    Case cases[] = {
+            Case("ubirch protocol [chain] store",
+                 TestChainStore, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [chain] messages",
+                 TestChainMessages, greentea_case_failure_abort_handler),
+#ifdef UBIRCH_CHAIN_FILE
+            Case("ubirch protocol [chain] file",
+                 TestChainFile, greentea_case_failure_abort_handler),
+#endif
+    };
+
+    Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
+    Harness::run(specification);
+}
@@ -0,0 +1,174 @@
+#include <unity/unity.h>
+#include <ubirch/ubirch_protocol_chain_verify.h>
+#include <ubirch/ubirch_ed25519.h>
+
+#include "utest/utest.h"
+#include "greentea-client/test_env.h"
+
+using namespace utest::v1;
+
+static const unsigned char UUID[16] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p'};
+
+unsigned char ed25519_secret_key[crypto_sign_SECRETKEYBYTES] = {
+        0x69, 0x09, 0xcb, 0x3d, 0xff, 0x94, 0x43, 0x26, 0xed, 0x98, 0x72, 0x60,
+        0x1e, 0xb3, 0x3c, 0xb2, 0x2d, 0x9e, 0x20, 0xdb, 0xbb, 0xe8, 0x17, 0x34,
+        0x1c, 0x81, 0x33, 0x53, 0xda, 0xc9, 0xef, 0xbb, 0x7c, 0x76, 0xc4, 0x7c,
+        0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87, 0x01, 0x0f, 0x32, 0x4b,
+        0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf, 0x8f, 0xfd, 0xaa, 0x55,
+        0x93, 0xe6, 0x3e, 0x6a
+};
+unsigned char ed25519_public_key[crypto_sign_PUBLICKEYBYTES] = {
+        0x7c, 0x76, 0xc4, 0x7c, 0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87,
+        0x01, 0x0f, 0x32, 0x4b, 0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf,
+        0x8f, 0xfd, 0xaa, 0x55, 0x93, 0xe6, 0x3e, 0x6a
+};
+
+#define CHAIN_LENGTH 100
+
+static unsigned char *messages[CHAIN_LENGTH];
+static size_t sizes[CHAIN_LENGTH];
+static int results[CHAIN_LENGTH];
+
+/**
+ * Create a chain of messages, optionally continuing message `fork` from the
+ * message before `from` instead of the previous one.
+ */
+static void create_chain(size_t fork, size_t from) {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+
+    for (size_t i = 0; i < CHAIN_LENGTH; i++) {
+        if (i == fork) {
+            memcpy(proto->signature, messages[from - 1] + sizes[from - 1] - UBIRCH_PROTOCOL_SIGN_SIZE,
+                   UBIRCH_PROTOCOL_SIGN_SIZE);
+        }
+        msgpack_sbuffer_clear(sbuf);
+        ubirch_protocol_start(proto, pk);
+        msgpack_pack_int(pk, (int) i);
+        ubirch_protocol_finish(proto, pk);
+
+        messages[i] = (unsigned char *) malloc(sbuf->size);
+        memcpy(messages[i], sbuf->data, sbuf->size);
+        sizes[i] = sbuf->size;
+    }
+
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+    msgpack_sbuffer_free(sbuf);
+}
+
+static void free_chain() {
+    for (size_t i = 0; i < CHAIN_LENGTH; i++) free(messages[i]);
+}
+
+/**
+ * Verify the chain in two (sequential) runs, like two threads would.
+ */
+static int verify_chain(const unsigned char *previous, size_t *index) {
+    ubirch_chain_verifier verifier;
+    ubirch_chain_verifier_init(&verifier, messages, sizes, CHAIN_LENGTH, ed25519_public_key,
+                               ed25519_verify_batch_ctx, ed25519_verify_ctx, results);
+    size_t verified = ubirch_chain_verifier_run(&verifier);
+    verified += ubirch_chain_verifier_run(&verifier);
+    TEST_ASSERT_EQUAL_UINT(CHAIN_LENGTH, verified);
+
+    return ubirch_chain_verifier_finish(&verifier, previous, index);
+}
+
+void TestChainVerifyValid() {
+    const unsigned char zero[UBIRCH_PROTOCOL_SIGN_SIZE] = {0};
+    size_t index = 0;
+
+    create_chain(CHAIN_LENGTH, 0);
+    TEST_ASSERT_EQUAL_INT(UBIRCH_CHAIN_VALID, verify_chain(NULL, &index));
+    TEST_ASSERT_EQUAL_UINT(CHAIN_LENGTH, index);
+
+    // the first message starts a new chain
+    TEST_ASSERT_EQUAL_INT(UBIRCH_CHAIN_VALID, verify_chain(zero, &index));
+    TEST_ASSERT_EQUAL_INT(UBIRCH_CHAIN_BROKEN, verify_chain(messages[1] + UBIRCH_PROTOCOL_HEADER_PREV, &index));
+    TEST_ASSERT_EQUAL_UINT(0, index);
+    free_chain();
+}
+
+void TestChainVerifySignature() {
+    size_t index = 0;
+
+    create_chain(CHAIN_LENGTH, 0);
+    messages[50][sizes[50] - UBIRCH_PROTOCOL_SIGN_FIELD_SIZE - 1] ^= 1;
+    TEST_ASSERT_EQUAL_INT(UBIRCH_CHAIN_SIGNATURE, verify_chain(NULL, &index));
+    TEST_ASSERT_EQUAL_UINT(50, index);
+    TEST_ASSERT_EQUAL_INT(0, results[49]);
+    TEST_ASSERT_NOT_EQUAL(0, results[50]);
+    free_chain();
+}
+
+void TestChainVerifyBroken() {
+    size_t index = 0;
+
+    // a missing message (replaced by its successor)
+    create_chain(CHAIN_LENGTH, 0);
+    free(messages[30]);
+    messages[30] = (unsigned char *) malloc(sizes[31]);
+    memcpy(messages[30], messages[31], sizes[31]);
+    sizes[30] = sizes[31];
+    TEST_ASSERT_EQUAL_INT(UBIRCH_CHAIN_BROKEN, verify_chain(NULL, &index));
+    TEST_ASSERT_EQUAL_UINT(30, index);
+    free_chain();
+
+    // messages in the wrong order
+    create_chain(CHAIN_LENGTH, 0);
+    unsigned char *message = messages[70];
+    const size_t size = sizes[70];
+    messages[70] = messages[71];
+    sizes[70] = sizes[71];
+    messages[71] = message;
+    sizes[71] = size;
+    TEST_ASSERT_EQUAL_INT(UBIRCH_CHAIN_BROKEN, verify_chain(NULL, &index));
+    TEST_ASSERT_EQUAL_UINT(70, index);
+    free_chain();
+}
+
+void TestChainVerifyFork() {
+    size_t index = 0;
+
+    // message 60 continues from message 40 again
+    create_chain(60, 41);
+    TEST_ASSERT_EQUAL_INT(UBIRCH_CHAIN_FORK, verify_chain(NULL, &index));
+    TEST_ASSERT_EQUAL_UINT(60, index);
+    free_chain();
+}
+
+void TestChainVerifyMalformed() {
+    size_t index = 0;
+
+    create_chain(CHAIN_LENGTH, 0);
+    messages[10][5] ^= 1;
+    TEST_ASSERT_EQUAL_INT(UBIRCH_CHAIN_MALFORMED, verify_chain(NULL, &index));
+    TEST_ASSERT_EQUAL_UINT(10, index);
+    free_chain();
+}
+
+utest::v1::status_t greentea_test_setup(const size_t number_of_cases) {
+    GREENTEA_SETUP(600, "default_auto");
+    return greentea_test_setup_handler(number_of_cases);
+}
+
+int main() {
+    Case cases[] = {
+            Case("ubirch protocol [chain verify] valid chain",
+                 TestChainVerifyValid, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [chain verify] invalid signature",
+                 TestChainVerifySignature, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [chain verify] broken chain",
+                 TestChainVerifyBroken, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [chain verify] forked chain",
+                 TestChainVerifyFork, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [chain verify] malformed message",
+                 TestChainVerifyMalformed, greentea_case_failure_abort_handler),
+    };
+
+    Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
+    Harness::run(specification);
+}
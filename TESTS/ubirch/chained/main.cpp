@@ -34,6 +34,7 @@ void TestProtocolInit() {
     TEST_ASSERT_EQUAL_PTR(dummybuffer, proto.packer.data);
     TEST_ASSERT_EQUAL_PTR(msgpack_sbuffer_write, proto.packer.callback);
     TEST_ASSERT_EQUAL_HEX16(proto_chained, proto.version);
+    TEST_ASSERT_EQUAL_PTR(ubirch_protocol_write_signed, ubirch_protocol_writer(&proto));
     TEST_ASSERT_EQUAL_PTR(ed25519_sign, proto.sign);
     TEST_ASSERT_EQUAL_UINT8_ARRAY(UUID, proto.uuid, 16);
 }
@@ -172,6 +173,145 @@ void TestProtocolMessageFinish() {
     ubirch_protocol_free(proto);
 }
 
+static int write_calls = 0;
+
+static int counting_sbuffer_write(void *data, const char *buf, size_t len) {
+    write_calls++;
+    return msgpack_sbuffer_write(data, buf, len);
+}
+
+void TestProtocolMessageStaged() {
+    char staging[128];
+
+    // reference message without staging
+    msgpack_sbuffer *expected = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 expected, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    ubirch_protocol_start(proto, pk);
+    msgpack_pack_int(pk, 2498);
+    ubirch_protocol_finish(proto, pk);
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+
+    // the same message with a staging buffer
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                sbuf, counting_sbuffer_write, ed25519_sign, UUID);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_set_write_buffer(proto, staging, sizeof(staging)));
+    pk = msgpack_packer_new(proto, ubirch_protocol_write);
+
+    write_calls = 0;
+    ubirch_protocol_start(proto, pk);
+    msgpack_pack_int(pk, 2498);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, sbuf->size, "data must be staged until finish");
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_finish(proto, pk));
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(2, write_calls, "staged writes not coalesced");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(expected->size, sbuf->size, "message length wrong");
+    TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected->data, sbuf->data, sbuf->size, "staged message differs");
+
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+    msgpack_sbuffer_free(sbuf);
+    msgpack_sbuffer_free(expected);
+}
+
+void TestProtocolMessageStartSingleWrite() {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sbuf, counting_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+
+    // the previous signature must be taken from the context at start
+    memset(proto->signature, 0xaa, sizeof(proto->signature));
+
+    write_calls = 0;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_start(proto, pk));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, write_calls, "header must be written at once");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(89, sbuf->size, "header size wrong");
+    TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(proto->signature, sbuf->data + 24, 64, "prev signature wrong");
+    TEST_ASSERT_EQUAL_HEX_MESSAGE(0x00, sbuf->data[88], "payload type wrong");
+
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+    msgpack_sbuffer_free(sbuf);
+}
+
+void TestProtocolMessageEncode() {
+    // the payload is the msgpack encoded int 2498
+    const unsigned char payload[] = {0xcd, 0x09, 0xc2};
+    const size_t message_size = ubirch_protocol_message_size(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                             sizeof(payload));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(159, message_size, "message size calculation wrong");
+
+    // encode the same message using the streaming api
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    ubirch_protocol_start(proto, pk);
+    msgpack_pack_int(pk, 2498);
+    ubirch_protocol_finish(proto, pk);
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+
+    unsigned char buffer[159];
+    size_t len = 0;
+    proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                NULL, NULL, ed25519_sign, UUID);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-4, ubirch_protocol_encode(proto, payload, sizeof(payload),
+                                                             buffer, sizeof(buffer) - 1, &len), "buffer too small");
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_encode(proto, payload, sizeof(payload), buffer, sizeof(buffer), &len));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(message_size, len, "encoded message length wrong");
+    TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(sbuf->data, buffer, sbuf->size, "encoded message differs");
+    TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(buffer + len - 64, proto->signature, 64, "signature not kept for chaining");
+
+    ubirch_protocol_free(proto);
+    msgpack_sbuffer_free(sbuf);
+}
+
+/**
+ * A writer with a different address than ubirch_protocol_write_signed, like the
+ * copy of it in another unit (the writers are static inline).
+ */
+static int other_unit_write(void *data, const char *buf, size_t len) {
+    return ubirch_protocol_write_signed(data, buf, len);
+}
+
+void TestProtocolMessageStagedOtherUnit() {
+    char staging[128];
+
+    msgpack_sbuffer *expected = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 expected, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    ubirch_protocol_start(proto, pk);
+    msgpack_pack_int(pk, 2498);
+    ubirch_protocol_finish(proto, pk);
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+
+    // the staged data must be hashed, whichever unit the context was initialized in
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    proto->write = other_unit_write;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_set_write_buffer(proto, staging, sizeof(staging)));
+    pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    ubirch_protocol_start(proto, pk);
+    msgpack_pack_int(pk, 2498);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_finish(proto, pk));
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(expected->size, sbuf->size, "message length wrong");
+    TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected->data, sbuf->data, sbuf->size, "staged data not hashed");
+
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+    msgpack_sbuffer_free(sbuf);
+    msgpack_sbuffer_free(expected);
+}
+
 void TestSimpleMessage() {
     char _key[20], _value[300];
     size_t encoded_size;
@@ -303,6 +443,59 @@ void TestChainedStaticMessage() {
 
 }
 
+static int completed = 0;
+
+static void count_completed(ubirch_protocol_pending *pending, int result) {
+    TEST_ASSERT_EQUAL_INT(0, result);
+    completed++;
+}
+
+void TestChainedMessageAsync() {
+    msgpack_sbuffer *expected = msgpack_sbuffer_new();
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *sync = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                expected, msgpack_sbuffer_write, ed25519_sign, UUID);
+    ubirch_protocol *proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *sync_pk = msgpack_packer_new(sync, ubirch_protocol_write);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+
+    // not initialized, the callback is cleared by ubirch_protocol_finish_hash
+    ubirch_protocol_pending pending;
+    memset(&pending, 0xff, sizeof(pending));
+    completed = 0;
+
+    for (int i = 0; i < 3; i++) {
+        ubirch_protocol_start(sync, sync_pk);
+        msgpack_pack_int(sync_pk, i);
+        TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_finish(sync, sync_pk));
+
+        TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_start(proto, pk));
+        msgpack_pack_int(pk, i);
+        TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_finish_hash(proto, &pending));
+        // the first message without a callback
+        if (i > 0) pending.done = count_completed;
+
+        // the context is busy until the signature is written
+        TEST_ASSERT_EQUAL_INT(-2, ubirch_protocol_start(proto, pk));
+        TEST_ASSERT_EQUAL_INT(-2, ubirch_protocol_finish(proto, pk));
+
+        TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_complete(&pending));
+        TEST_ASSERT_EQUAL_INT(i, completed);
+        TEST_ASSERT_EQUAL_INT(-2, ubirch_protocol_complete(&pending));
+    }
+
+    TEST_ASSERT_EQUAL_INT(expected->size, sbuf->size);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected->data, sbuf->data, expected->size);
+
+    msgpack_packer_free(sync_pk);
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(sync);
+    ubirch_protocol_free(proto);
+    msgpack_sbuffer_free(expected);
+    msgpack_sbuffer_free(sbuf);
+}
+
 void TestVerifyMessage() {
     // create a new message a sign it
     msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
@@ -358,6 +551,16 @@ int main() {
                  TestProtocolMessageFinish, greentea_case_failure_abort_handler),
             Case("ubirch protocol [chained] static message",
                  TestChainedStaticMessage, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [chained] message staged",
+                 TestProtocolMessageStaged, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [chained] staged message, context of another unit",
+                 TestProtocolMessageStagedOtherUnit, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [chained] message start single write",
+                 TestProtocolMessageStartSingleWrite, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [chained] message encode",
+                 TestProtocolMessageEncode, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [chained] message async sign",
+                 TestChainedMessageAsync, greentea_case_failure_abort_handler),
     };
 
     Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
@@ -0,0 +1,78 @@
+#include <unity/unity.h>
+#include <ubirch/digest/sha512_mb.h>
+
+#include "utest/utest.h"
+#include "greentea-client/test_env.h"
+
+using namespace utest::v1;
+
+#define MB_MESSAGES 11
+
+static unsigned char data[MB_MESSAGES][300];
+
+static void fill(void) {
+    for (unsigned int i = 0; i < MB_MESSAGES; i++) {
+        for (unsigned int j = 0; j < sizeof(data[i]); j++) {
+            data[i][j] = (unsigned char) (i * 31 + j * 7);
+        }
+    }
+}
+
+void TestMultiBufferMatchesSingle() {
+    // lengths around the padding boundaries (111/112, 127/128, 239/240)
+    const size_t lengths[MB_MESSAGES] = {0, 3, 90, 111, 112, 127, 128, 200, 239, 240, 300};
+    const unsigned char *input[MB_MESSAGES];
+    unsigned char output[MB_MESSAGES][64];
+    unsigned char expected[64];
+
+    fill();
+    for (unsigned int i = 0; i < MB_MESSAGES; i++) input[i] = data[i];
+
+    mbedtls_sha512_mb(input, lengths, output, MB_MESSAGES, 0);
+
+    for (unsigned int i = 0; i < MB_MESSAGES; i++) {
+        mbedtls_sha512(input[i], lengths[i], expected, 0);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected, output[i], sizeof(expected), "multi-buffer sha512 mismatch");
+    }
+}
+
+void TestMultiBufferSha384() {
+    const size_t lengths[3] = {17, 129, 250};
+    const unsigned char *input[3] = {data[0], data[1], data[2]};
+    unsigned char output[3][64];
+    unsigned char expected[64];
+
+    fill();
+    mbedtls_sha512_mb(input, lengths, output, 3, 1);
+
+    for (unsigned int i = 0; i < 3; i++) {
+        mbedtls_sha512(input[i], lengths[i], expected, 1);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected, output[i], 48, "multi-buffer sha384 mismatch");
+    }
+}
+
+void TestMultiBufferEmpty() {
+    // must not touch anything when there are no messages
+    mbedtls_sha512_mb(NULL, NULL, NULL, 0, 0);
+    TEST_ASSERT_TRUE(mbedtls_sha512_mb_lanes() >= 1);
+}
+
+utest::v1::status_t greentea_test_setup(const size_t number_of_cases) {
+    GREENTEA_SETUP(600, "default_auto");
+    return greentea_test_setup_handler(number_of_cases);
+}
+
+
+int main() {
+    Case cases[] = {
+            Case("ubirch digest [sha512 mb] matches single buffer",
+                 TestMultiBufferMatchesSingle, greentea_case_failure_abort_handler),
+            Case("ubirch digest [sha512 mb] sha384",
+                 TestMultiBufferSha384, greentea_case_failure_abort_handler),
+            Case("ubirch digest [sha512 mb] empty",
+                 TestMultiBufferEmpty, greentea_case_failure_abort_handler),
+    };
+
+    Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
+    Harness::run(specification);
+}
@@ -0,0 +1,217 @@
+#include <unity/unity.h>
+#include <ubirch/ubirch_protocol_iov.h>
+#include <ubirch/ubirch_protocol_view.h>
+#include <ubirch/ubirch_ed25519.h>
+
+#include "utest/utest.h"
+#include "greentea-client/test_env.h"
+
+using namespace utest::v1;
+
+static const unsigned char UUID[16] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p'};
+
+unsigned char ed25519_secret_key[crypto_sign_SECRETKEYBYTES] = {
+        0x69, 0x09, 0xcb, 0x3d, 0xff, 0x94, 0x43, 0x26, 0xed, 0x98, 0x72, 0x60,
+        0x1e, 0xb3, 0x3c, 0xb2, 0x2d, 0x9e, 0x20, 0xdb, 0xbb, 0xe8, 0x17, 0x34,
+        0x1c, 0x81, 0x33, 0x53, 0xda, 0xc9, 0xef, 0xbb, 0x7c, 0x76, 0xc4, 0x7c,
+        0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87, 0x01, 0x0f, 0x32, 0x4b,
+        0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf, 0x8f, 0xfd, 0xaa, 0x55,
+        0x93, 0xe6, 0x3e, 0x6a
+};
+unsigned char ed25519_public_key[crypto_sign_PUBLICKEYBYTES] = {
+        0x7c, 0x76, 0xc4, 0x7c, 0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87,
+        0x01, 0x0f, 0x32, 0x4b, 0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf,
+        0x8f, 0xfd, 0xaa, 0x55, 0x93, 0xe6, 0x3e, 0x6a
+};
+
+#define SNAPSHOT_SIZE 200000
+
+static char snapshot[SNAPSHOT_SIZE];
+
+/**
+ * Pack a message with a small field and a large body, to a sink or a buffer.
+ */
+static void pack_message(ubirch_iov_sink *sink, ubirch_protocol *proto, msgpack_packer *pk, size_t len) {
+    ubirch_protocol_start(proto, pk);
+    msgpack_pack_array(pk, 2);
+    msgpack_pack_int(pk, (int) len);
+    msgpack_pack_raw(pk, len);
+    msgpack_pack_raw_body(pk, snapshot, len);
+    if (sink != NULL) {
+        TEST_ASSERT_EQUAL_INT(0, ubirch_iov_finish(sink, proto, pk));
+    } else {
+        TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_finish(proto, pk));
+    }
+}
+
+/**
+ * Gather the segments into one buffer.
+ */
+static msgpack_sbuffer *gather(const ubirch_iovec *iov, size_t count) {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    for (size_t i = 0; i < count; i++) {
+        msgpack_sbuffer_write(sbuf, (const char *) iov[i].iov_base, iov[i].iov_len);
+    }
+    return sbuf;
+}
+
+/**
+ * Write the same messages through a sink and to a buffer, and compare them.
+ */
+static void check_messages(ubirch_protocol_variant variant, const size_t lens[], size_t n, size_t wbuf_size) {
+    msgpack_sbuffer *expected = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(variant, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 expected, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    for (size_t i = 0; i < n; i++) pack_message(NULL, proto, pk, lens[i]);
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+
+    ubirch_iov_sink *sink = ubirch_iov_new(64, 1024);
+    TEST_ASSERT_NOT_NULL(sink);
+    proto = ubirch_protocol_new(variant, UBIRCH_PROTOCOL_TYPE_BIN, sink, ubirch_iov_write, ed25519_sign, UUID);
+    char wbuf[256];
+    if (wbuf_size) ubirch_protocol_set_write_buffer(proto, wbuf, wbuf_size);
+    pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    for (size_t i = 0; i < n; i++) {
+        pack_message(sink, proto, pk, lens[i]);
+        if (variant == proto_plain) {
+            TEST_ASSERT_EQUAL_UINT(sink->count, sink->signature);
+        } else {
+            // the signature is the last segment
+            TEST_ASSERT_EQUAL_UINT(sink->count - 1, sink->signature);
+            TEST_ASSERT_NULL(sink->segments[sink->signature].base);
+            TEST_ASSERT_EQUAL_UINT(UBIRCH_PROTOCOL_SIGN_FIELD_SIZE, sink->segments[sink->signature].len);
+        }
+    }
+
+    size_t count;
+    const ubirch_iovec *iov = ubirch_iov_vector(sink, &count);
+    size_t referenced = 0, copied = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (sink->segments[i].base != NULL) {
+            TEST_ASSERT_EQUAL_PTR(snapshot, iov[i].iov_base);
+            referenced++;
+        } else {
+            copied += iov[i].iov_len;
+        }
+    }
+    msgpack_sbuffer *sbuf = gather(iov, count);
+    TEST_ASSERT_EQUAL_UINT(expected->size, sbuf->size);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected->data, sbuf->data, expected->size);
+    TEST_ASSERT_EQUAL_UINT(copied, sink->len);
+
+    // only the large bodies are referenced
+    size_t large = 0;
+    for (size_t i = 0; i < n; i++) large += lens[i] >= 1024;
+    TEST_ASSERT_EQUAL_UINT(large, referenced);
+
+    // the messages are valid
+    ubirch_protocol_view view;
+    size_t offset = 0;
+    for (size_t i = 0; i < n; i++) {
+        TEST_ASSERT_EQUAL_INT(variant == proto_plain ? -2 : 0,
+                              ubirch_protocol_verify_view((const unsigned char *) sbuf->data + offset,
+                                                          sbuf->size - offset, ed25519_verify_ctx,
+                                                          ed25519_public_key, &view));
+        offset += view.len;
+    }
+    TEST_ASSERT_EQUAL_UINT(sbuf->size, offset);
+
+    msgpack_sbuffer_free(sbuf);
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+    ubirch_iov_free(sink);
+    msgpack_sbuffer_free(expected);
+}
+
+void TestIovSigned() {
+    for (size_t i = 0; i < SNAPSHOT_SIZE; i++) snapshot[i] = (char) (i * 7);
+    const size_t lens[] = {SNAPSHOT_SIZE};
+    check_messages(proto_signed, lens, 1, 0);
+
+    // header and small fields, the snapshot and the signature
+    ubirch_iov_sink *sink = ubirch_iov_new(64, 1024);
+    ubirch_protocol *proto = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sink, ubirch_iov_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    pack_message(sink, proto, pk, SNAPSHOT_SIZE);
+    size_t count;
+    const ubirch_iovec *iov = ubirch_iov_vector(sink, &count);
+    TEST_ASSERT_EQUAL_UINT(3, count);
+    TEST_ASSERT_EQUAL_PTR(snapshot, iov[1].iov_base);
+    TEST_ASSERT_EQUAL_UINT(SNAPSHOT_SIZE, iov[1].iov_len);
+    TEST_ASSERT_EQUAL_UINT(2, sink->signature);
+
+    // the memory is kept when reset
+    char *buf = sink->buf;
+    ubirch_iov_reset(sink);
+    TEST_ASSERT_EQUAL_UINT(0, sink->count);
+    pack_message(sink, proto, pk, SNAPSHOT_SIZE);
+    TEST_ASSERT_EQUAL_PTR(buf, sink->buf);
+    TEST_ASSERT_EQUAL_UINT(3, sink->count);
+
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+    ubirch_iov_free(sink);
+}
+
+void TestIovChained() {
+    const size_t lens[] = {10, SNAPSHOT_SIZE, 1023, 1024, 0, 50000, 300};
+    check_messages(proto_chained, lens, sizeof(lens) / sizeof(lens[0]), 0);
+    check_messages(proto_plain, lens, sizeof(lens) / sizeof(lens[0]), 0);
+}
+
+void TestIovWriteBuffer() {
+    const size_t lens[] = {10, SNAPSHOT_SIZE, 200, 5000};
+    check_messages(proto_signed, lens, sizeof(lens) / sizeof(lens[0]), 256);
+    check_messages(proto_chained, lens, sizeof(lens) / sizeof(lens[0]), 256);
+
+    // a write buffer not smaller than the threshold would be referenced and overwritten
+    ubirch_iov_sink *sink = ubirch_iov_new(64, 100);
+    ubirch_protocol *proto = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sink, ubirch_iov_write, ed25519_sign, UUID);
+    char wbuf[4096];
+    ubirch_protocol_set_write_buffer(proto, wbuf, sizeof(wbuf));
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    ubirch_protocol_start(proto, pk);
+    msgpack_pack_raw(pk, 200);
+    msgpack_pack_raw_body(pk, snapshot, 200);
+    TEST_ASSERT_EQUAL_INT(-5, ubirch_iov_finish(sink, proto, pk));
+
+    // the context can be used again with a smaller write buffer
+    ubirch_iov_reset(sink);
+    ubirch_protocol_set_write_buffer(proto, wbuf, 64);
+    pack_message(sink, proto, pk, 200);
+    size_t count;
+    const ubirch_iovec *iov = ubirch_iov_vector(sink, &count);
+    msgpack_sbuffer *sbuf = gather(iov, count);
+    ubirch_protocol_view view;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_verify_view((const unsigned char *) sbuf->data, sbuf->size,
+                                                         ed25519_verify_ctx, ed25519_public_key, &view));
+    TEST_ASSERT_EQUAL_UINT(sbuf->size, view.len);
+
+    msgpack_sbuffer_free(sbuf);
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+    ubirch_iov_free(sink);
+}
+
+utest::v1::status_t greentea_test_setup(const size_t number_of_cases) {
+    GREENTEA_SETUP(600, "default_auto");
+    return greentea_test_setup_handler(number_of_cases);
+}
+
+int main() {
+    Case cases[] = {
+            Case("ubirch protocol [iov] signed message with a large payload",
+                 TestIovSigned, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [iov] chained and plain messages",
+                 TestIovChained, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [iov] with a write buffer",
+                 TestIovWriteBuffer, greentea_case_failure_abort_handler),
+    };
+
+    Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
+    Harness::run(specification);
+}
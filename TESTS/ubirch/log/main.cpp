@@ -0,0 +1,195 @@
+#include <unity/unity.h>
+#include <ubirch/ubirch_protocol_log.h>
+#include <ubirch/ubirch_ed25519.h>
+
+#include "utest/utest.h"
+#include "greentea-client/test_env.h"
+
+using namespace utest::v1;
+
+static const unsigned char UUID[16] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p'};
+
+unsigned char ed25519_secret_key[crypto_sign_SECRETKEYBYTES] = {
+        0x69, 0x09, 0xcb, 0x3d, 0xff, 0x94, 0x43, 0x26, 0xed, 0x98, 0x72, 0x60,
+        0x1e, 0xb3, 0x3c, 0xb2, 0x2d, 0x9e, 0x20, 0xdb, 0xbb, 0xe8, 0x17, 0x34,
+        0x1c, 0x81, 0x33, 0x53, 0xda, 0xc9, 0xef, 0xbb, 0x7c, 0x76, 0xc4, 0x7c,
+        0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87, 0x01, 0x0f, 0x32, 0x4b,
+        0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf, 0x8f, 0xfd, 0xaa, 0x55,
+        0x93, 0xe6, 0x3e, 0x6a
+};
+unsigned char ed25519_public_key[crypto_sign_PUBLICKEYBYTES] = {
+        0x7c, 0x76, 0xc4, 0x7c, 0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87,
+        0x01, 0x0f, 0x32, 0x4b, 0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf,
+        0x8f, 0xfd, 0xaa, 0x55, 0x93, 0xe6, 0x3e, 0x6a
+};
+
+#ifdef UBIRCH_LOG
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOG_DIR "log.test"
+#define LOG_MESSAGES 20
+
+static void remove_log() {
+    char path[64];
+    for (unsigned int i = 0; i < 100; i++) {
+        snprintf(path, sizeof(path), LOG_DIR "/%08u.log", i);
+        unlink(path);
+        snprintf(path, sizeof(path), LOG_DIR "/%08u.idx", i);
+        unlink(path);
+    }
+    rmdir(LOG_DIR);
+}
+
+void TestLogWriteRead() {
+    unsigned char uuid2[UBIRCH_PROTOCOL_UUID_SIZE];
+    memcpy(uuid2, UUID, sizeof(uuid2));
+    uuid2[15] = 'x';
+
+    remove_log();
+    // small segments, about four messages each
+    ubirch_log *log = ubirch_log_open(LOG_DIR, 600);
+    TEST_ASSERT_NOT_NULL(log);
+
+    ubirch_protocol *device1 = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                   log, ubirch_log_write, ed25519_sign, UUID);
+    ubirch_protocol *device2 = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                   log, ubirch_log_write, ed25519_sign, uuid2);
+    msgpack_packer *pk1 = msgpack_packer_new(device1, ubirch_protocol_write);
+    msgpack_packer *pk2 = msgpack_packer_new(device2, ubirch_protocol_write);
+
+    unsigned char signatures[LOG_MESSAGES][UBIRCH_PROTOCOL_SIGN_SIZE];
+    for (int i = 0; i < LOG_MESSAGES; i++) {
+        ubirch_protocol_start(device1, pk1);
+        msgpack_pack_int(pk1, i);
+        ubirch_protocol_finish(device1, pk1);
+        TEST_ASSERT_EQUAL_INT(0, ubirch_log_commit(log));
+        memcpy(signatures[i], device1->signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+
+        ubirch_protocol_start(device2, pk2);
+        msgpack_pack_int(pk2, i);
+        ubirch_protocol_finish(device2, pk2);
+        TEST_ASSERT_EQUAL_INT(0, ubirch_log_commit(log));
+    }
+    TEST_ASSERT_TRUE(log->segment > 5);
+
+    // not a ubirch protocol message
+    const unsigned char garbage[] = {0x93, 0x01, 0x02, 0x03};
+    TEST_ASSERT_EQUAL_INT(-2, ubirch_log_append(log, garbage, sizeof(garbage)));
+    ubirch_log_close(log);
+
+    // the chain of device 1 from its 5th message
+    ubirch_log_reader *reader = ubirch_log_reader_open(LOG_DIR);
+    TEST_ASSERT_NOT_NULL(reader);
+    ubirch_log_cursor cursor = {};
+    ubirch_log_view view;
+    uint32_t seq = 5;
+    while (!ubirch_log_next(reader, &cursor, UUID, 5, &view)) {
+        TEST_ASSERT_EQUAL_UINT32(seq, view.index->seq);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(signatures[seq], view.message + view.len - UBIRCH_PROTOCOL_SIGN_SIZE,
+                                     UBIRCH_PROTOCOL_SIGN_SIZE);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(signatures[seq], view.index->signature, UBIRCH_LOG_SIGN_PREFIX);
+        // the previous signature is part of the chained message
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(signatures[seq - 1], view.message + UBIRCH_PROTOCOL_HEADER_PREV,
+                                     UBIRCH_PROTOCOL_SIGN_SIZE);
+        seq++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(LOG_MESSAGES, seq);
+
+    // all messages
+    memset(&cursor, 0, sizeof(cursor));
+    int count = 0;
+    while (!ubirch_log_next(reader, &cursor, NULL, 0, &view)) count++;
+    TEST_ASSERT_EQUAL_INT(2 * LOG_MESSAGES, count);
+    ubirch_log_reader_close(reader);
+
+    msgpack_packer_free(pk1);
+    msgpack_packer_free(pk2);
+    ubirch_protocol_free(device1);
+    ubirch_protocol_free(device2);
+}
+
+void TestLogRecover() {
+    // a message without index entry, as after a crash
+    char path[64];
+    unsigned int last = 0;
+    snprintf(path, sizeof(path), LOG_DIR "/%08u.log", last);
+    while (access(path, F_OK) == 0) snprintf(path, sizeof(path), LOG_DIR "/%08u.log", ++last);
+    snprintf(path, sizeof(path), LOG_DIR "/%08u.log", last - 1);
+    FILE *f = fopen(path, "ab");
+    TEST_ASSERT_NOT_NULL(f);
+    fwrite("incomplete", 1, 10, f);
+    fclose(f);
+
+    ubirch_log *log = ubirch_log_open(LOG_DIR, 600);
+    TEST_ASSERT_NOT_NULL(log);
+
+    // a received message continues the chain position of its sender
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    ubirch_protocol_start(proto, pk);
+    msgpack_pack_int(pk, 99);
+    ubirch_protocol_finish(proto, pk);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_log_append(log, (const unsigned char *) sbuf->data, sbuf->size));
+    ubirch_log_close(log);
+
+    // the index entry reached the disk, the message did not completely
+    struct stat st;
+    snprintf(path, sizeof(path), LOG_DIR "/%08u.log", last);
+    while (access(path, F_OK) == 0) snprintf(path, sizeof(path), LOG_DIR "/%08u.log", ++last);
+    snprintf(path, sizeof(path), LOG_DIR "/%08u.log", last - 1);
+    TEST_ASSERT_EQUAL_INT(0, stat(path, &st));
+    const off_t size = st.st_size;
+    TEST_ASSERT_EQUAL_INT(0, truncate(path, size - 1));
+
+    // the entry is dropped instead of extending the segment, the message is appended again
+    log = ubirch_log_open(LOG_DIR, 600);
+    TEST_ASSERT_NOT_NULL(log);
+    TEST_ASSERT_EQUAL_INT(0, stat(path, &st));
+    TEST_ASSERT_EQUAL_INT(size - sbuf->size, st.st_size);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_log_append(log, (const unsigned char *) sbuf->data, sbuf->size));
+    ubirch_log_close(log);
+
+    ubirch_log_reader *reader = ubirch_log_reader_open(LOG_DIR);
+    ubirch_log_cursor cursor = {};
+    ubirch_log_view view;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_log_next(reader, &cursor, UUID, LOG_MESSAGES, &view));
+    TEST_ASSERT_EQUAL_UINT32(LOG_MESSAGES, view.index->seq);
+    TEST_ASSERT_EQUAL_INT(sbuf->size, view.len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(sbuf->data, view.message, sbuf->size);
+    TEST_ASSERT_EQUAL_INT(-1, ubirch_log_next(reader, &cursor, UUID, LOG_MESSAGES, &view));
+    ubirch_log_reader_close(reader);
+
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+    msgpack_sbuffer_free(sbuf);
+    remove_log();
+}
+
+utest::v1::status_t greentea_test_setup(const size_t number_of_cases) {
+    GREENTEA_SETUP(600, "default_auto");
+    return greentea_test_setup_handler(number_of_cases);
+}
+
+
+int main() {
+    Case cases[] = {
+            Case("ubirch protocol [log] write and read",
+                 TestLogWriteRead, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [log] recover",
+                 TestLogRecover, greentea_case_failure_abort_handler),
+    };
+
+    Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
+    Harness::run(specification);
+}
+#else
+// the message log needs a file system with mmap
+int main() {
+    GREENTEA_SETUP(10, "default_auto");
+    GREENTEA_TESTSUITE_RESULT(true);
+}
+#endif
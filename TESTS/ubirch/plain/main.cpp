@@ -19,6 +19,7 @@ void TestProtocolInit() {
     TEST_ASSERT_EQUAL_PTR(dummybuffer, proto.packer.data);
     TEST_ASSERT_EQUAL_PTR(msgpack_sbuffer_write, proto.packer.callback);
     TEST_ASSERT_EQUAL_HEX16(proto_plain, proto.version);
+    TEST_ASSERT_EQUAL_PTR(ubirch_protocol_write_plain, ubirch_protocol_writer(&proto));
     TEST_ASSERT_NULL(proto.sign);
     TEST_ASSERT_EQUAL_UINT8_ARRAY(UUID, proto.uuid, 16);
 }
@@ -118,6 +119,8 @@ void TestProtocolMessageFinish() {
 
     TEST_ASSERT_EQUAL_INT_MESSAGE(0, finish_ok, "message finish failed");
     TEST_ASSERT_EQUAL_INT_MESSAGE(25, sbuf->size, "message length wrong");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(25, ubirch_protocol_message_size(proto_plain, UBIRCH_PROTOCOL_TYPE_BIN, 3),
+                                  "message size calculation wrong");
 
     const unsigned char expected_message[25] = {
             0x94, 0xcd, 0x00, 0x11, 0xb0, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d,
@@ -130,6 +133,24 @@ void TestProtocolMessageFinish() {
     ubirch_protocol_free(proto);
 }
 
+void TestProtocolMessagePlainWriter() {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_plain, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sbuf, msgpack_sbuffer_write, NULL, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_writer(proto));
+
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_start(proto, pk));
+    msgpack_pack_int(pk, 2498);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_finish(proto, pk));
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(25, sbuf->size, "message length wrong");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, proto->hash.is384, "plain messages must not be hashed");
+
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+    msgpack_sbuffer_free(sbuf);
+}
+
 void TestSimpleMessage() {
     char _key[20], _value[300];
     size_t encoded_size;
@@ -181,6 +202,8 @@ int main() {
                  TestProtocolMessageFinishWithoutStart, greentea_case_failure_abort_handler),
             Case("ubirch protocol [plain] message finish",
                  TestProtocolMessageFinish, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [plain] message plain writer",
+                 TestProtocolMessagePlainWriter, greentea_case_failure_abort_handler),
     };
 
     Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
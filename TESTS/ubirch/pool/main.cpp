@@ -0,0 +1,231 @@
+#include <unity/unity.h>
+#include <ubirch/ubirch_protocol_pool.h>
+#include <ubirch/ubirch_ed25519.h>
+#include <ubirch/ubirch_protocol_view.h>
+
+#include "utest/utest.h"
+#include "greentea-client/test_env.h"
+
+using namespace utest::v1;
+
+static const unsigned char UUID[16] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p'};
+
+unsigned char ed25519_secret_key[crypto_sign_SECRETKEYBYTES] = {
+        0x69, 0x09, 0xcb, 0x3d, 0xff, 0x94, 0x43, 0x26, 0xed, 0x98, 0x72, 0x60,
+        0x1e, 0xb3, 0x3c, 0xb2, 0x2d, 0x9e, 0x20, 0xdb, 0xbb, 0xe8, 0x17, 0x34,
+        0x1c, 0x81, 0x33, 0x53, 0xda, 0xc9, 0xef, 0xbb, 0x7c, 0x76, 0xc4, 0x7c,
+        0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87, 0x01, 0x0f, 0x32, 0x4b,
+        0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf, 0x8f, 0xfd, 0xaa, 0x55,
+        0x93, 0xe6, 0x3e, 0x6a
+};
+unsigned char ed25519_public_key[crypto_sign_PUBLICKEYBYTES] = {
+        0x7c, 0x76, 0xc4, 0x7c, 0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87,
+        0x01, 0x0f, 0x32, 0x4b, 0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf,
+        0x8f, 0xfd, 0xaa, 0x55, 0x93, 0xe6, 0x3e, 0x6a
+};
+
+#define POOL_CONTEXTS 3
+#define POOL_MESSAGES 7
+
+void TestQueue() {
+    ubirch_queue queue;
+    ubirch_queue_cell cells[4];
+    ubirch_pool_item items[8];
+
+    TEST_ASSERT_EQUAL_INT(-1, ubirch_queue_init(&queue, cells, 3));
+    TEST_ASSERT_EQUAL_INT(0, ubirch_queue_init(&queue, cells, 4));
+    TEST_ASSERT_EQUAL_INT(0, ubirch_queue_pop(&queue, items, 8));
+
+    // fill the queue twice, items come out in order and it never takes more than it holds
+    for (unsigned int round = 0; round < 2; round++) {
+        for (unsigned int i = 0; i < 4; i++) {
+            ubirch_pool_item item = {i, NULL, 0, NULL};
+            TEST_ASSERT_EQUAL_INT(0, ubirch_queue_push(&queue, &item));
+        }
+        ubirch_pool_item item = {4, NULL, 0, NULL};
+        TEST_ASSERT_EQUAL_INT(-1, ubirch_queue_push(&queue, &item));
+        TEST_ASSERT_EQUAL_INT(4, ubirch_queue_depth(&queue));
+
+        TEST_ASSERT_EQUAL_INT(3, ubirch_queue_pop(&queue, items, 3));
+        TEST_ASSERT_EQUAL_INT(1, ubirch_queue_pop(&queue, items + 3, 8));
+        TEST_ASSERT_EQUAL_INT(0, ubirch_queue_depth(&queue));
+        for (unsigned int i = 0; i < 4; i++) {
+            TEST_ASSERT_EQUAL_UINT(i, items[i].context);
+        }
+    }
+}
+
+static int completed[POOL_CONTEXTS];
+static int notified = 0;
+
+static void count_done(void *arg, const ubirch_pool_item *item, int result) {
+    TEST_ASSERT_EQUAL_INT(0, result);
+    // completions of one context arrive in submission order
+    TEST_ASSERT_EQUAL_INT(completed[item->context], (int) (size_t) item->data);
+    completed[item->context]++;
+}
+
+static void count_notify(void *arg, unsigned int worker) {
+    notified++;
+}
+
+void TestPoolMessages() {
+    msgpack_sbuffer *sbufs[POOL_CONTEXTS], *expected[POOL_CONTEXTS];
+    ubirch_protocol *contexts[POOL_CONTEXTS], *sync[POOL_CONTEXTS];
+
+    for (int i = 0; i < POOL_CONTEXTS; i++) {
+        sbufs[i] = msgpack_sbuffer_new();
+        expected[i] = msgpack_sbuffer_new();
+        contexts[i] = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                          sbufs[i], msgpack_sbuffer_write, ed25519_sign, UUID);
+        sync[i] = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                      expected[i], msgpack_sbuffer_write, ed25519_sign, UUID);
+        completed[i] = 0;
+    }
+
+    ubirch_pool *pool = ubirch_pool_new(contexts, POOL_CONTEXTS, 2, 16);
+    TEST_ASSERT_NOT_NULL(pool);
+    ubirch_pool_set_callbacks(pool, count_notify, NULL, count_done, NULL);
+
+    // payloads are msgpack encoded integers
+    unsigned char payloads[POOL_MESSAGES];
+    for (int i = 0; i < POOL_MESSAGES; i++) {
+        payloads[i] = (unsigned char) i;
+        for (unsigned int c = 0; c < POOL_CONTEXTS; c++) {
+            ubirch_pool_item item = {c, payloads + i, 1, (void *) (size_t) i};
+            TEST_ASSERT_TRUE(ubirch_pool_submit(pool, &item) >= 0);
+
+            msgpack_packer *pk = msgpack_packer_new(sync[c], ubirch_protocol_write);
+            ubirch_protocol_start(sync[c], pk);
+            msgpack_pack_int(pk, i);
+            ubirch_protocol_finish(sync[c], pk);
+            msgpack_packer_free(pk);
+        }
+    }
+    ubirch_pool_item invalid = {POOL_CONTEXTS, payloads, 1, NULL};
+    TEST_ASSERT_EQUAL_INT(-2, ubirch_pool_submit(pool, &invalid));
+
+    // worker 0 owns contexts 0 and 2, worker 1 owns context 1
+    TEST_ASSERT_EQUAL_INT(2 * POOL_MESSAGES, ubirch_pool_depth(pool, 0));
+    TEST_ASSERT_EQUAL_INT(POOL_MESSAGES, ubirch_pool_depth(pool, 1));
+    TEST_ASSERT_EQUAL_INT(0, notified);
+
+    while (ubirch_pool_poll(pool, 0) || ubirch_pool_poll(pool, 1));
+    for (int i = 0; i < POOL_CONTEXTS; i++) {
+        TEST_ASSERT_EQUAL_INT(POOL_MESSAGES, completed[i]);
+        TEST_ASSERT_EQUAL_INT(expected[i]->size, sbufs[i]->size);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected[i]->data, sbufs[i]->data, expected[i]->size);
+    }
+
+    ubirch_pool_free(pool);
+    for (int i = 0; i < POOL_CONTEXTS; i++) {
+        ubirch_protocol_free(contexts[i]);
+        ubirch_protocol_free(sync[i]);
+        msgpack_sbuffer_free(sbufs[i]);
+        msgpack_sbuffer_free(expected[i]);
+    }
+}
+
+void TestPoolBackpressure() {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    ubirch_pool *pool = ubirch_pool_new(&proto, 1, 1, 4);
+    ubirch_pool_set_callbacks(pool, NULL, NULL, NULL, NULL);
+
+    const unsigned char payload = 0x01;
+    ubirch_pool_item item = {0, &payload, 1, NULL};
+    // the high water mark is 3 of 4 items
+    TEST_ASSERT_EQUAL_INT(0, ubirch_pool_submit(pool, &item));
+    TEST_ASSERT_EQUAL_INT(0, ubirch_pool_submit(pool, &item));
+    TEST_ASSERT_EQUAL_INT(0, ubirch_pool_submit(pool, &item));
+    TEST_ASSERT_EQUAL_INT(1, ubirch_pool_submit(pool, &item));
+    TEST_ASSERT_EQUAL_INT(-1, ubirch_pool_submit(pool, &item));
+
+    // stopped workers drain their queue first
+    ubirch_pool_stop(pool);
+    ubirch_pool_run(pool, 0);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_pool_depth(pool, 0));
+    TEST_ASSERT_EQUAL_INT(4 * ubirch_protocol_message_size(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN, 1), sbuf->size);
+
+    ubirch_pool_free(pool);
+    ubirch_protocol_free(proto);
+    msgpack_sbuffer_free(sbuf);
+}
+
+static int failed_results[3];
+
+static void failed_done(void *arg, const ubirch_pool_item *item, int result) {
+    failed_results[(size_t) item->data] = result;
+}
+
+/**
+ * Sign like ed25519_sign_ctx, but fail the second message.
+ */
+static int fail_second_sign(void *key, const unsigned char *data, size_t len,
+                            unsigned char signature[crypto_sign_BYTES]) {
+    return ++*(int *) key == 2 ? -1 : ed25519_sign(data, len, signature);
+}
+
+void TestPoolFailedMessage() {
+    char staging[256];
+    int signed_count = 0;
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    ubirch_protocol_set_signer(proto, fail_second_sign, &signed_count);
+    // the staged data is flushed and hashed by the worker (in another unit than the context was set up)
+    ubirch_protocol_set_write_buffer(proto, staging, sizeof(staging));
+    ubirch_pool *pool = ubirch_pool_new(&proto, 1, 1, 4);
+    ubirch_pool_set_callbacks(pool, NULL, NULL, failed_done, NULL);
+
+    const unsigned char payloads[3] = {0x01, 0x02, 0x03};
+    for (size_t i = 0; i < 3; i++) {
+        ubirch_pool_item item = {0, payloads + i, 1, (void *) i};
+        TEST_ASSERT_EQUAL_INT(0, ubirch_pool_submit(pool, &item));
+    }
+    TEST_ASSERT_EQUAL_INT(3, ubirch_pool_poll(pool, 0));
+    TEST_ASSERT_EQUAL_INT(0, failed_results[0]);
+    TEST_ASSERT_EQUAL_INT(-3, failed_results[1]);
+    TEST_ASSERT_EQUAL_INT(0, failed_results[2]);
+    TEST_ASSERT_EQUAL_INT(0, proto->wbuf_len);
+
+    // the failed message is left truncated (without signature) between the valid ones
+    const size_t size = ubirch_protocol_message_size(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN, 1);
+    const size_t truncated = size - UBIRCH_PROTOCOL_SIGN_FIELD_SIZE;
+    TEST_ASSERT_EQUAL_INT(2 * size + truncated, sbuf->size);
+
+    ubirch_protocol_view view;
+    const unsigned char *data = (const unsigned char *) sbuf->data;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_verify_view(data, size, ed25519_verify_ctx, ed25519_public_key, &view));
+    TEST_ASSERT_EQUAL_HEX8(0x01, view.payload[0]);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_verify_view(data + size + truncated, size, ed25519_verify_ctx,
+                                                         ed25519_public_key, &view));
+    TEST_ASSERT_EQUAL_HEX8(0x03, view.payload[0]);
+
+    ubirch_pool_free(pool);
+    ubirch_protocol_free(proto);
+    msgpack_sbuffer_free(sbuf);
+}
+
+utest::v1::status_t greentea_test_setup(const size_t number_of_cases) {
+    GREENTEA_SETUP(600, "default_auto");
+    return greentea_test_setup_handler(number_of_cases);
+}
+
+
+int main() {
+    Case cases[] = {
+            Case("ubirch protocol [pool] queue",
+                 TestQueue, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [pool] messages",
+                 TestPoolMessages, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [pool] backpressure",
+                 TestPoolBackpressure, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [pool] failed message",
+                 TestPoolFailedMessage, greentea_case_failure_abort_handler),
+    };
+
+    Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
+    Harness::run(specification);
+}
@@ -24,6 +24,8 @@ unsigned char ed25519_public_key[crypto_sign_PUBLICKEYBYTES] = {
         0x8f, 0xfd, 0xaa, 0x55, 0x93, 0xe6, 0x3e, 0x6a
 };
 
+ed25519_secret_key_cache ed25519_secret_key_cached;
+
 void TestProtocolInit() {
     char dummybuffer[10];
     ubirch_protocol proto = {};
@@ -33,6 +35,7 @@ void TestProtocolInit() {
     TEST_ASSERT_EQUAL_PTR(dummybuffer, proto.packer.data);
     TEST_ASSERT_EQUAL_PTR(msgpack_sbuffer_write, proto.packer.callback);
     TEST_ASSERT_EQUAL_HEX16(proto_signed, proto.version);
+    TEST_ASSERT_EQUAL_PTR(ubirch_protocol_write_signed, ubirch_protocol_writer(&proto));
     TEST_ASSERT_EQUAL_PTR(ed25519_sign, proto.sign);
     TEST_ASSERT_EQUAL_UINT8_ARRAY(UUID, proto.uuid, 16);
 }
@@ -249,6 +252,301 @@ void TestVerifyMessage() {
     msgpack_sbuffer_free(sbuf);
 }
 
+void TestSignVerifyScratch() {
+    const unsigned char data[100] = {1, 2, 3};
+    unsigned char scratch[ED25519_SCRATCH_SIZE(sizeof(data))];
+    unsigned char signature[crypto_sign_BYTES];
+    unsigned char expected[crypto_sign_BYTES];
+
+    TEST_ASSERT_EQUAL_INT(0, ed25519_sign_key(data, sizeof(data), expected, ed25519_secret_key));
+    TEST_ASSERT_EQUAL_INT(0, ed25519_sign_key_scratch(data, sizeof(data), signature, ed25519_secret_key,
+                                                      scratch, sizeof(scratch)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected, signature, sizeof(signature), "scratch signature differs");
+
+    // signing needs less scratch space than verifying
+    TEST_ASSERT_EQUAL_INT(0, ed25519_sign_key_scratch(data, sizeof(data), signature, ed25519_secret_key,
+                                                      scratch, ED25519_SIGN_SCRATCH_SIZE(sizeof(data))));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected, signature, sizeof(signature), "scratch signature differs");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, ed25519_sign_key_scratch(data, sizeof(data), signature, ed25519_secret_key,
+                                                               scratch, ED25519_SIGN_SCRATCH_SIZE(sizeof(data)) - 1),
+                                  "scratch too small");
+
+    TEST_ASSERT_EQUAL_INT(0, ed25519_verify_key_scratch(data, sizeof(data), signature, ed25519_public_key,
+                                                        scratch, sizeof(scratch)));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, ed25519_verify_key_scratch(data, sizeof(data), signature, ed25519_public_key,
+                                                                 scratch, sizeof(scratch) - 1), "scratch too small");
+
+    signature[0] ^= 1;
+    TEST_ASSERT_NOT_EQUAL(0, ed25519_verify_key_scratch(data, sizeof(data), signature, ed25519_public_key,
+                                                        scratch, sizeof(scratch)));
+}
+
+void TestSignWithKeyHandle() {
+    // reference message, signed with the global key
+    msgpack_sbuffer *expected = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 expected, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    ubirch_protocol_start(proto, pk);
+    msgpack_pack_int(pk, 99);
+    ubirch_protocol_finish(proto, pk);
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+
+    // the same message signed via key handle, without a plain signing function
+    unsigned char secret_key[crypto_sign_SECRETKEYBYTES];
+    memcpy(secret_key, ed25519_secret_key, sizeof(secret_key));
+
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    proto = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN, sbuf, msgpack_sbuffer_write, NULL, UUID);
+    ubirch_protocol_set_signer(proto, ed25519_sign_ctx, secret_key);
+    pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    ubirch_protocol_start(proto, pk);
+    msgpack_pack_int(pk, 99);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_finish(proto, pk));
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(expected->size, sbuf->size, "message length wrong");
+    TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected->data, sbuf->data, sbuf->size, "key handle signature differs");
+
+    // verify with the public key as key handle
+    unsigned char public_key[crypto_sign_PUBLICKEYBYTES];
+    memcpy(public_key, ed25519_public_key, sizeof(public_key));
+
+    msgpack_unpacker *unpacker = msgpack_unpacker_new(16);
+    if (msgpack_unpacker_buffer_capacity(unpacker) < sbuf->size) {
+        msgpack_unpacker_reserve_buffer(unpacker, sbuf->size);
+    }
+    memcpy(msgpack_unpacker_buffer(unpacker), sbuf->data, sbuf->size);
+    msgpack_unpacker_buffer_consumed(unpacker, sbuf->size);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, ubirch_protocol_verify_ctx(unpacker, ed25519_verify_ctx, public_key),
+                                  "message verification failed");
+
+    msgpack_unpacker_free(unpacker);
+    msgpack_sbuffer_free(sbuf);
+    msgpack_sbuffer_free(expected);
+}
+
+void TestVerifyBatch() {
+    msgpack_sbuffer *sbuf[5];
+    const unsigned char *messages[5];
+    size_t sizes[5];
+    void *keys[5];
+    int results[5];
+
+    for (int i = 0; i < 5; i++) {
+        sbuf[i] = msgpack_sbuffer_new();
+        ubirch_protocol *proto = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                     sbuf[i], msgpack_sbuffer_write, ed25519_sign, UUID);
+        msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+        ubirch_protocol_start(proto, pk);
+        msgpack_pack_int(pk, 2498 + i);
+        ubirch_protocol_finish(proto, pk);
+        msgpack_packer_free(pk);
+        ubirch_protocol_free(proto);
+
+        messages[i] = (const unsigned char *) sbuf[i]->data;
+        sizes[i] = sbuf[i]->size;
+        keys[i] = ed25519_public_key;
+    }
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, ubirch_protocol_verify_batch(messages, sizes, keys, 5, ed25519_verify_batch_ctx,
+                                                                  ed25519_verify_ctx, results),
+                                  "batch verification failed");
+    for (int i = 0; i < 5; i++) TEST_ASSERT_EQUAL_INT(0, results[i]);
+
+    // break the payload of one message and cut another one short
+    sbuf[2]->data[24] ^= 0x01;
+    sizes[4] = UBIRCH_PROTOCOL_SIGN_SIZE;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, ubirch_protocol_verify_batch(messages, sizes, keys, 5, ed25519_verify_batch_ctx,
+                                                                   ed25519_verify_ctx, results),
+                                  "batch verification must fail");
+    TEST_ASSERT_EQUAL_INT(0, results[0]);
+    TEST_ASSERT_EQUAL_INT(0, results[1]);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, results[2], "broken message not found");
+    TEST_ASSERT_EQUAL_INT(0, results[3]);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-2, results[4], "short message not rejected");
+
+    for (int i = 0; i < 5; i++) msgpack_sbuffer_free(sbuf[i]);
+}
+
+#ifdef UBIRCH_ED25519_HOST
+/**
+ * Sign like the key owner could, with the order 2 point (0, -1) added to R: only
+ * the cofactored equation accepts this signature.
+ */
+static int sign_small_order(void *key, const unsigned char *data, size_t len,
+                            unsigned char signature[crypto_sign_BYTES]) {
+    static const unsigned char torsion[32] = {
+            0xec, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+            0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f
+    };
+    ed25519_expanded_secret_key secret;
+    ed25519_secret_key_expand(&secret, (const unsigned char *) key);
+
+    unsigned char r[32] = {0x42, 0x17}, h[64], k[32];
+    ed25519_ge p, t;
+    ed25519_ge_cached c;
+    ed25519_ge_scalarmult_base(&p, r);
+    if (ed25519_ge_frombytes_vartime(&t, torsion)) return -1;
+    ed25519_ge_to_cached(&c, &t);
+    ed25519_ge_add(&p, &p, &c);
+    ed25519_ge_tobytes(signature, &p);
+
+    // S = r + H(R || A || m) * a
+    unsigned char *kin = (unsigned char *) malloc(64 + len);
+    memcpy(kin, signature, 32);
+    memcpy(kin + 32, secret.public_key, 32);
+    memcpy(kin + 64, data, len);
+    mbedtls_sha512(kin, 64 + len, h, 0);
+    free(kin);
+    ed25519_sc_reduce(k, h);
+    ed25519_sc_muladd(signature + 32, k, secret.scalar, r);
+    return 0;
+}
+
+void TestVerifySmallOrderComponent() {
+    msgpack_sbuffer *sbuf[3];
+    const unsigned char *messages[3];
+    size_t sizes[3];
+    void *keys[3];
+    int results[3];
+
+    for (int i = 0; i < 3; i++) {
+        sbuf[i] = msgpack_sbuffer_new();
+        ubirch_protocol *proto = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                     sbuf[i], msgpack_sbuffer_write, ed25519_sign, UUID);
+        if (i == 0) ubirch_protocol_set_signer(proto, sign_small_order, ed25519_secret_key);
+        msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+        ubirch_protocol_start(proto, pk);
+        msgpack_pack_int(pk, 2498 + i);
+        ubirch_protocol_finish(proto, pk);
+        msgpack_packer_free(pk);
+        ubirch_protocol_free(proto);
+
+        messages[i] = (const unsigned char *) sbuf[i]->data;
+        sizes[i] = sbuf[i]->size;
+        keys[i] = ed25519_public_key;
+    }
+
+    // the same result alone, in a valid batch and in a failing batch
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, ubirch_protocol_verify_batch(messages, sizes, keys, 1, NULL,
+                                                                  ed25519_verify_ctx, results), "alone");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, ubirch_protocol_verify_batch(messages, sizes, keys, 3, ed25519_verify_batch_ctx,
+                                                                  ed25519_verify_ctx, results), "valid batch");
+    sbuf[2]->data[24] ^= 0x01;
+    TEST_ASSERT_EQUAL_INT(-1, ubirch_protocol_verify_batch(messages, sizes, keys, 3, ed25519_verify_batch_ctx,
+                                                           ed25519_verify_ctx, results));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, results[0], "failing batch");
+    TEST_ASSERT_EQUAL_INT(0, results[1]);
+    TEST_ASSERT_EQUAL_INT(-1, results[2]);
+
+    for (int i = 0; i < 3; i++) msgpack_sbuffer_free(sbuf[i]);
+}
+#endif
+
+void TestVerifyCachedKey() {
+    ed25519_public_key_cache key;
+    TEST_ASSERT_EQUAL_INT(0, ed25519_public_key_cache_init(&key, ed25519_public_key));
+
+    unsigned char data[UBIRCH_PROTOCOL_HASH_SIZE];
+    unsigned char signature[crypto_sign_BYTES];
+    for (unsigned int i = 0; i < sizeof(data); i++) data[i] = (unsigned char) i;
+    TEST_ASSERT_EQUAL_INT(0, ed25519_sign(data, sizeof(data), signature));
+
+    // the same key verifies many times
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_INT_MESSAGE(0, ed25519_verify_cached(&key, data, sizeof(data), signature),
+                                      "cached key verification failed");
+    }
+    TEST_ASSERT_EQUAL_INT(0, ed25519_verify_cached_ctx(&key, data, sizeof(data), signature));
+
+    data[0] ^= 0x01;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, ed25519_verify_cached(&key, data, sizeof(data), signature),
+                                  "modified data must fail");
+    data[0] ^= 0x01;
+    signature[40] ^= 0x01;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, ed25519_verify_cached(&key, data, sizeof(data), signature),
+                                  "modified signature must fail");
+}
+
+void TestSignCachedKey() {
+    // reference message, signed with the plain secret key
+    msgpack_sbuffer *expected = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 expected, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    for (int i = 0; i < 3; i++) {
+        ubirch_protocol_start(proto, pk);
+        msgpack_pack_int(pk, 2498 + i);
+        ubirch_protocol_finish(proto, pk);
+    }
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+
+    // the same chain signed with the prepared key
+    ed25519_secret_key_cache_init(&ed25519_secret_key_cached, ed25519_secret_key);
+
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    proto = ubirch_protocol_new(proto_chained, UBIRCH_PROTOCOL_TYPE_BIN,
+                                sbuf, msgpack_sbuffer_write, ed25519_sign_cached, UUID);
+    pk = msgpack_packer_new(proto, ubirch_protocol_write);
+    for (int i = 0; i < 3; i++) {
+        ubirch_protocol_start(proto, pk);
+        msgpack_pack_int(pk, 2498 + i);
+        TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_finish(proto, pk));
+    }
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(expected->size, sbuf->size, "message length wrong");
+    TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected->data, sbuf->data, sbuf->size, "cached key signature differs");
+
+    // and as key handle
+    unsigned char data[UBIRCH_PROTOCOL_HASH_SIZE] = {0};
+    unsigned char signature[crypto_sign_BYTES], expected_signature[crypto_sign_BYTES];
+    TEST_ASSERT_EQUAL_INT(0, ed25519_sign(data, sizeof(data), expected_signature));
+    TEST_ASSERT_EQUAL_INT(0, ed25519_sign_cached_ctx(&ed25519_secret_key_cached, data, sizeof(data), signature));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected_signature, signature, crypto_sign_BYTES);
+
+    msgpack_sbuffer_free(sbuf);
+    msgpack_sbuffer_free(expected);
+}
+
+void TestSignVerifyTestVector() {
+    // RFC 8032, 7.1 TEST 2
+    const unsigned char secret_key[crypto_sign_SECRETKEYBYTES] = {
+        0x4c, 0xcd, 0x08, 0x9b, 0x28, 0xff, 0x96, 0xda, 0x9d, 0xb6, 0xc3, 0x46,
+        0xec, 0x11, 0x4e, 0x0f, 0x5b, 0x8a, 0x31, 0x9f, 0x35, 0xab, 0xa6, 0x24,
+        0xda, 0x8c, 0xf6, 0xed, 0x4f, 0xb8, 0xa6, 0xfb, 0x3d, 0x40, 0x17, 0xc3,
+        0xe8, 0x43, 0x89, 0x5a, 0x92, 0xb7, 0x0a, 0xa7, 0x4d, 0x1b, 0x7e, 0xbc,
+        0x9c, 0x98, 0x2c, 0xcf, 0x2e, 0xc4, 0x96, 0x8c, 0xc0, 0xcd, 0x55, 0xf1,
+        0x2a, 0xf4, 0x66, 0x0c
+    };
+    const unsigned char expected_signature[crypto_sign_BYTES] = {
+        0x92, 0xa0, 0x09, 0xa9, 0xf0, 0xd4, 0xca, 0xb8, 0x72, 0x0e, 0x82, 0x0b,
+        0x5f, 0x64, 0x25, 0x40, 0xa2, 0xb2, 0x7b, 0x54, 0x16, 0x50, 0x3f, 0x8f,
+        0xb3, 0x76, 0x22, 0x23, 0xeb, 0xdb, 0x69, 0xda, 0x08, 0x5a, 0xc1, 0xe4,
+        0x3e, 0x15, 0x99, 0x6e, 0x45, 0x8f, 0x36, 0x13, 0xd0, 0xf1, 0x1d, 0x8c,
+        0x38, 0x7b, 0x2e, 0xae, 0xb4, 0x30, 0x2a, 0xee, 0xb0, 0x0d, 0x29, 0x16,
+        0x12, 0xbb, 0x0c, 0x00
+    };
+    const unsigned char data[1] = {0x72};
+    unsigned char signature[crypto_sign_BYTES];
+
+    TEST_ASSERT_EQUAL_INT(0, ed25519_sign_key(data, sizeof(data), signature, secret_key));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected_signature, signature, crypto_sign_BYTES, "signature differs");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, ed25519_verify_key(data, sizeof(data), signature,
+                                                        secret_key + crypto_sign_PUBLICKEYBYTES),
+                                  "verification failed");
+
+    signature[0] ^= 0x01;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, ed25519_verify_key(data, sizeof(data), signature,
+                                                         secret_key + crypto_sign_PUBLICKEYBYTES),
+                                  "modified signature must fail");
+}
+
 utest::v1::status_t greentea_test_setup(const size_t number_of_cases) {
     GREENTEA_SETUP(600, "ProtocolTests");
     return greentea_test_setup_handler(number_of_cases);
@@ -273,6 +571,22 @@ int main() {
                  TestProtocolMessageFinish, greentea_case_failure_abort_handler),
             Case("ubirch protocol [signed] message verify",
                  TestVerifyMessage, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [signed] sign/verify with scratch space",
+                 TestSignVerifyScratch, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [signed] sign/verify with key handle",
+                 TestSignWithKeyHandle, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [signed] batch verification",
+                 TestVerifyBatch, greentea_case_failure_abort_handler),
+#ifdef UBIRCH_ED25519_HOST
+            Case("ubirch protocol [signed] small order component, alone and in batches",
+                 TestVerifySmallOrderComponent, greentea_case_failure_abort_handler),
+#endif
+            Case("ubirch protocol [signed] verify with cached key",
+                 TestVerifyCachedKey, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [signed] sign with cached key",
+                 TestSignCachedKey, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [signed] sign/verify test vector",
+                 TestSignVerifyTestVector, greentea_case_failure_abort_handler),
 
     };
 
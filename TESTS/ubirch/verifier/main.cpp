@@ -0,0 +1,167 @@
+#include <unity/unity.h>
+#include <ubirch/ubirch_protocol_verifier.h>
+#include <ubirch/ubirch_ed25519.h>
+
+#include "utest/utest.h"
+#include "greentea-client/test_env.h"
+
+using namespace utest::v1;
+
+static const unsigned char UUID[16] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p'};
+
+unsigned char ed25519_secret_key[crypto_sign_SECRETKEYBYTES] = {
+        0x69, 0x09, 0xcb, 0x3d, 0xff, 0x94, 0x43, 0x26, 0xed, 0x98, 0x72, 0x60,
+        0x1e, 0xb3, 0x3c, 0xb2, 0x2d, 0x9e, 0x20, 0xdb, 0xbb, 0xe8, 0x17, 0x34,
+        0x1c, 0x81, 0x33, 0x53, 0xda, 0xc9, 0xef, 0xbb, 0x7c, 0x76, 0xc4, 0x7c,
+        0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87, 0x01, 0x0f, 0x32, 0x4b,
+        0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf, 0x8f, 0xfd, 0xaa, 0x55,
+        0x93, 0xe6, 0x3e, 0x6a
+};
+unsigned char ed25519_public_key[crypto_sign_PUBLICKEYBYTES] = {
+        0x7c, 0x76, 0xc4, 0x7c, 0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87,
+        0x01, 0x0f, 0x32, 0x4b, 0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf,
+        0x8f, 0xfd, 0xaa, 0x55, 0x93, 0xe6, 0x3e, 0x6a
+};
+
+/**
+ * Create count messages of a device back to back, the payloads grow with the index.
+ */
+static msgpack_sbuffer *create_messages(ubirch_protocol_variant variant, int count) {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    ubirch_protocol *proto = ubirch_protocol_new(variant, UBIRCH_PROTOCOL_TYPE_BIN,
+                                                 sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+
+    for (int i = 0; i < count; i++) {
+        ubirch_protocol_start(proto, pk);
+        msgpack_pack_raw(pk, (size_t) i * 10);
+        for (int j = 0; j < i * 10; j++) msgpack_pack_raw_body(pk, "x", 1);
+        ubirch_protocol_finish(proto, pk);
+    }
+
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+    return sbuf;
+}
+
+void TestVerifierMessages() {
+    msgpack_sbuffer *sbuf = create_messages(proto_chained, 20);
+    ubirch_verifier *verifier = ubirch_verifier_new(16, ed25519_verify_ctx, ed25519_public_key);
+    TEST_ASSERT_NOT_NULL(verifier);
+
+    // feed the messages one by one, twice
+    ubirch_protocol_view view;
+    unsigned char *buf = NULL;
+    size_t size = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        size_t offset = 0;
+        for (int i = 0; i < 20; i++) {
+            TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_parse((const unsigned char *) sbuf->data + offset,
+                                                           sbuf->size - offset, &view));
+            const size_t len = view.len;
+            TEST_ASSERT_EQUAL_INT(0, ubirch_verifier_feed(verifier, view.message, len));
+
+            TEST_ASSERT_EQUAL_INT(0, ubirch_verifier_next(verifier, &view));
+            TEST_ASSERT_EQUAL_PTR(verifier->buf, view.message);
+            TEST_ASSERT_EQUAL_UINT(len, view.len);
+            TEST_ASSERT_EQUAL_UINT(i * 10 + (i * 10 < 32 ? 1 : 3), view.payload_len);
+            TEST_ASSERT_EQUAL_INT(-3, ubirch_verifier_next(verifier, &view));
+            offset += len;
+        }
+
+        // the second pass reuses the buffer grown in the first one
+        if (pass == 1) {
+            TEST_ASSERT_EQUAL_PTR(buf, verifier->buf);
+            TEST_ASSERT_EQUAL_UINT(size, verifier->size);
+        }
+        buf = verifier->buf;
+        size = verifier->size;
+    }
+
+    ubirch_verifier_free(verifier);
+    msgpack_sbuffer_free(sbuf);
+}
+
+void TestVerifierStream() {
+    msgpack_sbuffer *sbuf = create_messages(proto_signed, 20);
+    ubirch_verifier *verifier = ubirch_verifier_new(64, ed25519_verify_ctx, ed25519_public_key);
+
+    // receive in chunks that do not match the message borders
+    ubirch_protocol_view view;
+    size_t offset = 0;
+    int valid = 0;
+    while (offset < sbuf->size) {
+        const size_t len = sbuf->size - offset < 97 ? sbuf->size - offset : 97;
+        unsigned char *buf = ubirch_verifier_reserve(verifier, 97);
+        TEST_ASSERT_NOT_NULL(buf);
+        memcpy(buf, sbuf->data + offset, len);
+        ubirch_verifier_consumed(verifier, len);
+        offset += len;
+
+        int ret;
+        while ((ret = ubirch_verifier_next(verifier, &view)) != -3) {
+            TEST_ASSERT_EQUAL_INT(0, ret);
+            TEST_ASSERT_EQUAL_HEX8_ARRAY(UUID, view.uuid, UBIRCH_PROTOCOL_UUID_SIZE);
+            valid++;
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(20, valid);
+    TEST_ASSERT_EQUAL_UINT(verifier->len, verifier->off);
+
+    ubirch_verifier_free(verifier);
+    msgpack_sbuffer_free(sbuf);
+}
+
+void TestVerifierInvalid() {
+    msgpack_sbuffer *sbuf = create_messages(proto_signed, 3);
+    ubirch_verifier *verifier = ubirch_verifier_new(64, ed25519_verify_ctx, ed25519_public_key);
+    ubirch_protocol_view view;
+
+    // an invalid signature only affects its message
+    sbuf->data[10] ^= 1;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_verifier_feed(verifier, (const unsigned char *) sbuf->data, sbuf->size));
+    TEST_ASSERT_EQUAL_INT(-1, ubirch_verifier_next(verifier, &view));
+    TEST_ASSERT_EQUAL_INT(0, ubirch_verifier_next(verifier, &view));
+    TEST_ASSERT_EQUAL_INT(0, ubirch_verifier_next(verifier, &view));
+    TEST_ASSERT_EQUAL_INT(-3, ubirch_verifier_next(verifier, &view));
+
+    // malformed data drops everything received
+    sbuf->data[0] = 0x00;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_verifier_feed(verifier, (const unsigned char *) sbuf->data, sbuf->size));
+    TEST_ASSERT_EQUAL_INT(-2, ubirch_verifier_next(verifier, &view));
+    TEST_ASSERT_EQUAL_UINT(0, verifier->len);
+    TEST_ASSERT_EQUAL_INT(-3, ubirch_verifier_next(verifier, &view));
+
+    ubirch_verifier_free(verifier);
+    msgpack_sbuffer_free(sbuf);
+
+    // plain messages are skipped
+    sbuf = create_messages(proto_plain, 2);
+    verifier = ubirch_verifier_new(64, ed25519_verify_ctx, ed25519_public_key);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_verifier_feed(verifier, (const unsigned char *) sbuf->data, sbuf->size));
+    TEST_ASSERT_EQUAL_INT(-2, ubirch_verifier_next(verifier, &view));
+    TEST_ASSERT_EQUAL_INT(-2, ubirch_verifier_next(verifier, &view));
+    TEST_ASSERT_EQUAL_INT(-3, ubirch_verifier_next(verifier, &view));
+
+    ubirch_verifier_free(verifier);
+    msgpack_sbuffer_free(sbuf);
+}
+
+utest::v1::status_t greentea_test_setup(const size_t number_of_cases) {
+    GREENTEA_SETUP(600, "default_auto");
+    return greentea_test_setup_handler(number_of_cases);
+}
+
+int main() {
+    Case cases[] = {
+            Case("ubirch protocol [verifier] single messages",
+                 TestVerifierMessages, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [verifier] message stream",
+                 TestVerifierStream, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [verifier] invalid messages",
+                 TestVerifierInvalid, greentea_case_failure_abort_handler),
+    };
+
+    Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
+    Harness::run(specification);
+}
@@ -0,0 +1,348 @@
+#include <unity/unity.h>
+#include <ubirch/ubirch_protocol_view.h>
+#include <ubirch/ubirch_ed25519.h>
+
+#include "utest/utest.h"
+#include "greentea-client/test_env.h"
+
+using namespace utest::v1;
+
+static const unsigned char UUID[16] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p'};
+
+unsigned char ed25519_secret_key[crypto_sign_SECRETKEYBYTES] = {
+        0x69, 0x09, 0xcb, 0x3d, 0xff, 0x94, 0x43, 0x26, 0xed, 0x98, 0x72, 0x60,
+        0x1e, 0xb3, 0x3c, 0xb2, 0x2d, 0x9e, 0x20, 0xdb, 0xbb, 0xe8, 0x17, 0x34,
+        0x1c, 0x81, 0x33, 0x53, 0xda, 0xc9, 0xef, 0xbb, 0x7c, 0x76, 0xc4, 0x7c,
+        0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87, 0x01, 0x0f, 0x32, 0x4b,
+        0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf, 0x8f, 0xfd, 0xaa, 0x55,
+        0x93, 0xe6, 0x3e, 0x6a
+};
+unsigned char ed25519_public_key[crypto_sign_PUBLICKEYBYTES] = {
+        0x7c, 0x76, 0xc4, 0x7c, 0x51, 0x61, 0xd0, 0xa0, 0x3e, 0x7a, 0xe9, 0x87,
+        0x01, 0x0f, 0x32, 0x4b, 0x87, 0x5c, 0x23, 0xda, 0x81, 0x31, 0x32, 0xcf,
+        0x8f, 0xfd, 0xaa, 0x55, 0x93, 0xe6, 0x3e, 0x6a
+};
+
+/**
+ * Create a message with a nested payload (a map with an array and a raw value).
+ */
+static void create_message(msgpack_sbuffer *sbuf, ubirch_protocol_variant variant, unsigned int type) {
+    ubirch_protocol *proto = ubirch_protocol_new(variant, type, sbuf, msgpack_sbuffer_write, ed25519_sign, UUID);
+    msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+
+    // two messages, so a chained message has a non zero previous signature
+    for (int i = 0; i < 2; i++) {
+        msgpack_sbuffer_clear(sbuf);
+        ubirch_protocol_start(proto, pk);
+        msgpack_pack_map(pk, 2);
+        msgpack_pack_int(pk, 1);
+        msgpack_pack_array(pk, 3);
+        msgpack_pack_int(pk, -1);
+        msgpack_pack_uint32(pk, 70000);
+        msgpack_pack_double(pk, 1.5);
+        msgpack_pack_int(pk, 2);
+        msgpack_pack_raw(pk, 300);
+        for (int j = 0; j < 300; j++) msgpack_pack_raw_body(pk, "x", 1);
+        ubirch_protocol_finish(proto, pk);
+    }
+
+    msgpack_packer_free(pk);
+    ubirch_protocol_free(proto);
+}
+
+/**
+ * Parse a message and check the view against the message layout.
+ */
+static void check_message(ubirch_protocol_variant variant, unsigned int type) {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    create_message(sbuf, variant, type);
+    const unsigned char *data = (const unsigned char *) sbuf->data;
+
+    ubirch_protocol_view view;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_parse(data, sbuf->size, &view));
+    TEST_ASSERT_EQUAL_PTR(data, view.message);
+    TEST_ASSERT_EQUAL_UINT(sbuf->size, view.len);
+    TEST_ASSERT_EQUAL_HEX16(variant, view.version);
+    TEST_ASSERT_EQUAL_UINT(type, view.type);
+
+    // array, version (uint16) and uuid (raw)
+    TEST_ASSERT_EQUAL_PTR(data + 5, view.uuid);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(UUID, view.uuid, UBIRCH_PROTOCOL_UUID_SIZE);
+    if (variant == proto_chained) {
+        TEST_ASSERT_EQUAL_PTR(data + UBIRCH_PROTOCOL_HEADER_PREV, view.previous);
+    } else {
+        TEST_ASSERT_NULL(view.previous);
+    }
+    TEST_ASSERT_EQUAL_HEX8(0x82, view.payload[0]);
+
+    if (variant == proto_plain) {
+        TEST_ASSERT_NULL(view.signature);
+        TEST_ASSERT_EQUAL_UINT(sbuf->size, (size_t) (view.payload - data) + view.payload_len);
+    } else {
+        TEST_ASSERT_EQUAL_PTR(data + sbuf->size - UBIRCH_PROTOCOL_SIGN_SIZE, view.signature);
+        TEST_ASSERT_EQUAL_UINT(sbuf->size - UBIRCH_PROTOCOL_SIGN_FIELD_SIZE, view.signed_len);
+        TEST_ASSERT_EQUAL_UINT(view.signed_len, (size_t) (view.payload - data) + view.payload_len);
+
+        unsigned char sha512sum[UBIRCH_PROTOCOL_HASH_SIZE];
+        mbedtls_sha512(data, view.signed_len, sha512sum, 0);
+        TEST_ASSERT_EQUAL_INT(0, ed25519_verify(sha512sum, sizeof(sha512sum), view.signature));
+    }
+
+    // every part of the message is incomplete
+    for (size_t len = 0; len < sbuf->size; len++) {
+        TEST_ASSERT_EQUAL_INT(UBIRCH_PROTOCOL_INCOMPLETE, ubirch_protocol_parse(data, len, &view));
+    }
+
+    msgpack_sbuffer_free(sbuf);
+}
+
+void TestViewPlain() {
+    check_message(proto_plain, UBIRCH_PROTOCOL_TYPE_BIN);
+}
+
+void TestViewSigned() {
+    check_message(proto_signed, 0xef);
+}
+
+void TestViewChained() {
+    check_message(proto_chained, 70000);
+}
+
+void TestViewStream() {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    create_message(sbuf, proto_signed, UBIRCH_PROTOCOL_TYPE_BIN);
+    const size_t size = sbuf->size;
+    char *copy = (char *) malloc(size);
+    memcpy(copy, sbuf->data, size);
+    msgpack_sbuffer_write(sbuf, copy, size);
+    free(copy);
+
+    // back to back messages, each parse stops at the end of the message
+    ubirch_protocol_view view;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_parse((const unsigned char *) sbuf->data, sbuf->size, &view));
+    TEST_ASSERT_EQUAL_UINT(size, view.len);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_parse((const unsigned char *) sbuf->data + size, size, &view));
+    TEST_ASSERT_EQUAL_UINT(size, view.len);
+
+    msgpack_sbuffer_free(sbuf);
+}
+
+void TestViewMalformed() {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    create_message(sbuf, proto_chained, UBIRCH_PROTOCOL_TYPE_BIN);
+    unsigned char *data = (unsigned char *) sbuf->data;
+    ubirch_protocol_view view;
+
+    // wrong number of elements for the version
+    data[0] = 0x95;
+    TEST_ASSERT_EQUAL_INT(UBIRCH_PROTOCOL_MALFORMED, ubirch_protocol_parse(data, sbuf->size, &view));
+    data[0] = 0x96;
+
+    // unknown variant
+    data[3] = 0x14;
+    TEST_ASSERT_EQUAL_INT(UBIRCH_PROTOCOL_MALFORMED, ubirch_protocol_parse(data, sbuf->size, &view));
+    data[3] = proto_chained;
+
+    // uuid of the wrong size
+    data[4] = 0xaf;
+    TEST_ASSERT_EQUAL_INT(UBIRCH_PROTOCOL_MALFORMED, ubirch_protocol_parse(data, sbuf->size, &view));
+    data[4] = 0xb0;
+
+    // invalid type marker in the payload
+    const size_t payload = UBIRCH_PROTOCOL_HEADER_PREV + UBIRCH_PROTOCOL_SIGN_SIZE + 1;
+    data[payload] = 0xc1;
+    TEST_ASSERT_EQUAL_INT(UBIRCH_PROTOCOL_MALFORMED, ubirch_protocol_parse(data, sbuf->size, &view));
+
+    // not an array
+    const unsigned char map[] = {0x81, 0x01, 0x02};
+    TEST_ASSERT_EQUAL_INT(UBIRCH_PROTOCOL_MALFORMED, ubirch_protocol_parse(map, sizeof(map), &view));
+
+    msgpack_sbuffer_free(sbuf);
+}
+
+void TestViewSkip() {
+    size_t size = 0;
+
+    const unsigned char nested[] = {0x92, 0x81, 0xa1, 'k', 0xcd, 0x01, 0x02, 0xd6, 0x01, 1, 2, 3, 4, 0xc3};
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_skip(nested, sizeof(nested), &size));
+    TEST_ASSERT_EQUAL_UINT(sizeof(nested) - 1, size);
+
+    // huge element counts must not be trusted
+    const unsigned char huge[] = {0xdd, 0xff, 0xff, 0xff, 0xff, 0x01};
+    TEST_ASSERT_EQUAL_INT(UBIRCH_PROTOCOL_INCOMPLETE, ubirch_protocol_skip(huge, sizeof(huge), &size));
+    const unsigned char large[] = {0xdb, 0xff, 0xff, 0xff, 0xff, 0x01};
+    TEST_ASSERT_EQUAL_INT(UBIRCH_PROTOCOL_INCOMPLETE, ubirch_protocol_skip(large, sizeof(large), &size));
+
+    const unsigned char invalid[] = {0x91, 0xc1};
+    TEST_ASSERT_EQUAL_INT(UBIRCH_PROTOCOL_MALFORMED, ubirch_protocol_skip(invalid, sizeof(invalid), &size));
+}
+
+static int verify_calls = 0;
+
+static int counting_verify(void *key, const unsigned char *buf, size_t len,
+                           const unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]) {
+    verify_calls++;
+    return ed25519_verify_ctx(key, buf, len, signature);
+}
+
+void TestViewVerify() {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    create_message(sbuf, proto_chained, UBIRCH_PROTOCOL_TYPE_BIN);
+    unsigned char *data = (unsigned char *) sbuf->data;
+    ubirch_protocol_view view;
+
+    verify_calls = 0;
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_verify_view(data, sbuf->size, counting_verify,
+                                                         ed25519_public_key, &view));
+    TEST_ASSERT_EQUAL_PTR(data + sbuf->size - UBIRCH_PROTOCOL_SIGN_SIZE, view.signature);
+    TEST_ASSERT_EQUAL_INT(1, verify_calls);
+
+    // changed payload
+    data[sbuf->size - UBIRCH_PROTOCOL_SIGN_FIELD_SIZE - 1] ^= 1;
+    TEST_ASSERT_EQUAL_INT(-1, ubirch_protocol_verify_view(data, sbuf->size, counting_verify,
+                                                          ed25519_public_key, &view));
+    data[sbuf->size - UBIRCH_PROTOCOL_SIGN_FIELD_SIZE - 1] ^= 1;
+    TEST_ASSERT_EQUAL_INT(2, verify_calls);
+
+    // malformed and incomplete messages are not verified
+    data[0] = 0x95;
+    TEST_ASSERT_EQUAL_INT(-2, ubirch_protocol_verify_view(data, sbuf->size, counting_verify,
+                                                          ed25519_public_key, &view));
+    data[0] = 0x96;
+    TEST_ASSERT_EQUAL_INT(-3, ubirch_protocol_verify_view(data, sbuf->size - 1, counting_verify,
+                                                          ed25519_public_key, &view));
+    TEST_ASSERT_EQUAL_INT(2, verify_calls);
+
+    // plain messages have no signature
+    create_message(sbuf, proto_plain, UBIRCH_PROTOCOL_TYPE_BIN);
+    TEST_ASSERT_EQUAL_INT(-2, ubirch_protocol_verify_view((const unsigned char *) sbuf->data, sbuf->size,
+                                                          counting_verify, ed25519_public_key, &view));
+    TEST_ASSERT_EQUAL_INT(2, verify_calls);
+
+    msgpack_sbuffer_free(sbuf);
+}
+
+void TestViewStreamVerify() {
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    create_message(sbuf, proto_chained, 0x1234);
+    const size_t size = sbuf->size;
+    char *copy = (char *) malloc(size);
+    memcpy(copy, sbuf->data, size);
+    msgpack_sbuffer_write(sbuf, copy, size);
+    free(copy);
+    const unsigned char *data = (const unsigned char *) sbuf->data;
+
+    // the same result for any chunk size, the second message is not used
+    ubirch_protocol_stream stream;
+    for (size_t chunk = 1; chunk <= size + 1; chunk++) {
+        ubirch_protocol_stream_init(&stream);
+        size_t pos = 0, used = 0;
+        int ret = 0;
+        while (ret == 0) {
+            const size_t len = chunk < sbuf->size - pos ? chunk : sbuf->size - pos;
+            ret = ubirch_protocol_stream_feed(&stream, data + pos, len, &used);
+            pos += used;
+        }
+        TEST_ASSERT_EQUAL_INT(1, ret);
+        TEST_ASSERT_EQUAL_UINT(size, pos);
+        TEST_ASSERT_EQUAL_UINT(size, stream.len);
+        TEST_ASSERT_EQUAL_UINT(size - UBIRCH_PROTOCOL_SIGN_FIELD_SIZE, stream.signed_len);
+        TEST_ASSERT_EQUAL_HEX16(proto_chained, stream.version);
+        TEST_ASSERT_EQUAL_UINT(0x1234, stream.type);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(UUID, stream.uuid, UBIRCH_PROTOCOL_UUID_SIZE);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(data + UBIRCH_PROTOCOL_HEADER_PREV, stream.previous, UBIRCH_PROTOCOL_SIGN_SIZE);
+        TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_stream_verify(&stream, ed25519_verify_ctx, ed25519_public_key));
+    }
+
+    // a changed payload byte
+    sbuf->data[size - UBIRCH_PROTOCOL_SIGN_FIELD_SIZE - 1] ^= 1;
+    size_t used = 0;
+    ubirch_protocol_stream_init(&stream);
+    TEST_ASSERT_EQUAL_INT(1, ubirch_protocol_stream_feed(&stream, data, size, &used));
+    TEST_ASSERT_EQUAL_INT(-1, ubirch_protocol_stream_verify(&stream, ed25519_verify_ctx, ed25519_public_key));
+
+    // not complete
+    ubirch_protocol_stream_init(&stream);
+    TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_stream_feed(&stream, data, size - 1, &used));
+    TEST_ASSERT_EQUAL_INT(-2, ubirch_protocol_stream_verify(&stream, ed25519_verify_ctx, ed25519_public_key));
+
+    // malformed
+    sbuf->data[0] = (char) 0x95;
+    ubirch_protocol_stream_init(&stream);
+    TEST_ASSERT_EQUAL_INT(UBIRCH_PROTOCOL_MALFORMED, ubirch_protocol_stream_feed(&stream, data, size, &used));
+
+    msgpack_sbuffer_free(sbuf);
+}
+
+void TestViewScan() {
+    // ten signed messages back to back and the start of another one
+    msgpack_sbuffer *stream = msgpack_sbuffer_new();
+    msgpack_sbuffer *sbuf = msgpack_sbuffer_new();
+    for (int i = 0; i < 10; i++) {
+        create_message(sbuf, proto_signed, (unsigned int) i);
+        msgpack_sbuffer_write(stream, sbuf->data, sbuf->size);
+    }
+    msgpack_sbuffer_write(stream, sbuf->data, 100);
+    const unsigned char *data = (const unsigned char *) stream->data;
+
+    const unsigned char *messages[4];
+    size_t sizes[4], signed_lens[4], count, used, offset = 0, found = 0;
+    int results[4];
+    void *keys[4] = {ed25519_public_key, ed25519_public_key, ed25519_public_key, ed25519_public_key};
+    do {
+        TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_scan(data + offset, stream->size - offset,
+                                                      messages, sizes, signed_lens, 4, &count, &used));
+        for (size_t i = 0; i < count; i++) {
+            TEST_ASSERT_EQUAL_PTR(data + offset, messages[i]);
+            TEST_ASSERT_EQUAL_UINT(sbuf->size, sizes[i]);
+            TEST_ASSERT_EQUAL_UINT(sbuf->size - UBIRCH_PROTOCOL_SIGN_FIELD_SIZE, signed_lens[i]);
+            offset += sizes[i];
+        }
+        TEST_ASSERT_EQUAL_INT(0, ubirch_protocol_verify_batch(messages, sizes, keys, count,
+                                                              ed25519_verify_batch_ctx, ed25519_verify_ctx, results));
+        found += count;
+    } while (count > 0);
+    TEST_ASSERT_EQUAL_UINT(10, found);
+    TEST_ASSERT_EQUAL_UINT(stream->size - 100, offset);
+
+    // a broken message stops the scan
+    stream->data[3 * sbuf->size] = (char) 0xc1;
+    TEST_ASSERT_EQUAL_INT(UBIRCH_PROTOCOL_MALFORMED, ubirch_protocol_scan(data, stream->size, messages, sizes,
+                                                                          NULL, 4, &count, &used));
+    TEST_ASSERT_EQUAL_UINT(3, count);
+    TEST_ASSERT_EQUAL_UINT(3 * sbuf->size, used);
+
+    msgpack_sbuffer_free(sbuf);
+    msgpack_sbuffer_free(stream);
+}
+
+utest::v1::status_t greentea_test_setup(const size_t number_of_cases) {
+    GREENTEA_SETUP(600, "ProtocolTests");
+    return greentea_test_setup_handler(number_of_cases);
+}
+
+int main() {
+    Case cases[] = {
+            Case("ubirch protocol [view] parse plain",
+                 TestViewPlain, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [view] parse signed",
+                 TestViewSigned, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [view] parse chained",
+                 TestViewChained, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [view] parse back to back messages",
+                 TestViewStream, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [view] reject malformed messages",
+                 TestViewMalformed, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [view] skip elements",
+                 TestViewSkip, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [view] verify",
+                 TestViewVerify, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [view] streaming verify",
+                 TestViewStreamVerify, greentea_case_failure_abort_handler),
+            Case("ubirch protocol [view] scan message stream",
+                 TestViewScan, greentea_case_failure_abort_handler),
+    };
+
+    Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
+    Harness::run(specification);
+}
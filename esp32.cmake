@@ -1,6 +1,20 @@
 set(COMPONENT_SRCS
         ubirch/ubirch_protocol_kex.c
+        ubirch/ubirch_protocol_pool.c
+        ubirch/ubirch_protocol_chain.c
+        ubirch/ubirch_protocol_chain_file.c
+        ubirch/ubirch_protocol_log.c
+        ubirch/ubirch_protocol_view.c
+        ubirch/ubirch_protocol_chain_verify.c
+        ubirch/ubirch_protocol_verifier.c
+        ubirch/ubirch_protocol_batch.c
+        ubirch/ubirch_protocol_iov.c
         ubirch/digest/sha512.c
+        ubirch/digest/sha512_process.c
+        ubirch/digest/sha512_mb.c
+        ubirch/ed25519/ed25519_math.c
+        ubirch/ed25519/ed25519_batch.c
+        ubirch/ed25519/ed25519_keys.c
         )
 set(COMPONENT_ADD_INCLUDEDIRS
         ubirch
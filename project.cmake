@@ -3,6 +3,15 @@ add_library(tests-basic
         TESTS/ubirch/signed/main.cpp
         TESTS/ubirch/chained/main.cpp
         TESTS/ubirch/kex/main.cpp
+        TESTS/ubirch/digest/main.cpp
+        TESTS/ubirch/pool/main.cpp
+        TESTS/ubirch/chain/main.cpp
+        TESTS/ubirch/log/main.cpp
+        TESTS/ubirch/view/main.cpp
+        TESTS/ubirch/chain_verify/main.cpp
+        TESTS/ubirch/verifier/main.cpp
+        TESTS/ubirch/batch/main.cpp
+        TESTS/ubirch/iov/main.cpp
         )
 target_link_libraries(tests-basic mbed-ubirch-protocol)
 
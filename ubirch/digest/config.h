@@ -6,8 +6,16 @@
 #define MBEDTLS_SHA512_C    1
 #define MBEDTLS_BASE64_C    1
 
+// On x86-64 hosts using the bundled digest, replace the portable SHA512 compression
+// function with the kernels from sha512_process.c, which are selected at runtime (AVX2, BMI2).
+#if !defined(MBEDTLS_CONFIG_FILE) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) \
+    && !defined(MBEDTLS_SHA512_PROCESS_ALT)
+#define MBEDTLS_SHA512_PROCESS_X86_64
+#define MBEDTLS_SHA512_PROCESS_ALT
+#endif
+
 #ifdef MBEDTLS_CONFIG_FILE
 #include <mbedtls/check_config.h>
 #endif
 
-#endif //MBEDTLS_H
\ No newline at end of file
+#endif //MBEDTLS_H
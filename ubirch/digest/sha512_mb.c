@@ -0,0 +1,416 @@
+/*
+ *  Multi-buffer SHA-384/512 implementation
+ *
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+/*
+ *  Every lane runs the regular FIPS-180-2 compression function on its own
+ *  message. The lanes are kept in lock step, one 128 byte block per step,
+ *  with the state transposed (word-major) so that each SIMD register holds
+ *  the same state word of all lanes. Lanes that have already consumed all
+ *  of their blocks are fed a dummy block and their result is ignored.
+ */
+
+#include "sha512_mb.h"
+
+#include <string.h>
+#include <stdint.h>
+
+#if defined(_MSC_VER) || defined(__WATCOMC__)
+  #define UL64(x) x##ui64
+#else
+  #define UL64(x) x##ULL
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA512_MB_X86_64
+#include <immintrin.h>
+#endif
+
+#ifndef PUT_UINT64_BE
+#define PUT_UINT64_BE(n,b,i)                            \
+{                                                       \
+    (b)[(i)    ] = (unsigned char) ( (n) >> 56 );       \
+    (b)[(i) + 1] = (unsigned char) ( (n) >> 48 );       \
+    (b)[(i) + 2] = (unsigned char) ( (n) >> 40 );       \
+    (b)[(i) + 3] = (unsigned char) ( (n) >> 32 );       \
+    (b)[(i) + 4] = (unsigned char) ( (n) >> 24 );       \
+    (b)[(i) + 5] = (unsigned char) ( (n) >> 16 );       \
+    (b)[(i) + 6] = (unsigned char) ( (n) >>  8 );       \
+    (b)[(i) + 7] = (unsigned char) ( (n)       );       \
+}
+#endif /* PUT_UINT64_BE */
+
+#if defined(SHA512_MB_X86_64)
+
+#define MB_LANES MBEDTLS_SHA512_MB_MAX_LANES
+
+/*
+ * Round constants
+ */
+static const uint64_t K[80] =
+{
+    UL64(0x428A2F98D728AE22),  UL64(0x7137449123EF65CD),
+    UL64(0xB5C0FBCFEC4D3B2F),  UL64(0xE9B5DBA58189DBBC),
+    UL64(0x3956C25BF348B538),  UL64(0x59F111F1B605D019),
+    UL64(0x923F82A4AF194F9B),  UL64(0xAB1C5ED5DA6D8118),
+    UL64(0xD807AA98A3030242),  UL64(0x12835B0145706FBE),
+    UL64(0x243185BE4EE4B28C),  UL64(0x550C7DC3D5FFB4E2),
+    UL64(0x72BE5D74F27B896F),  UL64(0x80DEB1FE3B1696B1),
+    UL64(0x9BDC06A725C71235),  UL64(0xC19BF174CF692694),
+    UL64(0xE49B69C19EF14AD2),  UL64(0xEFBE4786384F25E3),
+    UL64(0x0FC19DC68B8CD5B5),  UL64(0x240CA1CC77AC9C65),
+    UL64(0x2DE92C6F592B0275),  UL64(0x4A7484AA6EA6E483),
+    UL64(0x5CB0A9DCBD41FBD4),  UL64(0x76F988DA831153B5),
+    UL64(0x983E5152EE66DFAB),  UL64(0xA831C66D2DB43210),
+    UL64(0xB00327C898FB213F),  UL64(0xBF597FC7BEEF0EE4),
+    UL64(0xC6E00BF33DA88FC2),  UL64(0xD5A79147930AA725),
+    UL64(0x06CA6351E003826F),  UL64(0x142929670A0E6E70),
+    UL64(0x27B70A8546D22FFC),  UL64(0x2E1B21385C26C926),
+    UL64(0x4D2C6DFC5AC42AED),  UL64(0x53380D139D95B3DF),
+    UL64(0x650A73548BAF63DE),  UL64(0x766A0ABB3C77B2A8),
+    UL64(0x81C2C92E47EDAEE6),  UL64(0x92722C851482353B),
+    UL64(0xA2BFE8A14CF10364),  UL64(0xA81A664BBC423001),
+    UL64(0xC24B8B70D0F89791),  UL64(0xC76C51A30654BE30),
+    UL64(0xD192E819D6EF5218),  UL64(0xD69906245565A910),
+    UL64(0xF40E35855771202A),  UL64(0x106AA07032BBD1B8),
+    UL64(0x19A4C116B8D2D0C8),  UL64(0x1E376C085141AB53),
+    UL64(0x2748774CDF8EEB99),  UL64(0x34B0BCB5E19B48A8),
+    UL64(0x391C0CB3C5C95A63),  UL64(0x4ED8AA4AE3418ACB),
+    UL64(0x5B9CCA4F7763E373),  UL64(0x682E6FF3D6B2B8A3),
+    UL64(0x748F82EE5DEFB2FC),  UL64(0x78A5636F43172F60),
+    UL64(0x84C87814A1F0AB72),  UL64(0x8CC702081A6439EC),
+    UL64(0x90BEFFFA23631E28),  UL64(0xA4506CEBDE82BDE9),
+    UL64(0xBEF9A3F7B2C67915),  UL64(0xC67178F2E372532B),
+    UL64(0xCA273ECEEA26619C),  UL64(0xD186B8C721C0C207),
+    UL64(0xEADA7DD6CDE0EB1E),  UL64(0xF57D4F7FEE6ED178),
+    UL64(0x06F067AA72176FBA),  UL64(0x0A637DC5A2C898A6),
+    UL64(0x113F9804BEF90DAE),  UL64(0x1B710B35131C471B),
+    UL64(0x28DB77F523047D84),  UL64(0x32CAAB7B40C72493),
+    UL64(0x3C9EBE0A15C9BEBC),  UL64(0x431D67C49C100D4C),
+    UL64(0x4CC5D4BECB3E42B6),  UL64(0x597F299CFC657E2A),
+    UL64(0x5FCB6FAB3AD6FAEC),  UL64(0x6C44198C4A475817)
+};
+
+static inline uint64_t sha512_mb_load_be( const unsigned char *b )
+{
+    uint64_t n;
+    memcpy( &n, b, sizeof( n ) );
+    return( __builtin_bswap64( n ) );
+}
+
+/*
+ * Vector round function, shared by all kernels. The kernels define
+ * VADD, VXOR, VAND, VOR, VSHR and VROTR for their register type.
+ */
+#define MB_S0(x) VXOR(VXOR(VROTR(x, 1), VROTR(x, 8)), VSHR(x, 7))
+#define MB_S1(x) VXOR(VXOR(VROTR(x,19), VROTR(x,61)), VSHR(x, 6))
+
+#define MB_S2(x) VXOR(VXOR(VROTR(x,28), VROTR(x,34)), VROTR(x,39))
+#define MB_S3(x) VXOR(VXOR(VROTR(x,14), VROTR(x,18)), VROTR(x,41))
+
+#define MB_F0(x,y,z) VOR(VAND(x, y), VAND(z, VOR(x, y)))
+#define MB_F1(x,y,z) VXOR(z, VAND(x, VXOR(y, z)))
+
+#define MB_P(a,b,c,d,e,f,g,h,x,k)                                   \
+{                                                                   \
+    temp1 = VADD(VADD(VADD(h, MB_S3(e)), VADD(MB_F1(e,f,g), k)), x);\
+    temp2 = VADD(MB_S2(a), MB_F0(a,b,c));                           \
+    d = VADD(d, temp1); h = VADD(temp1, temp2);                     \
+}
+
+#define MB_ROUNDS(VSET1)                                            \
+    for( i = 16; i < 80; i++ )                                      \
+    {                                                               \
+        W[i] = VADD(VADD(MB_S1(W[i -  2]), W[i -  7]),              \
+                    VADD(MB_S0(W[i - 15]), W[i - 16]));             \
+    }                                                               \
+    i = 0;                                                          \
+    do                                                              \
+    {                                                               \
+        MB_P( A, B, C, D, E, F, G, H, W[i], VSET1(K[i]) ); i++;     \
+        MB_P( H, A, B, C, D, E, F, G, W[i], VSET1(K[i]) ); i++;     \
+        MB_P( G, H, A, B, C, D, E, F, W[i], VSET1(K[i]) ); i++;     \
+        MB_P( F, G, H, A, B, C, D, E, W[i], VSET1(K[i]) ); i++;     \
+        MB_P( E, F, G, H, A, B, C, D, W[i], VSET1(K[i]) ); i++;     \
+        MB_P( D, E, F, G, H, A, B, C, W[i], VSET1(K[i]) ); i++;     \
+        MB_P( C, D, E, F, G, H, A, B, W[i], VSET1(K[i]) ); i++;     \
+        MB_P( B, C, D, E, F, G, H, A, W[i], VSET1(K[i]) ); i++;     \
+    }                                                               \
+    while( i < 80 );
+
+/*
+ * AVX2 kernel, 4 lanes
+ */
+#define VADD(x,y)   _mm256_add_epi64(x, y)
+#define VXOR(x,y)   _mm256_xor_si256(x, y)
+#define VAND(x,y)   _mm256_and_si256(x, y)
+#define VOR(x,y)    _mm256_or_si256(x, y)
+#define VSHR(x,n)   _mm256_srli_epi64(x, n)
+#define VROTR(x,n)  _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+#define VSET1(x)    _mm256_set1_epi64x((long long) (x))
+
+__attribute__((target("avx2")))
+static void sha512_mb_process_avx2( uint64_t state[8][MB_LANES], const unsigned char *data[MB_LANES] )
+{
+    int i;
+    __m256i temp1, temp2, W[80];
+    __m256i A, B, C, D, E, F, G, H;
+
+    for( i = 0; i < 16; i++ )
+    {
+        W[i] = _mm256_set_epi64x( (long long) sha512_mb_load_be( data[3] + ( i << 3 ) ),
+                                  (long long) sha512_mb_load_be( data[2] + ( i << 3 ) ),
+                                  (long long) sha512_mb_load_be( data[1] + ( i << 3 ) ),
+                                  (long long) sha512_mb_load_be( data[0] + ( i << 3 ) ) );
+    }
+
+    A = _mm256_loadu_si256( (const __m256i *) state[0] );
+    B = _mm256_loadu_si256( (const __m256i *) state[1] );
+    C = _mm256_loadu_si256( (const __m256i *) state[2] );
+    D = _mm256_loadu_si256( (const __m256i *) state[3] );
+    E = _mm256_loadu_si256( (const __m256i *) state[4] );
+    F = _mm256_loadu_si256( (const __m256i *) state[5] );
+    G = _mm256_loadu_si256( (const __m256i *) state[6] );
+    H = _mm256_loadu_si256( (const __m256i *) state[7] );
+
+    MB_ROUNDS(VSET1)
+
+    _mm256_storeu_si256( (__m256i *) state[0], VADD( A, _mm256_loadu_si256( (const __m256i *) state[0] ) ) );
+    _mm256_storeu_si256( (__m256i *) state[1], VADD( B, _mm256_loadu_si256( (const __m256i *) state[1] ) ) );
+    _mm256_storeu_si256( (__m256i *) state[2], VADD( C, _mm256_loadu_si256( (const __m256i *) state[2] ) ) );
+    _mm256_storeu_si256( (__m256i *) state[3], VADD( D, _mm256_loadu_si256( (const __m256i *) state[3] ) ) );
+    _mm256_storeu_si256( (__m256i *) state[4], VADD( E, _mm256_loadu_si256( (const __m256i *) state[4] ) ) );
+    _mm256_storeu_si256( (__m256i *) state[5], VADD( F, _mm256_loadu_si256( (const __m256i *) state[5] ) ) );
+    _mm256_storeu_si256( (__m256i *) state[6], VADD( G, _mm256_loadu_si256( (const __m256i *) state[6] ) ) );
+    _mm256_storeu_si256( (__m256i *) state[7], VADD( H, _mm256_loadu_si256( (const __m256i *) state[7] ) ) );
+}
+
+#undef VADD
+#undef VXOR
+#undef VAND
+#undef VOR
+#undef VSHR
+#undef VROTR
+#undef VSET1
+
+/*
+ * AVX-512 kernel, 8 lanes (native 64 bit rotates)
+ */
+#define VADD(x,y)   _mm512_add_epi64(x, y)
+#define VXOR(x,y)   _mm512_xor_si512(x, y)
+#define VAND(x,y)   _mm512_and_si512(x, y)
+#define VOR(x,y)    _mm512_or_si512(x, y)
+#define VSHR(x,n)   _mm512_srli_epi64(x, n)
+#define VROTR(x,n)  _mm512_ror_epi64(x, n)
+#define VSET1(x)    _mm512_set1_epi64((long long) (x))
+
+__attribute__((target("avx512f")))
+static void sha512_mb_process_avx512( uint64_t state[8][MB_LANES], const unsigned char *data[MB_LANES] )
+{
+    int i;
+    __m512i temp1, temp2, W[80];
+    __m512i A, B, C, D, E, F, G, H;
+
+    for( i = 0; i < 16; i++ )
+    {
+        W[i] = _mm512_set_epi64( (long long) sha512_mb_load_be( data[7] + ( i << 3 ) ),
+                                 (long long) sha512_mb_load_be( data[6] + ( i << 3 ) ),
+                                 (long long) sha512_mb_load_be( data[5] + ( i << 3 ) ),
+                                 (long long) sha512_mb_load_be( data[4] + ( i << 3 ) ),
+                                 (long long) sha512_mb_load_be( data[3] + ( i << 3 ) ),
+                                 (long long) sha512_mb_load_be( data[2] + ( i << 3 ) ),
+                                 (long long) sha512_mb_load_be( data[1] + ( i << 3 ) ),
+                                 (long long) sha512_mb_load_be( data[0] + ( i << 3 ) ) );
+    }
+
+    A = _mm512_loadu_si512( state[0] );
+    B = _mm512_loadu_si512( state[1] );
+    C = _mm512_loadu_si512( state[2] );
+    D = _mm512_loadu_si512( state[3] );
+    E = _mm512_loadu_si512( state[4] );
+    F = _mm512_loadu_si512( state[5] );
+    G = _mm512_loadu_si512( state[6] );
+    H = _mm512_loadu_si512( state[7] );
+
+    MB_ROUNDS(VSET1)
+
+    _mm512_storeu_si512( state[0], VADD( A, _mm512_loadu_si512( state[0] ) ) );
+    _mm512_storeu_si512( state[1], VADD( B, _mm512_loadu_si512( state[1] ) ) );
+    _mm512_storeu_si512( state[2], VADD( C, _mm512_loadu_si512( state[2] ) ) );
+    _mm512_storeu_si512( state[3], VADD( D, _mm512_loadu_si512( state[3] ) ) );
+    _mm512_storeu_si512( state[4], VADD( E, _mm512_loadu_si512( state[4] ) ) );
+    _mm512_storeu_si512( state[5], VADD( F, _mm512_loadu_si512( state[5] ) ) );
+    _mm512_storeu_si512( state[6], VADD( G, _mm512_loadu_si512( state[6] ) ) );
+    _mm512_storeu_si512( state[7], VADD( H, _mm512_loadu_si512( state[7] ) ) );
+}
+
+#undef VADD
+#undef VXOR
+#undef VAND
+#undef VOR
+#undef VSHR
+#undef VROTR
+#undef VSET1
+
+typedef void (*sha512_mb_kernel)( uint64_t state[8][MB_LANES], const unsigned char *data[MB_LANES] );
+
+/*
+ * Per lane bookkeeping: full blocks are read straight from the input,
+ * the last one or two (padded) blocks come from the tail buffer.
+ */
+typedef struct
+{
+    const unsigned char *input;
+    size_t blocks;                  /* full 128 byte blocks in the input */
+    size_t total;                   /* blocks including padding          */
+    unsigned char tail[256];        /* remainder, padding and length     */
+}
+sha512_mb_lane;
+
+static void sha512_mb_lane_setup( sha512_mb_lane *lane, const unsigned char *input, size_t ilen )
+{
+    size_t left = ilen & 0x7F;
+    size_t tail = ( left < 112 ) ? 128 : 256;
+    uint64_t high = (uint64_t) ilen >> 61;
+    uint64_t low  = (uint64_t) ilen << 3;
+
+    lane->input = input;
+    lane->blocks = ilen >> 7;
+    lane->total = lane->blocks + tail / 128;
+
+    memcpy( lane->tail, input + ( lane->blocks << 7 ), left );
+    lane->tail[left] = 0x80;
+    memset( lane->tail + left + 1, 0, tail - left - 1 );
+    PUT_UINT64_BE( high, lane->tail, tail - 16 );
+    PUT_UINT64_BE( low,  lane->tail, tail -  8 );
+}
+
+static void sha512_mb_group( sha512_mb_kernel kernel, size_t width,
+                             const unsigned char * const input[], const size_t ilen[],
+                             unsigned char output[][64], size_t n, int is384 )
+{
+    static const unsigned char dummy[128] = { 0 };
+    sha512_mb_lane lanes[MB_LANES];
+    uint64_t state[8][MB_LANES];
+    const unsigned char *data[MB_LANES];
+    mbedtls_sha512_context ctx;
+    size_t i, j, b, blocks = 0;
+
+    mbedtls_sha512_starts( &ctx, is384 );
+
+    for( j = 0; j < width; j++ )
+    {
+        for( i = 0; i < 8; i++ )
+            state[i][j] = ctx.state[i];
+
+        if( j < n )
+        {
+            sha512_mb_lane_setup( &lanes[j], input[j], ilen[j] );
+            if( lanes[j].total > blocks )
+                blocks = lanes[j].total;
+        }
+    }
+
+    for( b = 0; b < blocks; b++ )
+    {
+        for( j = 0; j < width; j++ )
+        {
+            if( j >= n || b >= lanes[j].total )
+                data[j] = dummy;
+            else if( b < lanes[j].blocks )
+                data[j] = lanes[j].input + ( b << 7 );
+            else
+                data[j] = lanes[j].tail + ( ( b - lanes[j].blocks ) << 7 );
+        }
+
+        kernel( state, data );
+
+        for( j = 0; j < n; j++ )
+        {
+            if( b + 1 != lanes[j].total )
+                continue;
+
+            for( i = 0; i < ( is384 ? 6u : 8u ); i++ )
+                PUT_UINT64_BE( state[i][j], output[j], i << 3 );
+        }
+    }
+}
+
+/* the number of lanes, 0 until the CPU is checked on first use; all threads
+ * select the same width, so the unsynchronized update is benign */
+static size_t sha512_mb_width = 0;
+
+static sha512_mb_kernel sha512_mb_select( size_t *width )
+{
+    size_t lanes = sha512_mb_width;
+
+    if( lanes == 0 )
+    {
+        __builtin_cpu_init();
+
+        if( __builtin_cpu_supports( "avx512f" ) )
+            lanes = 8;
+        else if( __builtin_cpu_supports( "avx2" ) )
+            lanes = 4;
+        else
+            lanes = 1;
+
+        sha512_mb_width = lanes;
+    }
+
+    *width = lanes;
+    if( lanes == 8 )
+        return( sha512_mb_process_avx512 );
+    if( lanes == 4 )
+        return( sha512_mb_process_avx2 );
+    return( NULL );
+}
+
+#endif /* SHA512_MB_X86_64 */
+
+size_t mbedtls_sha512_mb_lanes( void )
+{
+    size_t width = 1;
+#if defined(SHA512_MB_X86_64)
+    sha512_mb_select( &width );
+#endif
+    return( width );
+}
+
+/*
+ * output[i] = SHA-512( input[i] )
+ */
+void mbedtls_sha512_mb( const unsigned char * const input[], const size_t ilen[],
+                        unsigned char output[][64], size_t n, int is384 )
+{
+    size_t i = 0;
+
+#if defined(SHA512_MB_X86_64)
+    size_t width;
+    sha512_mb_kernel kernel = sha512_mb_select( &width );
+
+    /* a group of a single message is cheaper to hash on its own */
+    while( kernel != NULL && n - i > 1 )
+    {
+        size_t count = ( n - i < width ) ? n - i : width;
+        sha512_mb_group( kernel, width, input + i, ilen + i, output + i, count, is384 );
+        i += count;
+    }
+#endif
+
+    for( ; i < n; i++ )
+        mbedtls_sha512( input[i], ilen[i], output[i], is384 );
+}
@@ -0,0 +1,68 @@
+/**
+ * \file sha512_mb.h
+ *
+ * \brief Multi-buffer SHA-384 and SHA-512 for many independent messages
+ *
+ * Hashes a set of independent messages, processing several of them side
+ * by side in SIMD lanes (AVX-512: 8 lanes, AVX2: 4 lanes) on x86-64 hosts.
+ * The kernel is selected at runtime; all other platforms fall back to
+ * hashing the messages one after another with mbedtls_sha512().
+ *
+ * The output for every message is identical to mbedtls_sha512().
+ *
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#ifndef MBEDTLS_SHA512_MB_H
+#define MBEDTLS_SHA512_MB_H
+
+#if defined(MBEDTLS_CONFIG_FILE)
+#include <mbedtls/sha512.h>
+#else
+#include "sha512.h"
+#endif
+
+#include <stddef.h>
+
+#define MBEDTLS_SHA512_MB_MAX_LANES 8   /*!< widest supported lane count */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Output[i] = SHA-512( input[i] ) for n independent buffers
+ *
+ * \param input    array of n buffers holding the data
+ * \param ilen     array of n lengths of the input data
+ * \param output   array of n SHA-384/512 checksum results
+ * \param n        number of buffers
+ * \param is384    0 = use SHA512, 1 = use SHA384
+ */
+void mbedtls_sha512_mb( const unsigned char * const input[], const size_t ilen[],
+                        unsigned char output[][64], size_t n, int is384 );
+
+/**
+ * \brief          Number of messages hashed in parallel by the kernel
+ *                 selected on this machine (1 if no SIMD kernel is available)
+ *
+ * \return         the lane count, callers may use it to size their batches
+ */
+size_t mbedtls_sha512_mb_lanes( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBEDTLS_SHA512_MB_H */
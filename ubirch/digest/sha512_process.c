@@ -0,0 +1,270 @@
+/*
+ *  Runtime dispatched SHA-384/512 compression function for x86-64
+ *
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+/*
+ *  Provides mbedtls_sha512_process() for MBEDTLS_SHA512_PROCESS_ALT (see
+ *  config.h). On first use the CPU is checked and one of these is selected:
+ *
+ *  - AVX2: message schedule (and W + K) computed two words at a time in
+ *          vector registers, byte swap by shuffle, rounds with rorx
+ *  - BMI2: unrolled scalar rounds using rorx and a rolling 16 word schedule
+ *  - a portable version equal to the regular implementation in sha512.c
+ */
+
+#include "sha512.h"
+
+#if defined(MBEDTLS_SHA512_PROCESS_X86_64)
+
+#include <string.h>
+#include <immintrin.h>
+
+#define UL64(x) x##ULL
+
+/*
+ * Round constants
+ */
+static const uint64_t K[80] =
+{
+    UL64(0x428A2F98D728AE22),  UL64(0x7137449123EF65CD),
+    UL64(0xB5C0FBCFEC4D3B2F),  UL64(0xE9B5DBA58189DBBC),
+    UL64(0x3956C25BF348B538),  UL64(0x59F111F1B605D019),
+    UL64(0x923F82A4AF194F9B),  UL64(0xAB1C5ED5DA6D8118),
+    UL64(0xD807AA98A3030242),  UL64(0x12835B0145706FBE),
+    UL64(0x243185BE4EE4B28C),  UL64(0x550C7DC3D5FFB4E2),
+    UL64(0x72BE5D74F27B896F),  UL64(0x80DEB1FE3B1696B1),
+    UL64(0x9BDC06A725C71235),  UL64(0xC19BF174CF692694),
+    UL64(0xE49B69C19EF14AD2),  UL64(0xEFBE4786384F25E3),
+    UL64(0x0FC19DC68B8CD5B5),  UL64(0x240CA1CC77AC9C65),
+    UL64(0x2DE92C6F592B0275),  UL64(0x4A7484AA6EA6E483),
+    UL64(0x5CB0A9DCBD41FBD4),  UL64(0x76F988DA831153B5),
+    UL64(0x983E5152EE66DFAB),  UL64(0xA831C66D2DB43210),
+    UL64(0xB00327C898FB213F),  UL64(0xBF597FC7BEEF0EE4),
+    UL64(0xC6E00BF33DA88FC2),  UL64(0xD5A79147930AA725),
+    UL64(0x06CA6351E003826F),  UL64(0x142929670A0E6E70),
+    UL64(0x27B70A8546D22FFC),  UL64(0x2E1B21385C26C926),
+    UL64(0x4D2C6DFC5AC42AED),  UL64(0x53380D139D95B3DF),
+    UL64(0x650A73548BAF63DE),  UL64(0x766A0ABB3C77B2A8),
+    UL64(0x81C2C92E47EDAEE6),  UL64(0x92722C851482353B),
+    UL64(0xA2BFE8A14CF10364),  UL64(0xA81A664BBC423001),
+    UL64(0xC24B8B70D0F89791),  UL64(0xC76C51A30654BE30),
+    UL64(0xD192E819D6EF5218),  UL64(0xD69906245565A910),
+    UL64(0xF40E35855771202A),  UL64(0x106AA07032BBD1B8),
+    UL64(0x19A4C116B8D2D0C8),  UL64(0x1E376C085141AB53),
+    UL64(0x2748774CDF8EEB99),  UL64(0x34B0BCB5E19B48A8),
+    UL64(0x391C0CB3C5C95A63),  UL64(0x4ED8AA4AE3418ACB),
+    UL64(0x5B9CCA4F7763E373),  UL64(0x682E6FF3D6B2B8A3),
+    UL64(0x748F82EE5DEFB2FC),  UL64(0x78A5636F43172F60),
+    UL64(0x84C87814A1F0AB72),  UL64(0x8CC702081A6439EC),
+    UL64(0x90BEFFFA23631E28),  UL64(0xA4506CEBDE82BDE9),
+    UL64(0xBEF9A3F7B2C67915),  UL64(0xC67178F2E372532B),
+    UL64(0xCA273ECEEA26619C),  UL64(0xD186B8C721C0C207),
+    UL64(0xEADA7DD6CDE0EB1E),  UL64(0xF57D4F7FEE6ED178),
+    UL64(0x06F067AA72176FBA),  UL64(0x0A637DC5A2C898A6),
+    UL64(0x113F9804BEF90DAE),  UL64(0x1B710B35131C471B),
+    UL64(0x28DB77F523047D84),  UL64(0x32CAAB7B40C72493),
+    UL64(0x3C9EBE0A15C9BEBC),  UL64(0x431D67C49C100D4C),
+    UL64(0x4CC5D4BECB3E42B6),  UL64(0x597F299CFC657E2A),
+    UL64(0x5FCB6FAB3AD6FAEC),  UL64(0x6C44198C4A475817)
+};
+
+#define  SHR(x,n) ((x) >> (n))
+#define ROTR(x,n) (SHR(x,n) | ((x) << (64 - (n))))
+
+#define S0(x) (ROTR(x, 1) ^ ROTR(x, 8) ^  SHR(x, 7))
+#define S1(x) (ROTR(x,19) ^ ROTR(x,61) ^  SHR(x, 6))
+
+#define S2(x) (ROTR(x,28) ^ ROTR(x,34) ^ ROTR(x,39))
+#define S3(x) (ROTR(x,14) ^ ROTR(x,18) ^ ROTR(x,41))
+
+#define F0(x,y,z) ((x & y) | (z & (x | y)))
+#define F1(x,y,z) (z ^ (x & (y ^ z)))
+
+/* round with the constant already added to the message word */
+#define PK(a,b,c,d,e,f,g,h,wk)                  \
+{                                               \
+    temp1 = h + S3(e) + F1(e,f,g) + wk;         \
+    temp2 = S2(a) + F0(a,b,c);                  \
+    d += temp1; h = temp1 + temp2;              \
+}
+
+#define ROUNDS8(i, WK)                                  \
+{                                                       \
+    PK( A, B, C, D, E, F, G, H, WK((i)    ) );          \
+    PK( H, A, B, C, D, E, F, G, WK((i) + 1) );          \
+    PK( G, H, A, B, C, D, E, F, WK((i) + 2) );          \
+    PK( F, G, H, A, B, C, D, E, WK((i) + 3) );          \
+    PK( E, F, G, H, A, B, C, D, WK((i) + 4) );          \
+    PK( D, E, F, G, H, A, B, C, WK((i) + 5) );          \
+    PK( C, D, E, F, G, H, A, B, WK((i) + 6) );          \
+    PK( B, C, D, E, F, G, H, A, WK((i) + 7) );          \
+}
+
+static inline uint64_t sha512_load_be( const unsigned char *b )
+{
+    uint64_t n;
+    memcpy( &n, b, sizeof( n ) );
+    return( __builtin_bswap64( n ) );
+}
+
+/*
+ * Portable version, identical to the regular implementation
+ */
+static void sha512_process_c( mbedtls_sha512_context *ctx, const unsigned char data[128] )
+{
+    int i;
+    uint64_t temp1, temp2, W[80];
+    uint64_t A, B, C, D, E, F, G, H;
+
+    for( i = 0; i < 16; i++ )
+        W[i] = sha512_load_be( data + ( i << 3 ) );
+
+    for( ; i < 80; i++ )
+        W[i] = S1(W[i -  2]) + W[i -  7] + S0(W[i - 15]) + W[i - 16];
+
+    A = ctx->state[0]; B = ctx->state[1]; C = ctx->state[2]; D = ctx->state[3];
+    E = ctx->state[4]; F = ctx->state[5]; G = ctx->state[6]; H = ctx->state[7];
+
+#define WK_C(i) ( W[i] + K[i] )
+    for( i = 0; i < 80; i += 8 )
+        ROUNDS8( i, WK_C );
+#undef WK_C
+
+    ctx->state[0] += A; ctx->state[1] += B; ctx->state[2] += C; ctx->state[3] += D;
+    ctx->state[4] += E; ctx->state[5] += F; ctx->state[6] += G; ctx->state[7] += H;
+}
+
+/*
+ * BMI2 version: the compiler emits rorx for ROTR, the schedule only keeps
+ * the last 16 words and is expanded just in time for each round.
+ */
+#define W16(i)      W[(i) & 15]
+#define SCHED(i)    ( W16(i) += S1(W16((i) - 2)) + W16((i) - 7) + S0(W16((i) - 15)) )
+#define WK_LOAD(i)  ( W16(i) + K[i] )
+#define WK_SCHED(i) ( SCHED(i) + K[i] )
+
+__attribute__((target("bmi2")))
+static void sha512_process_bmi2( mbedtls_sha512_context *ctx, const unsigned char data[128] )
+{
+    int i;
+    uint64_t temp1, temp2, W[16];
+    uint64_t A, B, C, D, E, F, G, H;
+
+    for( i = 0; i < 16; i++ )
+        W[i] = sha512_load_be( data + ( i << 3 ) );
+
+    A = ctx->state[0]; B = ctx->state[1]; C = ctx->state[2]; D = ctx->state[3];
+    E = ctx->state[4]; F = ctx->state[5]; G = ctx->state[6]; H = ctx->state[7];
+
+    ROUNDS8(  0, WK_LOAD );
+    ROUNDS8(  8, WK_LOAD );
+    for( i = 16; i < 80; i += 8 )
+        ROUNDS8( i, WK_SCHED );
+
+    ctx->state[0] += A; ctx->state[1] += B; ctx->state[2] += C; ctx->state[3] += D;
+    ctx->state[4] += E; ctx->state[5] += F; ctx->state[6] += G; ctx->state[7] += H;
+}
+
+#undef W16
+#undef SCHED
+#undef WK_LOAD
+#undef WK_SCHED
+
+/*
+ * AVX2 version: the whole message schedule plus round constants is computed
+ * up front in vector registers, leaving only the rounds for the scalar units.
+ */
+#define V128_ROTR(x,n) _mm_or_si128( _mm_srli_epi64( x, n ), _mm_slli_epi64( x, 64 - (n) ) )
+
+__attribute__((target("avx2,bmi2")))
+static void sha512_process_avx2( mbedtls_sha512_context *ctx, const unsigned char data[128] )
+{
+    int i;
+    uint64_t temp1, temp2, A, B, C, D, E, F, G, H;
+    uint64_t W[80] __attribute__((aligned(32)));
+    uint64_t WK[80] __attribute__((aligned(32)));
+    const __m256i bswap = _mm256_set_epi8( 8,  9, 10, 11, 12, 13, 14, 15,
+                                           0,  1,  2,  3,  4,  5,  6,  7,
+                                           8,  9, 10, 11, 12, 13, 14, 15,
+                                           0,  1,  2,  3,  4,  5,  6,  7 );
+
+    for( i = 0; i < 16; i += 4 )
+    {
+        __m256i w = _mm256_loadu_si256( (const __m256i *) ( data + ( i << 3 ) ) );
+        _mm256_store_si256( (__m256i *) &W[i], _mm256_shuffle_epi8( w, bswap ) );
+    }
+
+    /* W[i] depends on W[i - 2], so two words can be expanded per step */
+    for( i = 16; i < 80; i += 2 )
+    {
+        __m128i w2  = _mm_load_si128( (const __m128i *) &W[i - 2] );
+        __m128i w7  = _mm_loadu_si128( (const __m128i *) &W[i - 7] );
+        __m128i w15 = _mm_loadu_si128( (const __m128i *) &W[i - 15] );
+        __m128i w16 = _mm_load_si128( (const __m128i *) &W[i - 16] );
+        __m128i s0  = _mm_xor_si128( _mm_xor_si128( V128_ROTR( w15, 1 ), V128_ROTR( w15, 8 ) ),
+                                     _mm_srli_epi64( w15, 7 ) );
+        __m128i s1  = _mm_xor_si128( _mm_xor_si128( V128_ROTR( w2, 19 ), V128_ROTR( w2, 61 ) ),
+                                     _mm_srli_epi64( w2, 6 ) );
+        _mm_store_si128( (__m128i *) &W[i],
+                         _mm_add_epi64( _mm_add_epi64( s1, w7 ), _mm_add_epi64( s0, w16 ) ) );
+    }
+
+    for( i = 0; i < 80; i += 4 )
+    {
+        _mm256_store_si256( (__m256i *) &WK[i],
+                            _mm256_add_epi64( _mm256_load_si256( (const __m256i *) &W[i] ),
+                                              _mm256_loadu_si256( (const __m256i *) &K[i] ) ) );
+    }
+
+    A = ctx->state[0]; B = ctx->state[1]; C = ctx->state[2]; D = ctx->state[3];
+    E = ctx->state[4]; F = ctx->state[5]; G = ctx->state[6]; H = ctx->state[7];
+
+#define WK_V(i) WK[i]
+    for( i = 0; i < 80; i += 8 )
+        ROUNDS8( i, WK_V );
+#undef WK_V
+
+    ctx->state[0] += A; ctx->state[1] += B; ctx->state[2] += C; ctx->state[3] += D;
+    ctx->state[4] += E; ctx->state[5] += F; ctx->state[6] += G; ctx->state[7] += H;
+}
+
+typedef void (*sha512_process_fn)( mbedtls_sha512_context *ctx, const unsigned char data[128] );
+
+static void sha512_process_select( mbedtls_sha512_context *ctx, const unsigned char data[128] );
+
+/* all threads select the same kernel, so the unsynchronized update is benign */
+static sha512_process_fn sha512_process = sha512_process_select;
+
+static void sha512_process_select( mbedtls_sha512_context *ctx, const unsigned char data[128] )
+{
+    __builtin_cpu_init();
+
+    if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "bmi2" ) )
+        sha512_process = sha512_process_avx2;
+    else if( __builtin_cpu_supports( "bmi2" ) )
+        sha512_process = sha512_process_bmi2;
+    else
+        sha512_process = sha512_process_c;
+
+    sha512_process( ctx, data );
+}
+
+void mbedtls_sha512_process( mbedtls_sha512_context *ctx, const unsigned char data[128] )
+{
+    sha512_process( ctx, data );
+}
+
+#endif /* MBEDTLS_SHA512_PROCESS_X86_64 */
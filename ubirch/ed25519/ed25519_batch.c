@@ -0,0 +1,124 @@
+/*!
+ * @file
+ * @brief randomized batch verification of ed25519 signatures
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include "ed25519_batch.h"
+
+#ifdef ED25519_MATH_64
+
+#include <stdlib.h>
+#include <string.h>
+#include "../digest/sha512_mb.h"
+
+// provided by the application (see nacl-cm0 randombytes.h)
+extern void randombytes(unsigned char *x, unsigned long long xlen);
+
+/*
+ * Verify up to ED25519_BATCH_MAX signatures. Point 0 is the base point,
+ * points 1 .. n are -R_i and points n+1 .. 2n are -A_i.
+ */
+static int ed25519_verify_batch_chunk(const unsigned char *const m[], const size_t mlen[],
+                                      const unsigned char *const signatures[],
+                                      const unsigned char *const public_keys[], size_t n) {
+    const size_t points = 2 * n + 1;
+    size_t klen_total = 0;
+
+    for (size_t i = 0; i < n; i++) klen_total += 64 + mlen[i];
+
+    // one allocation for the point tables, digits, hash input and output
+    const size_t tables_size = points * sizeof(ed25519_ge_cached[ED25519_WNAF_TABLE]);
+    const size_t wnaf_size = points * sizeof(signed char[ED25519_WNAF_SIZE]);
+    unsigned char *mem = (unsigned char *) malloc(tables_size + wnaf_size + n * 64 + klen_total);
+    if (!mem) return -2;
+
+    ed25519_ge_cached (*tables)[ED25519_WNAF_TABLE] = (ed25519_ge_cached (*)[ED25519_WNAF_TABLE]) mem;
+    signed char (*wnaf)[ED25519_WNAF_SIZE] = (signed char (*)[ED25519_WNAF_SIZE]) (mem + tables_size);
+    unsigned char (*k)[64] = (unsigned char (*)[64]) (mem + tables_size + wnaf_size);
+    unsigned char *kbuf = mem + tables_size + wnaf_size + n * 64;
+
+    const unsigned char *kin[ED25519_BATCH_MAX];
+    size_t kinlen[ED25519_BATCH_MAX];
+    unsigned char z[ED25519_BATCH_MAX][32];
+    unsigned char b[32] = {0};
+    unsigned char zero[32] = {0};
+    unsigned char s[32];
+    ed25519_ge p;
+    int ret = -1;
+
+    // decode the points and check the encodings
+    for (size_t i = 0; i < n; i++) {
+        const unsigned char *sig = signatures[i];
+        if (!ed25519_sc_is_canonical(sig + 32)) goto exit;
+        if (ed25519_ge_frombytes_vartime(&p, sig)) goto exit;
+        ed25519_ge_neg(&p, &p);
+        ed25519_ge_wnaf_table(tables[1 + i], &p);
+        if (ed25519_ge_frombytes_vartime(&p, public_keys[i])) goto exit;
+        ed25519_ge_neg(&p, &p);
+        ed25519_ge_wnaf_table(tables[1 + n + i], &p);
+    }
+    ed25519_ge_wnaf_table(tables[0], &ed25519_ge_base);
+
+    // k_i = H(R_i || A_i || m_i), hashed side by side
+    for (size_t i = 0, off = 0; i < n; i++) {
+        memcpy(kbuf + off, signatures[i], 32);
+        memcpy(kbuf + off + 32, public_keys[i], 32);
+        memcpy(kbuf + off + 64, m[i], mlen[i]);
+        kin[i] = kbuf + off;
+        kinlen[i] = 64 + mlen[i];
+        off += kinlen[i];
+    }
+    mbedtls_sha512_mb(kin, kinlen, k, n, 0);
+
+    // random 128 bit coefficients
+    memset(z, 0, sizeof(z));
+    for (size_t i = 0; i < n; i++) randombytes(z[i], 16);
+
+    for (size_t i = 0; i < n; i++) {
+        ed25519_sc_reduce(s, k[i]);
+        ed25519_sc_muladd(s, z[i], s, zero);                // z_i * k_i
+        ed25519_sc_wnaf(wnaf[1 + n + i], s);
+        ed25519_sc_wnaf(wnaf[1 + i], z[i]);
+        ed25519_sc_muladd(b, z[i], signatures[i] + 32, b);  // sum(z_i * S_i)
+    }
+    ed25519_sc_wnaf(wnaf[0], b);
+
+    ed25519_ge_multi_scalarmult_vartime(&p, tables, wnaf, points);
+    ed25519_ge_dbl(&p, &p);
+    ed25519_ge_dbl(&p, &p);
+    ed25519_ge_dbl(&p, &p);
+    ret = ed25519_ge_is_zero(&p) ? 0 : -1;
+
+    exit:
+    free(mem);
+    return ret;
+}
+
+int ed25519_verify_batch(const unsigned char *const m[], const size_t mlen[],
+                         const unsigned char *const signatures[], const unsigned char *const public_keys[],
+                         size_t n) {
+    int ret = 0;
+    for (size_t i = 0; i < n && !ret; i += ED25519_BATCH_MAX) {
+        const size_t count = n - i < ED25519_BATCH_MAX ? n - i : ED25519_BATCH_MAX;
+        ret = ed25519_verify_batch_chunk(m + i, mlen + i, signatures + i, public_keys + i, count);
+    }
+    return ret;
+}
+
+#endif // ED25519_MATH_64
@@ -0,0 +1,76 @@
+/*!
+ * @file
+ * @brief randomized batch verification of ed25519 signatures
+ *
+ * Checks many signatures with a single multi-scalar multiplication
+ * (Straus' method with shared doublings) instead of one double scalar
+ * multiplication per signature. With random 128 bit coefficients z_i the
+ * combined equation
+ *
+ *     8 * ( sum(z_i * S_i) * B - sum(z_i * R_i) - sum(z_i * k_i * A_i) ) = 0
+ *
+ * holds for a batch containing an invalid signature only with negligible
+ * probability. A failing batch does not tell which signature is invalid,
+ * callers fall back to checking the signatures one by one.
+ *
+ * The equation is cofactored (multiplied by 8), like most batch verifiers,
+ * and so is the single signature check (#ed25519_verify_expanded) used when
+ * a batch fails: a signature with small order components, which only the key
+ * owner can craft, gets the same result alone and in any batch.
+ *
+ * Only available on hosts with 64 bit arithmetic (ED25519_MATH_64).
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef UBIRCH_ED25519_BATCH_H
+#define UBIRCH_ED25519_BATCH_H
+
+#include "ed25519_math.h"
+
+#ifdef ED25519_MATH_64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ED25519_BATCH_MAX 64    //!< signatures combined into one multi-scalar multiplication
+
+/**
+ * Verify n signatures at once. Larger sets are checked in chunks of
+ * ED25519_BATCH_MAX signatures. Uses the heap for the point tables
+ * (about 3k per signature) and randombytes() for the coefficients.
+ * @param m the signed messages
+ * @param mlen the lengths of the signed messages
+ * @param signatures the signatures (64 bytes each)
+ * @param public_keys the public keys (32 bytes each)
+ * @param n the number of signatures
+ * @return 0 if all signatures are valid
+ * @return -1 if at least one signature is invalid
+ * @return -2 if memory allocation failed
+ */
+int ed25519_verify_batch(const unsigned char *const m[], const size_t mlen[],
+                         const unsigned char *const signatures[], const unsigned char *const public_keys[],
+                         size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ED25519_MATH_64
+
+#endif // UBIRCH_ED25519_BATCH_H
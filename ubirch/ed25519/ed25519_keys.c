@@ -0,0 +1,125 @@
+/*!
+ * @file
+ * @brief expanded ed25519 keys for repeated signing and verification
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include "ed25519_keys.h"
+
+#ifdef ED25519_MATH_64
+
+#include <string.h>
+
+#if defined(MBEDTLS_CONFIG_FILE)
+#include <mbedtls/sha512.h>
+#else
+#include "../digest/sha512.h"
+#endif
+
+int ed25519_public_key_expand(ed25519_expanded_public_key *key, const unsigned char public_key[32]) {
+    ed25519_ge a;
+
+    if (ed25519_ge_frombytes_vartime(&a, public_key)) return -1;
+    ed25519_ge_neg(&a, &a);
+    ed25519_ge_wnaf_table(key->table, &a);
+    memcpy(key->key, public_key, 32);
+
+    return 0;
+}
+
+int ed25519_verify_expanded(const ed25519_expanded_public_key *key, const unsigned char *m, size_t mlen,
+                            const unsigned char signature[64]) {
+    mbedtls_sha512_context ctx;
+    unsigned char h[64], k[32], r[32];
+    ed25519_ge p, q;
+    ed25519_ge_cached c;
+
+    if (!ed25519_sc_is_canonical(signature + 32)) return -1;
+
+    // k = H(R || A || m) mod l
+    mbedtls_sha512_init(&ctx);
+    mbedtls_sha512_starts(&ctx, 0);
+    mbedtls_sha512_update(&ctx, signature, 32);
+    mbedtls_sha512_update(&ctx, key->key, 32);
+    mbedtls_sha512_update(&ctx, m, mlen);
+    mbedtls_sha512_finish(&ctx, h);
+    mbedtls_sha512_free(&ctx);
+    ed25519_sc_reduce(k, h);
+
+    // R == S * B - k * A, which is the usual case
+    ed25519_ge_double_scalarmult_vartime(&p, k, key->table, signature + 32);
+    ed25519_ge_tobytes(r, &p);
+    if (!memcmp(r, signature, 32)) return 0;
+
+    // 8 * (S * B - k * A - R) == 0, the same equation as the batch verification
+    if (ed25519_ge_frombytes_vartime(&q, signature)) return -1;
+    ed25519_ge_to_cached(&c, &q);
+    ed25519_ge_sub(&p, &p, &c);
+    ed25519_ge_dbl(&p, &p);
+    ed25519_ge_dbl(&p, &p);
+    ed25519_ge_dbl(&p, &p);
+
+    return ed25519_ge_is_zero(&p) ? 0 : -1;
+}
+
+void ed25519_secret_key_expand(ed25519_expanded_secret_key *key, const unsigned char secret_key[64]) {
+    unsigned char h[64];
+
+    mbedtls_sha512(secret_key, 32, h, 0);
+    h[0] &= 248;
+    h[31] &= 127;
+    h[31] |= 64;
+    memcpy(key->scalar, h, 32);
+    memcpy(key->prefix, h + 32, 32);
+    memcpy(key->public_key, secret_key + 32, 32);
+    memset(h, 0, sizeof(h));
+}
+
+void ed25519_sign_expanded(const ed25519_expanded_secret_key *key, const unsigned char *m, size_t mlen,
+                           unsigned char signature[64]) {
+    mbedtls_sha512_context ctx;
+    unsigned char h[64], r[32], k[32];
+    ed25519_ge p;
+
+    // r = H(prefix || m) mod l
+    mbedtls_sha512_init(&ctx);
+    mbedtls_sha512_starts(&ctx, 0);
+    mbedtls_sha512_update(&ctx, key->prefix, 32);
+    mbedtls_sha512_update(&ctx, m, mlen);
+    mbedtls_sha512_finish(&ctx, h);
+    ed25519_sc_reduce(r, h);
+
+    // R = r * B
+    ed25519_ge_scalarmult_base(&p, r);
+    ed25519_ge_tobytes(signature, &p);
+
+    // k = H(R || A || m) mod l
+    mbedtls_sha512_starts(&ctx, 0);
+    mbedtls_sha512_update(&ctx, signature, 32);
+    mbedtls_sha512_update(&ctx, key->public_key, 32);
+    mbedtls_sha512_update(&ctx, m, mlen);
+    mbedtls_sha512_finish(&ctx, h);
+    mbedtls_sha512_free(&ctx);
+    ed25519_sc_reduce(k, h);
+
+    // S = r + k * a mod l
+    ed25519_sc_muladd(signature + 32, k, key->scalar, r);
+    memset(r, 0, sizeof(r));
+}
+
+#endif // ED25519_MATH_64
@@ -0,0 +1,109 @@
+/*!
+ * @file
+ * @brief expanded ed25519 keys for repeated signing and verification
+ *
+ * Decoding a public key includes a field square root, which costs about
+ * as much as a tenth of the verification itself. An expanded public key
+ * keeps the decoded point and its wNAF table of odd multiples, so each
+ * verification only hashes and runs the double scalar multiplication.
+ *
+ * An expanded secret key keeps the clamped secret scalar and the nonce
+ * prefix (the two halves of SHA-512(seed)), so signing skips hashing the
+ * secret key. Signatures are identical to the ones of crypto_sign().
+ *
+ * Only available on hosts with 64 bit arithmetic (ED25519_MATH_64).
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef UBIRCH_ED25519_KEYS_H
+#define UBIRCH_ED25519_KEYS_H
+
+#include "ed25519_math.h"
+
+#ifdef ED25519_MATH_64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A public key prepared for verification.
+ */
+typedef struct ed25519_expanded_public_key {
+    unsigned char key[32];                              //!< the compressed public key A
+    ed25519_ge_cached table[ED25519_WNAF_TABLE];        //!< odd multiples of -A
+} ed25519_expanded_public_key;
+
+/**
+ * Expand a public key for verification.
+ * @param key the expanded key
+ * @param public_key the 32 byte public key
+ * @return 0 on success
+ * @return -1 if the public key is not a valid curve point
+ */
+int ed25519_public_key_expand(ed25519_expanded_public_key *key, const unsigned char public_key[32]);
+
+/**
+ * Verify a signature with an expanded public key. The result is the same as
+ * for the nacl-cm0 crypto_sign_open(), except that a signature scalar S that
+ * is not reduced mod l is rejected (RFC 8032), and that the equation is
+ * cofactored like in #ed25519_verify_batch, so a signature is accepted or
+ * rejected the same way whether it is checked alone or in a batch.
+ * @param key the expanded public key
+ * @param m the signed message
+ * @param mlen the length of the message
+ * @param signature the 64 byte signature
+ * @return 0 if the signature is valid
+ * @return -1 if the verification failed
+ */
+int ed25519_verify_expanded(const ed25519_expanded_public_key *key, const unsigned char *m, size_t mlen,
+                            const unsigned char signature[64]);
+
+/**
+ * A secret key prepared for signing.
+ */
+typedef struct ed25519_expanded_secret_key {
+    unsigned char scalar[32];                           //!< the clamped secret scalar a
+    unsigned char prefix[32];                           //!< the nonce prefix
+    unsigned char public_key[32];                       //!< the compressed public key A
+} ed25519_expanded_secret_key;
+
+/**
+ * Expand a NaCl secret key (32 byte seed followed by the 32 byte public key).
+ * @param key the expanded key
+ * @param secret_key the 64 byte secret key
+ */
+void ed25519_secret_key_expand(ed25519_expanded_secret_key *key, const unsigned char secret_key[64]);
+
+/**
+ * Sign a message with an expanded secret key, in constant time.
+ * @param key the expanded secret key
+ * @param m the message to sign
+ * @param mlen the length of the message
+ * @param signature the 64 byte signature
+ */
+void ed25519_sign_expanded(const ed25519_expanded_secret_key *key, const unsigned char *m, size_t mlen,
+                           unsigned char signature[64]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ED25519_MATH_64
+
+#endif // UBIRCH_ED25519_KEYS_H
@@ -0,0 +1,796 @@
+/*!
+ * @file
+ * @brief curve25519 field, group and scalar arithmetic for 64 bit hosts
+ *
+ * The field and group formulas follow the ref10 implementation by
+ * D. J. Bernstein et al. (public domain), with the field arithmetic
+ * rewritten for radix 2^51 as in curve25519-donna-64.
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include "ed25519_math.h"
+
+#ifdef ED25519_MATH_64
+
+#include <string.h>
+
+#include "ed25519_base.h"
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+#define MASK51 0x7ffffffffffffULL
+
+/* d = -121665/121666 */
+static const ed25519_fe fe_d = {{
+        0x34dca135978a3ULL, 0x1a8283b156ebdULL, 0x5e7a26001c029ULL, 0x739c663a03cbbULL, 0x52036cee2b6ffULL
+}};
+
+/* 2 * d */
+static const ed25519_fe fe_d2 = {{
+        0x69b9426b2f159ULL, 0x35050762add7aULL, 0x3cf44c0038052ULL, 0x6738cc7407977ULL, 0x2406d9dc56dffULL
+}};
+
+/* sqrt(-1) */
+static const ed25519_fe fe_sqrtm1 = {{
+        0x61b274a0ea0b0ULL, 0x0d5a5fc8f189dULL, 0x7ef5e9cbd0c60ULL, 0x78595a6804c9eULL, 0x2b8324804fc1dULL
+}};
+
+/* base point, y = 4/5, x positive */
+const ed25519_ge ed25519_ge_base = {
+        {{0x62d608f25d51aULL, 0x412a4b4f6592aULL, 0x75b7171a4b31dULL, 0x1ff60527118feULL, 0x216936d3cd6e5ULL}},
+        {{0x6666666666658ULL, 0x4ccccccccccccULL, 0x1999999999999ULL, 0x3333333333333ULL, 0x6666666666666ULL}},
+        {{1, 0, 0, 0, 0}},
+        {{0x68ab3a5b7dda3ULL, 0x00eea2a5eadbbULL, 0x2af8df483c27eULL, 0x332b375274732ULL, 0x67875f0fd78b7ULL}}
+};
+
+/* odd multiples B, 3B, ... 15B of the base point */
+static const ed25519_ge_precomp ge_base_wnaf[ED25519_WNAF_TABLE] = {
+        {
+                {{0x493c6f58c3b85ULL, 0x0df7181c325f7ULL, 0x0f50b0b3e4cb7ULL, 0x5329385a44c32ULL, 0x07cf9d3a33d4bULL}},
+                {{0x03905d740913eULL, 0x0ba2817d673a2ULL, 0x23e2827f4e67cULL, 0x133d2e0c21a34ULL, 0x44fd2f9298f81ULL}},
+                {{0x11205877aaa68ULL, 0x479955893d579ULL, 0x50d66309b67a0ULL, 0x2d42d0dbee5eeULL, 0x6f117b689f0c6ULL}}
+        },
+        {
+                {{0x5b0a84cee9730ULL, 0x61d10c97155e4ULL, 0x4059cc8096a10ULL, 0x47a608da8014fULL, 0x7a164e1b9a80fULL}},
+                {{0x11fe8a4fcd265ULL, 0x7bcb8374faaccULL, 0x52f5af4ef4d4fULL, 0x5314098f98d10ULL, 0x2ab91587555bdULL}},
+                {{0x6933f0dd0d889ULL, 0x44386bb4c4295ULL, 0x3cb6d3162508cULL, 0x26368b872a2c6ULL, 0x5a2826af12b9bULL}}
+        },
+        {
+                {{0x2bc4408a5bb33ULL, 0x078ebdda05442ULL, 0x2ffb112354123ULL, 0x375ee8df5862dULL, 0x2945ccf146e20ULL}},
+                {{0x182c3a447d6baULL, 0x22964e536eff2ULL, 0x192821f540053ULL, 0x2f9f19e788e5cULL, 0x154a7e73eb1b5ULL}},
+                {{0x3dbf1812a8285ULL, 0x0fa17ba3f9797ULL, 0x6f69cb49c3820ULL, 0x34d5a0db3858dULL, 0x43aabe696b3bbULL}}
+        },
+        {
+                {{0x25cd0944ea3bfULL, 0x75673b81a4d63ULL, 0x150b925d1c0d4ULL, 0x13f38d9294114ULL, 0x461bea69283c9ULL}},
+                {{0x72c9aaa3221b1ULL, 0x267774474f74dULL, 0x064b0e9b28085ULL, 0x3f04ef53b27c9ULL, 0x1d6edd5d2e531ULL}},
+                {{0x36dc801b8b3a2ULL, 0x0e0a7d4935e30ULL, 0x1deb7cecc0d7dULL, 0x053a94e20dd2cULL, 0x7a9fbb1c6a0f9ULL}}
+        },
+        {
+                {{0x6678aa6a8632fULL, 0x5ea3788d8b365ULL, 0x21bd6d6994279ULL, 0x7ace75919e4e3ULL, 0x34b9ed338add7ULL}},
+                {{0x6217e039d8064ULL, 0x6dea408337e6dULL, 0x57ac112628206ULL, 0x647cb65e30473ULL, 0x49c05a51fadc9ULL}},
+                {{0x4e8bf9045af1bULL, 0x514e33a45e0d6ULL, 0x7533c5b8bfe0fULL, 0x583557b7e14c9ULL, 0x73c172021b008ULL}}
+        },
+        {
+                {{0x700848a802adeULL, 0x1e04605c4e5f7ULL, 0x5c0d01b9767fbULL, 0x7d7889f42388bULL, 0x4275aae2546d8ULL}},
+                {{0x75b0249864348ULL, 0x52ee11070262bULL, 0x237ae54fb5acdULL, 0x3bfd1d03aaab5ULL, 0x18ab598029d5cULL}},
+                {{0x32cc5fd6089e9ULL, 0x426505c949b05ULL, 0x46a18880c7ad2ULL, 0x4a4221888ccdaULL, 0x3dc65522b53dfULL}}
+        },
+        {
+                {{0x0c222a2007f6dULL, 0x356b79bdb77eeULL, 0x41ee81efe12ceULL, 0x120a9bd07097dULL, 0x234fd7eec346fULL}},
+                {{0x7013b327fbf93ULL, 0x1336eeded6a0dULL, 0x2b565a2bbf3afULL, 0x253ce89591955ULL, 0x0267882d17602ULL}},
+                {{0x0a119732ea378ULL, 0x63bf1ba8e2a6cULL, 0x69f94cc90df9aULL, 0x431d1779bfc48ULL, 0x497ba6fdaa097ULL}}
+        },
+        {
+                {{0x6cc0313cfeaa0ULL, 0x1a313848da499ULL, 0x7cb534219230aULL, 0x39596dedefd60ULL, 0x61e22917f12deULL}},
+                {{0x3cd86468ccf0bULL, 0x48553221ac081ULL, 0x6c9464b4e0a6eULL, 0x75fba84180403ULL, 0x43b5cd4218d05ULL}},
+                {{0x2762f9bd0b516ULL, 0x1c6e7fbddcbb3ULL, 0x75909c3ace2bdULL, 0x42101972d3ec9ULL, 0x511d61210ae4dULL}}
+        }
+
+};
+
+/* group order l = 2^252 + 27742317777372353535851937790883648493, 64 bit words */
+static const uint64_t sc_l[5] = {
+        0x5812631a5cf5d3edULL, 0x14def9dea2f79cd6ULL, 0, 0x1000000000000000ULL, 0
+};
+
+/* floor(2^512 / l) for the Barrett reduction */
+static const uint64_t sc_mu[5] = {
+        0xed9ce5a30a2c131bULL, 0x2106215d086329a7ULL, 0xffffffffffffffebULL, 0xffffffffffffffffULL, 0xf
+};
+
+static inline uint64_t load64_le(const unsigned char *s) {
+    return (uint64_t) s[0] | (uint64_t) s[1] << 8 | (uint64_t) s[2] << 16 | (uint64_t) s[3] << 24 |
+           (uint64_t) s[4] << 32 | (uint64_t) s[5] << 40 | (uint64_t) s[6] << 48 | (uint64_t) s[7] << 56;
+}
+
+static inline void store64_le(unsigned char *s, uint64_t v) {
+    for (int i = 0; i < 8; i++) s[i] = (unsigned char) (v >> (8 * i));
+}
+
+/*
+ * Field arithmetic. All functions accept inputs with limbs below 2^52
+ * and return limbs below 2^52 (weakly reduced).
+ */
+
+static inline void fe_0(ed25519_fe *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+static inline void fe_1(ed25519_fe *h) {
+    fe_0(h);
+    h->v[0] = 1;
+}
+
+static inline void fe_carry(ed25519_fe *h) {
+    uint64_t c;
+    c = h->v[0] >> 51; h->v[0] &= MASK51; h->v[1] += c;
+    c = h->v[1] >> 51; h->v[1] &= MASK51; h->v[2] += c;
+    c = h->v[2] >> 51; h->v[2] &= MASK51; h->v[3] += c;
+    c = h->v[3] >> 51; h->v[3] &= MASK51; h->v[4] += c;
+    c = h->v[4] >> 51; h->v[4] &= MASK51; h->v[0] += 19 * c;
+}
+
+static inline void fe_add(ed25519_fe *h, const ed25519_fe *f, const ed25519_fe *g) {
+    for (int i = 0; i < 5; i++) h->v[i] = f->v[i] + g->v[i];
+    fe_carry(h);
+}
+
+/* h = f - g, adding 2p to stay positive */
+static inline void fe_sub(ed25519_fe *h, const ed25519_fe *f, const ed25519_fe *g) {
+    h->v[0] = f->v[0] + 0xfffffffffffdaULL - g->v[0];
+    h->v[1] = f->v[1] + 0xffffffffffffeULL - g->v[1];
+    h->v[2] = f->v[2] + 0xffffffffffffeULL - g->v[2];
+    h->v[3] = f->v[3] + 0xffffffffffffeULL - g->v[3];
+    h->v[4] = f->v[4] + 0xffffffffffffeULL - g->v[4];
+    fe_carry(h);
+}
+
+static inline void fe_neg(ed25519_fe *h, const ed25519_fe *f) {
+    ed25519_fe zero;
+    fe_0(&zero);
+    fe_sub(h, &zero, f);
+}
+
+static inline void fe_reduce128(ed25519_fe *h, uint128_t r0, uint128_t r1, uint128_t r2, uint128_t r3,
+                                uint128_t r4) {
+    uint64_t c;
+    r1 += (uint64_t) (r0 >> 51); h->v[0] = (uint64_t) r0 & MASK51;
+    r2 += (uint64_t) (r1 >> 51); h->v[1] = (uint64_t) r1 & MASK51;
+    r3 += (uint64_t) (r2 >> 51); h->v[2] = (uint64_t) r2 & MASK51;
+    r4 += (uint64_t) (r3 >> 51); h->v[3] = (uint64_t) r3 & MASK51;
+    c = (uint64_t) (r4 >> 51); h->v[4] = (uint64_t) r4 & MASK51;
+    h->v[0] += c * 19;
+    c = h->v[0] >> 51; h->v[0] &= MASK51; h->v[1] += c;
+}
+
+static void fe_mul(ed25519_fe *h, const ed25519_fe *f, const ed25519_fe *g) {
+    const uint64_t f0 = f->v[0], f1 = f->v[1], f2 = f->v[2], f3 = f->v[3], f4 = f->v[4];
+    const uint64_t g0 = g->v[0], g1 = g->v[1], g2 = g->v[2], g3 = g->v[3], g4 = g->v[4];
+    const uint64_t g1_19 = 19 * g1, g2_19 = 19 * g2, g3_19 = 19 * g3, g4_19 = 19 * g4;
+
+    uint128_t r0 = (uint128_t) f0 * g0 + (uint128_t) f1 * g4_19 + (uint128_t) f2 * g3_19 +
+                   (uint128_t) f3 * g2_19 + (uint128_t) f4 * g1_19;
+    uint128_t r1 = (uint128_t) f0 * g1 + (uint128_t) f1 * g0 + (uint128_t) f2 * g4_19 +
+                   (uint128_t) f3 * g3_19 + (uint128_t) f4 * g2_19;
+    uint128_t r2 = (uint128_t) f0 * g2 + (uint128_t) f1 * g1 + (uint128_t) f2 * g0 +
+                   (uint128_t) f3 * g4_19 + (uint128_t) f4 * g3_19;
+    uint128_t r3 = (uint128_t) f0 * g3 + (uint128_t) f1 * g2 + (uint128_t) f2 * g1 +
+                   (uint128_t) f3 * g0 + (uint128_t) f4 * g4_19;
+    uint128_t r4 = (uint128_t) f0 * g4 + (uint128_t) f1 * g3 + (uint128_t) f2 * g2 +
+                   (uint128_t) f3 * g1 + (uint128_t) f4 * g0;
+
+    fe_reduce128(h, r0, r1, r2, r3, r4);
+}
+
+static void fe_sq(ed25519_fe *h, const ed25519_fe *f) {
+    const uint64_t f0 = f->v[0], f1 = f->v[1], f2 = f->v[2], f3 = f->v[3], f4 = f->v[4];
+    const uint64_t d0 = 2 * f0, d1 = 2 * f1, d2 = 2 * f2, d3 = 2 * f3;
+    const uint64_t f3_19 = 19 * f3, f4_19 = 19 * f4;
+
+    uint128_t r0 = (uint128_t) f0 * f0 + (uint128_t) d1 * f4_19 + (uint128_t) d2 * f3_19;
+    uint128_t r1 = (uint128_t) d0 * f1 + (uint128_t) d2 * f4_19 + (uint128_t) f3 * f3_19;
+    uint128_t r2 = (uint128_t) d0 * f2 + (uint128_t) f1 * f1 + (uint128_t) d3 * f4_19;
+    uint128_t r3 = (uint128_t) d0 * f3 + (uint128_t) d1 * f2 + (uint128_t) f4 * f4_19;
+    uint128_t r4 = (uint128_t) d0 * f4 + (uint128_t) d1 * f3 + (uint128_t) f2 * f2;
+
+    fe_reduce128(h, r0, r1, r2, r3, r4);
+}
+
+static void fe_sqn(ed25519_fe *h, const ed25519_fe *f, int n) {
+    fe_sq(h, f);
+    while (--n > 0) fe_sq(h, h);
+}
+
+static void fe_frombytes(ed25519_fe *h, const unsigned char s[32]) {
+    const uint64_t w0 = load64_le(s), w1 = load64_le(s + 8), w2 = load64_le(s + 16), w3 = load64_le(s + 24);
+    h->v[0] = w0 & MASK51;
+    h->v[1] = (w0 >> 51 | w1 << 13) & MASK51;
+    h->v[2] = (w1 >> 38 | w2 << 26) & MASK51;
+    h->v[3] = (w2 >> 25 | w3 << 39) & MASK51;
+    h->v[4] = (w3 >> 12) & MASK51;
+}
+
+static void fe_tobytes(unsigned char s[32], const ed25519_fe *f) {
+    ed25519_fe t = *f;
+    uint64_t q;
+
+    fe_carry(&t);
+
+    // q = 1 if t >= p, computed by propagating the carry of t + 19
+    q = (t.v[0] + 19) >> 51;
+    q = (t.v[1] + q) >> 51;
+    q = (t.v[2] + q) >> 51;
+    q = (t.v[3] + q) >> 51;
+    q = (t.v[4] + q) >> 51;
+
+    t.v[0] += 19 * q;
+    t.v[1] += t.v[0] >> 51; t.v[0] &= MASK51;
+    t.v[2] += t.v[1] >> 51; t.v[1] &= MASK51;
+    t.v[3] += t.v[2] >> 51; t.v[2] &= MASK51;
+    t.v[4] += t.v[3] >> 51; t.v[3] &= MASK51;
+    t.v[4] &= MASK51;
+
+    store64_le(s, t.v[0] | t.v[1] << 51);
+    store64_le(s + 8, t.v[1] >> 13 | t.v[2] << 38);
+    store64_le(s + 16, t.v[2] >> 26 | t.v[3] << 25);
+    store64_le(s + 24, t.v[3] >> 39 | t.v[4] << 12);
+}
+
+static int fe_isnegative(const ed25519_fe *f) {
+    unsigned char s[32];
+    fe_tobytes(s, f);
+    return s[0] & 1;
+}
+
+static int fe_iszero(const ed25519_fe *f) {
+    unsigned char s[32];
+    unsigned char r = 0;
+    fe_tobytes(s, f);
+    for (int i = 0; i < 32; i++) r |= s[i];
+    return r == 0;
+}
+
+/* f = g if b == 1, f unchanged if b == 0, in constant time */
+static inline void fe_cmov(ed25519_fe *f, const ed25519_fe *g, uint64_t b) {
+    const uint64_t mask = (uint64_t) 0 - b;
+    for (int i = 0; i < 5; i++) f->v[i] ^= mask & (f->v[i] ^ g->v[i]);
+}
+
+/* z2_250_0 = z^(2^250 - 1), z11 = z^11 */
+static void fe_pow2_250_1(ed25519_fe *z2_250_0, ed25519_fe *z11, const ed25519_fe *z) {
+    ed25519_fe t, z9, z2_5_0, z2_10_0, z2_20_0, z2_50_0, z2_100_0;
+
+    fe_sq(&t, z);                               // 2
+    fe_sqn(&z9, &t, 2);                         // 8
+    fe_mul(&z9, &z9, z);                        // 9
+    fe_mul(z11, &z9, &t);                       // 11
+    fe_sq(&t, z11);                             // 22
+    fe_mul(&z2_5_0, &t, &z9);                   // 2^5 - 1
+    fe_sqn(&t, &z2_5_0, 5);
+    fe_mul(&z2_10_0, &t, &z2_5_0);              // 2^10 - 1
+    fe_sqn(&t, &z2_10_0, 10);
+    fe_mul(&z2_20_0, &t, &z2_10_0);             // 2^20 - 1
+    fe_sqn(&t, &z2_20_0, 20);
+    fe_mul(&t, &t, &z2_20_0);                   // 2^40 - 1
+    fe_sqn(&t, &t, 10);
+    fe_mul(&z2_50_0, &t, &z2_10_0);             // 2^50 - 1
+    fe_sqn(&t, &z2_50_0, 50);
+    fe_mul(&z2_100_0, &t, &z2_50_0);            // 2^100 - 1
+    fe_sqn(&t, &z2_100_0, 100);
+    fe_mul(&t, &t, &z2_100_0);                  // 2^200 - 1
+    fe_sqn(&t, &t, 50);
+    fe_mul(z2_250_0, &t, &z2_50_0);             // 2^250 - 1
+}
+
+/* h = z^(p-2) = 1/z */
+static void fe_invert(ed25519_fe *h, const ed25519_fe *z) {
+    ed25519_fe t, z11;
+    fe_pow2_250_1(&t, &z11, z);
+    fe_sqn(&t, &t, 5);
+    fe_mul(h, &t, &z11);                        // 2^255 - 21
+}
+
+/* h = z^((p-5)/8) */
+static void fe_pow22523(ed25519_fe *h, const ed25519_fe *z) {
+    ed25519_fe t, z11;
+    fe_pow2_250_1(&t, &z11, z);
+    fe_sqn(&t, &t, 2);
+    fe_mul(h, &t, z);                           // 2^252 - 3
+}
+
+/*
+ * Group arithmetic.
+ */
+
+/* completed point ((X:Z), (Y:T)) */
+typedef struct ge_p1p1 {
+    ed25519_fe X, Y, Z, T;
+} ge_p1p1;
+
+/* projective point (X:Y:Z) */
+typedef struct ge_p2 {
+    ed25519_fe X, Y, Z;
+} ge_p2;
+
+static inline void ge_p1p1_to_p2(ge_p2 *r, const ge_p1p1 *p) {
+    fe_mul(&r->X, &p->X, &p->T);
+    fe_mul(&r->Y, &p->Y, &p->Z);
+    fe_mul(&r->Z, &p->Z, &p->T);
+}
+
+static inline void ge_p1p1_to_p3(ed25519_ge *r, const ge_p1p1 *p) {
+    fe_mul(&r->X, &p->X, &p->T);
+    fe_mul(&r->Y, &p->Y, &p->Z);
+    fe_mul(&r->Z, &p->Z, &p->T);
+    fe_mul(&r->T, &p->X, &p->Y);
+}
+
+static void ge_p2_dbl(ge_p1p1 *r, const ge_p2 *p) {
+    ed25519_fe t0;
+
+    fe_sq(&r->X, &p->X);
+    fe_sq(&r->Z, &p->Y);
+    fe_sq(&r->T, &p->Z);
+    fe_add(&r->T, &r->T, &r->T);
+    fe_add(&r->Y, &p->X, &p->Y);
+    fe_sq(&t0, &r->Y);
+    fe_add(&r->Y, &r->Z, &r->X);
+    fe_sub(&r->Z, &r->Z, &r->X);
+    fe_sub(&r->X, &t0, &r->Y);
+    fe_sub(&r->T, &r->T, &r->Z);
+}
+
+static void ge_p1p1_add(ge_p1p1 *r, const ed25519_ge *p, const ed25519_ge_cached *q) {
+    ed25519_fe t0;
+
+    fe_add(&r->X, &p->Y, &p->X);
+    fe_sub(&r->Y, &p->Y, &p->X);
+    fe_mul(&r->Z, &r->X, &q->YplusX);
+    fe_mul(&r->Y, &r->Y, &q->YminusX);
+    fe_mul(&r->T, &q->T2d, &p->T);
+    fe_mul(&r->X, &p->Z, &q->Z);
+    fe_add(&t0, &r->X, &r->X);
+    fe_sub(&r->X, &r->Z, &r->Y);
+    fe_add(&r->Y, &r->Z, &r->Y);
+    fe_add(&r->Z, &t0, &r->T);
+    fe_sub(&r->T, &t0, &r->T);
+}
+
+static void ge_p1p1_sub(ge_p1p1 *r, const ed25519_ge *p, const ed25519_ge_cached *q) {
+    ed25519_fe t0;
+
+    fe_add(&r->X, &p->Y, &p->X);
+    fe_sub(&r->Y, &p->Y, &p->X);
+    fe_mul(&r->Z, &r->X, &q->YminusX);
+    fe_mul(&r->Y, &r->Y, &q->YplusX);
+    fe_mul(&r->T, &q->T2d, &p->T);
+    fe_mul(&r->X, &p->Z, &q->Z);
+    fe_add(&t0, &r->X, &r->X);
+    fe_sub(&r->X, &r->Z, &r->Y);
+    fe_add(&r->Y, &r->Z, &r->Y);
+    fe_sub(&r->Z, &t0, &r->T);
+    fe_add(&r->T, &t0, &r->T);
+}
+
+static void ge_p1p1_madd(ge_p1p1 *r, const ed25519_ge *p, const ed25519_ge_precomp *q) {
+    ed25519_fe t0;
+
+    fe_add(&r->X, &p->Y, &p->X);
+    fe_sub(&r->Y, &p->Y, &p->X);
+    fe_mul(&r->Z, &r->X, &q->yplusx);
+    fe_mul(&r->Y, &r->Y, &q->yminusx);
+    fe_mul(&r->T, &q->xy2d, &p->T);
+    fe_add(&t0, &p->Z, &p->Z);
+    fe_sub(&r->X, &r->Z, &r->Y);
+    fe_add(&r->Y, &r->Z, &r->Y);
+    fe_add(&r->Z, &t0, &r->T);
+    fe_sub(&r->T, &t0, &r->T);
+}
+
+static void ge_p1p1_msub(ge_p1p1 *r, const ed25519_ge *p, const ed25519_ge_precomp *q) {
+    ed25519_fe t0;
+
+    fe_add(&r->X, &p->Y, &p->X);
+    fe_sub(&r->Y, &p->Y, &p->X);
+    fe_mul(&r->Z, &r->X, &q->yminusx);
+    fe_mul(&r->Y, &r->Y, &q->yplusx);
+    fe_mul(&r->T, &q->xy2d, &p->T);
+    fe_add(&t0, &p->Z, &p->Z);
+    fe_sub(&r->X, &r->Z, &r->Y);
+    fe_add(&r->Y, &r->Z, &r->Y);
+    fe_sub(&r->Z, &t0, &r->T);
+    fe_add(&r->T, &t0, &r->T);
+}
+
+int ed25519_ge_frombytes_vartime(ed25519_ge *r, const unsigned char s[32]) {
+    ed25519_fe u, v, v3, vxx, check;
+
+    fe_frombytes(&r->Y, s);
+    fe_1(&r->Z);
+    fe_sq(&u, &r->Y);
+    fe_mul(&v, &u, &fe_d);
+    fe_sub(&u, &u, &r->Z);                      // u = y^2 - 1
+    fe_add(&v, &v, &r->Z);                      // v = d y^2 + 1
+
+    fe_sq(&v3, &v);
+    fe_mul(&v3, &v3, &v);                       // v3 = v^3
+    fe_sq(&r->X, &v3);
+    fe_mul(&r->X, &r->X, &v);
+    fe_mul(&r->X, &r->X, &u);                   // x = u v^7
+
+    fe_pow22523(&r->X, &r->X);                  // x = (u v^7)^((p-5)/8)
+    fe_mul(&r->X, &r->X, &v3);
+    fe_mul(&r->X, &r->X, &u);                   // x = u v^3 (u v^7)^((p-5)/8)
+
+    fe_sq(&vxx, &r->X);
+    fe_mul(&vxx, &vxx, &v);
+    fe_sub(&check, &vxx, &u);                   // v x^2 - u
+    if (!fe_iszero(&check)) {
+        fe_add(&check, &vxx, &u);               // v x^2 + u
+        if (!fe_iszero(&check)) return -1;
+        fe_mul(&r->X, &r->X, &fe_sqrtm1);
+    }
+
+    const int sign = s[31] >> 7;
+    if (sign && fe_iszero(&r->X)) return -1;
+    if (fe_isnegative(&r->X) != sign) fe_neg(&r->X, &r->X);
+
+    fe_mul(&r->T, &r->X, &r->Y);
+    return 0;
+}
+
+void ed25519_ge_tobytes(unsigned char s[32], const ed25519_ge *p) {
+    ed25519_fe recip, x, y;
+
+    fe_invert(&recip, &p->Z);
+    fe_mul(&x, &p->X, &recip);
+    fe_mul(&y, &p->Y, &recip);
+    fe_tobytes(s, &y);
+    s[31] ^= fe_isnegative(&x) << 7;
+}
+
+void ed25519_ge_zero(ed25519_ge *r) {
+    fe_0(&r->X);
+    fe_1(&r->Y);
+    fe_1(&r->Z);
+    fe_0(&r->T);
+}
+
+void ed25519_ge_neg(ed25519_ge *r, const ed25519_ge *p) {
+    fe_neg(&r->X, &p->X);
+    r->Y = p->Y;
+    r->Z = p->Z;
+    fe_neg(&r->T, &p->T);
+}
+
+void ed25519_ge_dbl(ed25519_ge *r, const ed25519_ge *p) {
+    ge_p1p1 t;
+    ge_p2 q = {p->X, p->Y, p->Z};
+    ge_p2_dbl(&t, &q);
+    ge_p1p1_to_p3(r, &t);
+}
+
+void ed25519_ge_add(ed25519_ge *r, const ed25519_ge *p, const ed25519_ge_cached *q) {
+    ge_p1p1 t;
+    ge_p1p1_add(&t, p, q);
+    ge_p1p1_to_p3(r, &t);
+}
+
+void ed25519_ge_sub(ed25519_ge *r, const ed25519_ge *p, const ed25519_ge_cached *q) {
+    ge_p1p1 t;
+    ge_p1p1_sub(&t, p, q);
+    ge_p1p1_to_p3(r, &t);
+}
+
+void ed25519_ge_to_cached(ed25519_ge_cached *r, const ed25519_ge *p) {
+    fe_add(&r->YplusX, &p->Y, &p->X);
+    fe_sub(&r->YminusX, &p->Y, &p->X);
+    r->Z = p->Z;
+    fe_mul(&r->T2d, &p->T, &fe_d2);
+}
+
+int ed25519_ge_is_zero(const ed25519_ge *p) {
+    ed25519_fe t;
+    fe_sub(&t, &p->Y, &p->Z);
+    return fe_iszero(&p->X) && fe_iszero(&t);
+}
+
+void ed25519_ge_wnaf_table(ed25519_ge_cached table[ED25519_WNAF_TABLE], const ed25519_ge *p) {
+    ed25519_ge p2, t;
+
+    ed25519_ge_to_cached(&table[0], p);
+    ed25519_ge_dbl(&p2, p);
+    for (int i = 1; i < ED25519_WNAF_TABLE; i++) {
+        ed25519_ge_add(&t, &p2, &table[i - 1]);
+        ed25519_ge_to_cached(&table[i], &t);
+    }
+}
+
+void ed25519_sc_wnaf(signed char r[ED25519_WNAF_SIZE], const unsigned char a[32]) {
+    int i, b, k;
+
+    for (i = 0; i < ED25519_WNAF_SIZE; ++i) r[i] = (signed char) (1 & (a[i >> 3] >> (i & 7)));
+
+    for (i = 0; i < ED25519_WNAF_SIZE; ++i) {
+        if (!r[i]) continue;
+        for (b = 1; b <= 6 && i + b < ED25519_WNAF_SIZE; ++b) {
+            if (!r[b + i]) continue;
+            if (r[i] + (r[b + i] << b) <= 15) {
+                r[i] = (signed char) (r[i] + (r[b + i] << b));
+                r[b + i] = 0;
+            } else if (r[i] - (r[b + i] << b) >= -15) {
+                r[i] = (signed char) (r[i] - (r[b + i] << b));
+                for (k = i + b; k < ED25519_WNAF_SIZE; ++k) {
+                    if (!r[k]) {
+                        r[k] = 1;
+                        break;
+                    }
+                    r[k] = 0;
+                }
+            } else {
+                break;
+            }
+        }
+    }
+}
+
+void ed25519_ge_multi_scalarmult_vartime(ed25519_ge *r, ed25519_ge_cached (*tables)[ED25519_WNAF_TABLE],
+                                         signed char (*wnaf)[ED25519_WNAF_SIZE], size_t n) {
+    ge_p1p1 t;
+    ge_p2 q;
+    int i;
+
+    // skip the leading zero digits of all scalars
+    for (i = ED25519_WNAF_SIZE - 1; i >= 0; --i) {
+        size_t j;
+        for (j = 0; j < n && !wnaf[j][i]; j++);
+        if (j < n) break;
+    }
+
+    ed25519_ge_zero(r);
+    if (i < 0) return;
+
+    fe_0(&q.X);
+    fe_1(&q.Y);
+    fe_1(&q.Z);
+    for (; i >= 0; --i) {
+        ge_p2_dbl(&t, &q);
+        for (size_t j = 0; j < n; j++) {
+            const signed char d = wnaf[j][i];
+            if (d > 0) {
+                ge_p1p1_to_p3(r, &t);
+                ge_p1p1_add(&t, r, &tables[j][d / 2]);
+            } else if (d < 0) {
+                ge_p1p1_to_p3(r, &t);
+                ge_p1p1_sub(&t, r, &tables[j][(-d) / 2]);
+            }
+        }
+        ge_p1p1_to_p2(&q, &t);
+    }
+    ge_p1p1_to_p3(r, &t);
+}
+
+void ed25519_ge_double_scalarmult_vartime(ed25519_ge *r, const unsigned char a[32],
+                                          const ed25519_ge_cached table[ED25519_WNAF_TABLE],
+                                          const unsigned char b[32]) {
+    signed char aslide[ED25519_WNAF_SIZE], bslide[ED25519_WNAF_SIZE];
+    ge_p1p1 t;
+    ge_p2 q;
+    int i;
+
+    ed25519_sc_wnaf(aslide, a);
+    ed25519_sc_wnaf(bslide, b);
+
+    for (i = ED25519_WNAF_SIZE - 1; i >= 0 && !aslide[i] && !bslide[i]; --i);
+
+    ed25519_ge_zero(r);
+    if (i < 0) return;
+
+    fe_0(&q.X);
+    fe_1(&q.Y);
+    fe_1(&q.Z);
+    for (; i >= 0; --i) {
+        ge_p2_dbl(&t, &q);
+        if (aslide[i] > 0) {
+            ge_p1p1_to_p3(r, &t);
+            ge_p1p1_add(&t, r, &table[aslide[i] / 2]);
+        } else if (aslide[i] < 0) {
+            ge_p1p1_to_p3(r, &t);
+            ge_p1p1_sub(&t, r, &table[(-aslide[i]) / 2]);
+        }
+        if (bslide[i] > 0) {
+            ge_p1p1_to_p3(r, &t);
+            ge_p1p1_madd(&t, r, &ge_base_wnaf[bslide[i] / 2]);
+        } else if (bslide[i] < 0) {
+            ge_p1p1_to_p3(r, &t);
+            ge_p1p1_msub(&t, r, &ge_base_wnaf[(-bslide[i]) / 2]);
+        }
+        ge_p1p1_to_p2(&q, &t);
+    }
+    ge_p1p1_to_p3(r, &t);
+}
+
+/* 1 if b == c, 0 otherwise, in constant time */
+static inline uint64_t ct_equal(signed char b, signed char c) {
+    const uint64_t x = (unsigned char) (b ^ c);
+    return (x - 1) >> 63;
+}
+
+/* t = b * 256^pos * B for b in [-8, 8], in constant time */
+static void ge_base_select(ed25519_ge_precomp *t, int pos, signed char b) {
+    const uint64_t negative = (uint64_t) ((int64_t) b >> 63) & 1;
+    const signed char babs = (signed char) (b - (((-negative) & (uint64_t) b) << 1));
+    ed25519_ge_precomp minust;
+
+    fe_1(&t->yplusx);
+    fe_1(&t->yminusx);
+    fe_0(&t->xy2d);
+    for (int i = 0; i < 8; i++) {
+        const uint64_t eq = ct_equal(babs, (signed char) (i + 1));
+        fe_cmov(&t->yplusx, &ge_base_comb[pos][i].yplusx, eq);
+        fe_cmov(&t->yminusx, &ge_base_comb[pos][i].yminusx, eq);
+        fe_cmov(&t->xy2d, &ge_base_comb[pos][i].xy2d, eq);
+    }
+
+    minust.yplusx = t->yminusx;
+    minust.yminusx = t->yplusx;
+    fe_neg(&minust.xy2d, &t->xy2d);
+    fe_cmov(&t->yplusx, &minust.yplusx, negative);
+    fe_cmov(&t->yminusx, &minust.yminusx, negative);
+    fe_cmov(&t->xy2d, &minust.xy2d, negative);
+}
+
+/*
+ * a = sum(e[i] * 16^i) with signed radix 16 digits e[i], so that
+ * a * B = sum(e[2i] * 256^i * B) + 16 * sum(e[2i+1] * 256^i * B).
+ * Both sums are taken from the comb table, which leaves 64 additions
+ * and only 4 doublings.
+ */
+void ed25519_ge_scalarmult_base(ed25519_ge *r, const unsigned char a[32]) {
+    signed char e[64];
+    signed char carry = 0;
+    ed25519_ge_precomp t;
+    ge_p1p1 s;
+    ge_p2 q;
+
+    // signed radix 16 digits in [-8, 8]
+    for (int i = 0; i < 32; i++) {
+        e[2 * i] = (signed char) (a[i] & 15);
+        e[2 * i + 1] = (signed char) ((a[i] >> 4) & 15);
+    }
+    for (int i = 0; i < 63; i++) {
+        e[i] = (signed char) (e[i] + carry);
+        carry = (signed char) ((e[i] + 8) >> 4);
+        e[i] = (signed char) (e[i] - (carry << 4));
+    }
+    e[63] = (signed char) (e[63] + carry);
+
+    ed25519_ge_zero(r);
+    for (int i = 1; i < 64; i += 2) {
+        ge_base_select(&t, i / 2, e[i]);
+        ge_p1p1_madd(&s, r, &t);
+        ge_p1p1_to_p3(r, &s);
+    }
+
+    q.X = r->X;
+    q.Y = r->Y;
+    q.Z = r->Z;
+    ge_p2_dbl(&s, &q);
+    ge_p1p1_to_p2(&q, &s);
+    ge_p2_dbl(&s, &q);
+    ge_p1p1_to_p2(&q, &s);
+    ge_p2_dbl(&s, &q);
+    ge_p1p1_to_p2(&q, &s);
+    ge_p2_dbl(&s, &q);
+    ge_p1p1_to_p3(r, &s);
+
+    for (int i = 0; i < 64; i += 2) {
+        ge_base_select(&t, i / 2, e[i]);
+        ge_p1p1_madd(&s, r, &t);
+        ge_p1p1_to_p3(r, &s);
+    }
+}
+
+/*
+ * Scalar arithmetic mod l, using 64 bit words and Barrett reduction.
+ */
+
+/* r[0 .. an+bn-1] = a * b */
+static void sc_mp_mul(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn) {
+    memset(r, 0, (an + bn) * sizeof(uint64_t));
+    for (size_t i = 0; i < an; i++) {
+        uint64_t c = 0;
+        for (size_t j = 0; j < bn; j++) {
+            uint128_t t = (uint128_t) a[i] * b[j] + r[i + j] + c;
+            r[i + j] = (uint64_t) t;
+            c = (uint64_t) (t >> 64);
+        }
+        r[i + bn] = c;
+    }
+}
+
+/* r >= l for a 5 word r */
+static int sc_geq_l(const uint64_t r[5]) {
+    for (int i = 4; i >= 0; i--) {
+        if (r[i] != sc_l[i]) return r[i] > sc_l[i];
+    }
+    return 1;
+}
+
+/* s = x mod l for a 512 bit x (HAC 14.42, b = 2^64, k = 4) */
+static void sc_barrett(unsigned char s[32], const uint64_t x[8]) {
+    uint64_t q2[10], r2[9], r[5];
+    uint64_t borrow = 0;
+
+    // q3 = ((x >> 192) * mu) >> 320
+    sc_mp_mul(q2, x + 3, 5, sc_mu, 5);
+
+    // r = (x - q3 * l) mod 2^320
+    sc_mp_mul(r2, q2 + 5, 5, sc_l, 4);
+    for (int i = 0; i < 5; i++) {
+        uint128_t t = (uint128_t) x[i] - r2[i] - borrow;
+        r[i] = (uint64_t) t;
+        borrow = (uint64_t) (t >> 64) & 1;
+    }
+
+    // r < 3l, at most two subtractions are needed, done in constant time
+    for (int k = 0; k < 2; k++) {
+        uint64_t t[5], mask;
+        borrow = 0;
+        for (int i = 0; i < 5; i++) {
+            uint128_t d = (uint128_t) r[i] - sc_l[i] - borrow;
+            t[i] = (uint64_t) d;
+            borrow = (uint64_t) (d >> 64) & 1;
+        }
+        mask = borrow - 1;      // all ones if r >= l
+        for (int i = 0; i < 5; i++) r[i] = (t[i] & mask) | (r[i] & ~mask);
+    }
+
+    for (int i = 0; i < 4; i++) store64_le(s + 8 * i, r[i]);
+}
+
+void ed25519_sc_reduce(unsigned char r[32], const unsigned char s[64]) {
+    uint64_t x[8];
+    for (int i = 0; i < 8; i++) x[i] = load64_le(s + 8 * i);
+    sc_barrett(r, x);
+}
+
+void ed25519_sc_muladd(unsigned char r[32], const unsigned char a[32], const unsigned char b[32],
+                       const unsigned char c[32]) {
+    uint64_t aw[4], bw[4], x[8];
+    uint64_t carry = 0;
+
+    for (int i = 0; i < 4; i++) {
+        aw[i] = load64_le(a + 8 * i);
+        bw[i] = load64_le(b + 8 * i);
+    }
+    sc_mp_mul(x, aw, 4, bw, 4);
+    for (int i = 0; i < 8; i++) {
+        uint128_t t = (uint128_t) x[i] + (i < 4 ? load64_le(c + 8 * i) : 0) + carry;
+        x[i] = (uint64_t) t;
+        carry = (uint64_t) (t >> 64);
+    }
+    sc_barrett(r, x);
+}
+
+int ed25519_sc_is_canonical(const unsigned char s[32]) {
+    uint64_t w[5] = {load64_le(s), load64_le(s + 8), load64_le(s + 16), load64_le(s + 24), 0};
+    return !sc_geq_l(w);
+}
+
+#endif // ED25519_MATH_64
@@ -0,0 +1,201 @@
+/*!
+ * @file
+ * @brief curve25519 field, group and scalar arithmetic for 64 bit hosts
+ *
+ * Field elements use five 51 bit limbs (radix 2^51) and 64x64->128 bit
+ * multiplications, points use extended twisted Edwards coordinates.
+ * This is only available if the compiler supports 128 bit integers
+ * (ED25519_MATH_64 is defined then), MCU builds use nacl-cm0 only.
+ *
+ * All functions named *_vartime leak their inputs through timing and
+ * must only be used with public data (verification). Scalar arithmetic
+ * and the fixed base multiplication run in constant time.
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef UBIRCH_ED25519_MATH_H
+#define UBIRCH_ED25519_MATH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SIZEOF_INT128__)
+#define ED25519_MATH_64     //!< 64 bit arithmetic is available
+#endif
+
+#ifdef ED25519_MATH_64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ED25519_WNAF_SIZE 256   //!< number of signed digits of a scalar in wNAF form
+#define ED25519_WNAF_TABLE 8    //!< odd multiples (P, 3P, ... 15P) per wNAF table
+
+/**
+ * Field element mod 2^255-19, value = v[0] + v[1] 2^51 + ... + v[4] 2^204.
+ */
+typedef struct ed25519_fe {
+    uint64_t v[5];
+} ed25519_fe;
+
+/**
+ * Point in extended coordinates: x = X/Z, y = Y/Z, x*y = T/Z.
+ */
+typedef struct ed25519_ge {
+    ed25519_fe X, Y, Z, T;
+} ed25519_ge;
+
+/**
+ * Point prepared for additions: (Y+X, Y-X, Z, 2dT).
+ */
+typedef struct ed25519_ge_cached {
+    ed25519_fe YplusX, YminusX, Z, T2d;
+} ed25519_ge_cached;
+
+/**
+ * Affine point prepared for additions: (y+x, y-x, 2dxy).
+ */
+typedef struct ed25519_ge_precomp {
+    ed25519_fe yplusx, yminusx, xy2d;
+} ed25519_ge_precomp;
+
+/**
+ * Decode a compressed point (RFC 8032, 5.1.3).
+ * @param r the decoded point
+ * @param s the 32 byte encoding
+ * @return 0 on success
+ * @return -1 if s is not the encoding of a curve point
+ */
+int ed25519_ge_frombytes_vartime(ed25519_ge *r, const unsigned char s[32]);
+
+/**
+ * Encode a point.
+ * @param s the 32 byte encoding
+ * @param p the point
+ */
+void ed25519_ge_tobytes(unsigned char s[32], const ed25519_ge *p);
+
+/**
+ * Set r = identity point.
+ */
+void ed25519_ge_zero(ed25519_ge *r);
+
+/**
+ * Set r = -p.
+ */
+void ed25519_ge_neg(ed25519_ge *r, const ed25519_ge *p);
+
+/**
+ * Set r = 2p.
+ */
+void ed25519_ge_dbl(ed25519_ge *r, const ed25519_ge *p);
+
+/**
+ * Set r = p + q.
+ */
+void ed25519_ge_add(ed25519_ge *r, const ed25519_ge *p, const ed25519_ge_cached *q);
+
+/**
+ * Set r = p - q.
+ */
+void ed25519_ge_sub(ed25519_ge *r, const ed25519_ge *p, const ed25519_ge_cached *q);
+
+/**
+ * Prepare a point for additions.
+ */
+void ed25519_ge_to_cached(ed25519_ge_cached *r, const ed25519_ge *p);
+
+/**
+ * Check if a point is the identity.
+ * @return 1 if p is the identity, 0 otherwise
+ */
+int ed25519_ge_is_zero(const ed25519_ge *p);
+
+/**
+ * Fill a wNAF table with the odd multiples P, 3P, ... 15P of p.
+ */
+void ed25519_ge_wnaf_table(ed25519_ge_cached table[ED25519_WNAF_TABLE], const ed25519_ge *p);
+
+/**
+ * Recode a 256 bit little endian scalar into signed odd digits in [-15, 15],
+ * with at least four zeros between non-zero digits.
+ */
+void ed25519_sc_wnaf(signed char r[ED25519_WNAF_SIZE], const unsigned char a[32]);
+
+/**
+ * Multi-scalar multiplication r = sum(wnaf[i] * P[i]) with shared doublings
+ * (Straus' method).
+ * @param r the result
+ * @param tables the wNAF tables of the points, see #ed25519_ge_wnaf_table
+ * @param wnaf the scalars in wNAF form, see #ed25519_sc_wnaf
+ * @param n the number of points
+ */
+void ed25519_ge_multi_scalarmult_vartime(ed25519_ge *r, ed25519_ge_cached (*tables)[ED25519_WNAF_TABLE],
+                                         signed char (*wnaf)[ED25519_WNAF_SIZE], size_t n);
+
+/**
+ * Set r = a * A + b * B, with B the base point (signature verification).
+ * @param r the result
+ * @param a the scalar for A
+ * @param table the wNAF table of A, see #ed25519_ge_wnaf_table
+ * @param b the scalar for the base point
+ */
+void ed25519_ge_double_scalarmult_vartime(ed25519_ge *r, const unsigned char a[32],
+                                          const ed25519_ge_cached table[ED25519_WNAF_TABLE],
+                                          const unsigned char b[32]);
+
+/**
+ * Set r = a * B, with B the base point, in constant time (signing).
+ * @param r the result
+ * @param a the scalar, a[31] must be at most 127
+ */
+void ed25519_ge_scalarmult_base(ed25519_ge *r, const unsigned char a[32]);
+
+/**
+ * The base point.
+ */
+extern const ed25519_ge ed25519_ge_base;
+
+/**
+ * Reduce a 512 bit little endian number mod the group order l.
+ * @param r the reduced 32 byte scalar
+ * @param s the 64 byte number (i.e. a sha512 hash)
+ */
+void ed25519_sc_reduce(unsigned char r[32], const unsigned char s[64]);
+
+/**
+ * Set r = (a * b + c) mod l.
+ */
+void ed25519_sc_muladd(unsigned char r[32], const unsigned char a[32], const unsigned char b[32],
+                       const unsigned char c[32]);
+
+/**
+ * Check that a scalar is fully reduced mod l (RFC 8032 requires this for the
+ * signature scalar S).
+ * @return 1 if s < l, 0 otherwise
+ */
+int ed25519_sc_is_canonical(const unsigned char s[32]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ED25519_MATH_64
+
+#endif // UBIRCH_ED25519_MATH_H
@@ -28,6 +28,21 @@
 #include <string.h>
 #include <armnacl.h>
 #include <string.h>
+#include "ed25519/ed25519_batch.h"
+#include "ed25519/ed25519_keys.h"
+
+/*
+ * The signature backend is chosen at build time. 64 bit hosts use the radix 2^51
+ * arithmetic with precomputed base point tables in ed25519/, MCUs use nacl-cm0.
+ * Define UBIRCH_ED25519_NACL to use nacl-cm0 on 64 bit hosts as well.
+ * Signatures are identical, the host backend additionally rejects signatures
+ * with a non-reduced S (RFC 8032) and has no 64k message length limit. It checks
+ * the cofactored equation, alone and in batches; nacl-cm0 checks each signature
+ * with the cofactorless one.
+ */
+#if defined(ED25519_MATH_64) && !defined(UBIRCH_ED25519_NACL)
+#define UBIRCH_ED25519_HOST     //!< ed25519_sign_key()/ed25519_verify_key() use the host backend
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -36,6 +51,46 @@ extern "C" {
 extern unsigned char ed25519_secret_key[crypto_sign_SECRETKEYBYTES];    //!< reference to the secret key for signing
 extern unsigned char ed25519_public_key[crypto_sign_PUBLICKEYBYTES];    //!< reference to the public key for signing
 
+#define ED25519_STACK_DATA_SIZE 64  //!< data up to this size (i.e. a sha512 hash) is handled without heap allocation
+
+/**
+ * A secret key prepared for repeated signing, see #ed25519_secret_key_cache_init.
+ * On 64 bit hosts it holds the expanded secret scalar and nonce prefix,
+ * otherwise just the secret key.
+ */
+typedef struct ed25519_secret_key_cache {
+#ifdef ED25519_MATH_64
+    ed25519_expanded_secret_key expanded;                       //!< the expanded secret key
+#else
+    unsigned char secret_key[crypto_sign_SECRETKEYBYTES];       //!< the secret key
+#endif
+} ed25519_secret_key_cache;
+
+extern ed25519_secret_key_cache ed25519_secret_key_cached;      //!< reference to the prepared key for signing
+
+/**
+ * A public key prepared for repeated verification, see #ed25519_public_key_cache_init.
+ * On 64 bit hosts it holds the decompressed point and its precomputed table,
+ * otherwise just the public key.
+ */
+typedef struct ed25519_public_key_cache {
+#ifdef ED25519_MATH_64
+    ed25519_expanded_public_key expanded;                       //!< the decoded key and its table
+#else
+    unsigned char public_key[crypto_sign_PUBLICKEYBYTES];       //!< the public key
+#endif
+} ed25519_public_key_cache;
+
+/**
+ * The size of the scratch space needed to sign data of the given length.
+ */
+#define ED25519_SIGN_SCRATCH_SIZE(len) (crypto_sign_BYTES + (len))
+
+/**
+ * The size of the scratch space needed to verify (or sign) data of the given length.
+ */
+#define ED25519_SCRATCH_SIZE(len) (2 * ED25519_SIGN_SCRATCH_SIZE(len))
+
 /**
  * Function to sign a payload and return the signature.
  * @param data the buffer with the data to sign
@@ -80,19 +135,231 @@ static int ed25519_verify(const unsigned char *data, size_t len, const unsigned
 static int ed25519_verify_key(const unsigned char *data, size_t len, const unsigned char signature[crypto_sign_BYTES],
                        const unsigned char public_key[crypto_sign_PUBLICKEYBYTES]);
 
+/**
+ * Function to sign a payload with the secret key given as key handle.
+ * Matches #ubirch_protocol_sign_ctx, use it with #ubirch_protocol_set_signer.
+ * @param key pointer to the secret key (crypto_sign_SECRETKEYBYTES)
+ * @param data the buffer with the data to sign
+ * @param len the length of the data buffer
+ * @param signature the buffer to hold the returned signature
+ * @return 0 on success
+ * @return -1 if the signing failed
+ */
+static int ed25519_sign_ctx(void *key, const unsigned char *data, size_t len, unsigned char signature[crypto_sign_BYTES]);
+
+/**
+ * Function to verify a data buffer with the public key given as key handle.
+ * Matches #ubirch_protocol_check_ctx, use it with #ubirch_protocol_verify_ctx.
+ * @param key pointer to the public key (crypto_sign_PUBLICKEYBYTES)
+ * @param data the buffer with the data to verify
+ * @param len the length of the data buffer
+ * @param signature a buffer with the corresponding signature
+ * @return 0 on success
+ * @return -1 if the verification failed
+ */
+static int ed25519_verify_ctx(void *key, const unsigned char *data, size_t len,
+                              const unsigned char signature[crypto_sign_BYTES]);
+
+/**
+ * Prepare a secret key for repeated signing. This derives the secret scalar and
+ * the nonce prefix once, instead of hashing the secret key on every signature.
+ * @param key the key cache to initialize
+ * @param secret_key the secret key
+ */
+static void ed25519_secret_key_cache_init(ed25519_secret_key_cache *key,
+                                          const unsigned char secret_key[crypto_sign_SECRETKEYBYTES]);
+
+/**
+ * Function to sign a payload with the prepared global key #ed25519_secret_key_cached.
+ * Matches #ubirch_protocol_sign, initialize the key with #ed25519_secret_key_cache_init first.
+ * @param data the buffer with the data to sign
+ * @param len the length of the data buffer
+ * @param signature the buffer to hold the returned signature
+ * @return 0 on success
+ * @return -1 if the signing failed
+ */
+static int ed25519_sign_cached(const unsigned char *data, size_t len, unsigned char signature[crypto_sign_BYTES]);
+
+/**
+ * Function to sign a payload with a prepared secret key.
+ * The signature is identical to the one of #ed25519_sign_key.
+ * @param key the key cache, see #ed25519_secret_key_cache_init
+ * @param data the buffer with the data to sign
+ * @param len the length of the data buffer
+ * @param signature the buffer to hold the returned signature
+ * @return 0 on success
+ * @return -1 if the signing failed
+ */
+static int ed25519_sign_cached_key(const ed25519_secret_key_cache *key, const unsigned char *data, size_t len,
+                                   unsigned char signature[crypto_sign_BYTES]);
+
+/**
+ * Function to sign a payload with a prepared secret key given as key handle.
+ * Matches #ubirch_protocol_sign_ctx, use it with #ubirch_protocol_set_signer.
+ * @param key pointer to the key cache (ed25519_secret_key_cache)
+ * @param data the buffer with the data to sign
+ * @param len the length of the data buffer
+ * @param signature the buffer to hold the returned signature
+ * @return 0 on success
+ * @return -1 if the signing failed
+ */
+static int ed25519_sign_cached_ctx(void *key, const unsigned char *data, size_t len,
+                                   unsigned char signature[crypto_sign_BYTES]);
+
+/**
+ * Prepare a public key for repeated verification. This decompresses the key and
+ * precomputes its tables once, instead of on every verification.
+ * @param key the key cache to initialize
+ * @param public_key the public key
+ * @return 0 on success
+ * @return -1 if the public key is invalid
+ */
+static int ed25519_public_key_cache_init(ed25519_public_key_cache *key,
+                                         const unsigned char public_key[crypto_sign_PUBLICKEYBYTES]);
+
+/**
+ * Function to verify a data buffer with a prepared public key.
+ * @param key the key cache, see #ed25519_public_key_cache_init
+ * @param data the buffer with the data to verify
+ * @param len the length of the data buffer
+ * @param signature a buffer with the corresponding signature
+ * @return 0 on success
+ * @return -1 if the verification failed
+ */
+static int ed25519_verify_cached(const ed25519_public_key_cache *key, const unsigned char *data, size_t len,
+                                 const unsigned char signature[crypto_sign_BYTES]);
+
+/**
+ * Function to verify a data buffer with a prepared public key given as key handle.
+ * Matches #ubirch_protocol_check_ctx, use it with #ubirch_protocol_verify_ctx.
+ * @param key pointer to the key cache (ed25519_public_key_cache)
+ * @param data the buffer with the data to verify
+ * @param len the length of the data buffer
+ * @param signature a buffer with the corresponding signature
+ * @return 0 on success
+ * @return -1 if the verification failed
+ */
+static int ed25519_verify_cached_ctx(void *key, const unsigned char *data, size_t len,
+                                     const unsigned char signature[crypto_sign_BYTES]);
+
+/**
+ * Function to verify many data buffers (i.e. message hashes) of the same length at once.
+ * Uses randomized batch verification with the host backend and single checks otherwise.
+ * Matches #ubirch_protocol_check_batch, use it with #ubirch_protocol_verify_batch.
+ * @param keys pointers to the public keys (crypto_sign_PUBLICKEYBYTES each)
+ * @param data the data buffers to verify (ED25519_STACK_DATA_SIZE bytes each)
+ * @param signatures the corresponding signatures
+ * @param n the number of data buffers
+ * @return 0 if all signatures are valid
+ * @return -1 if at least one verification failed
+ */
+static int ed25519_verify_batch_ctx(void *const keys[], const unsigned char *const data[],
+                                    const unsigned char *const signatures[], size_t n);
+
+/**
+ * Function to sign a payload with a given secret key, using caller supplied scratch
+ * space instead of the heap.
+ * @param data the buffer with the data to sign
+ * @param len the length of the data buffer
+ * @param signature the buffer to hold the returned signature
+ * @param secret_key the secret key to use
+ * @param scratch scratch space of at least ED25519_SIGN_SCRATCH_SIZE(len) bytes
+ * @param scratch_size the size of the scratch space
+ * @return 0 on success
+ * @return -1 if the signing failed or the scratch space is too small
+ */
+static int ed25519_sign_key_scratch(const unsigned char *data, size_t len, unsigned char signature[crypto_sign_BYTES],
+                                    const unsigned char secret_key[crypto_sign_SECRETKEYBYTES],
+                                    unsigned char *scratch, size_t scratch_size);
+
+/**
+ * Function to verify a data buffer with the provided signature and the given public key,
+ * using caller supplied scratch space instead of the heap.
+ * @param data the buffer with the data to verify
+ * @param len the length of the data buffer
+ * @param signature a buffer with the corresponding signature
+ * @param public_key the public key to verify with
+ * @param scratch scratch space of at least ED25519_SCRATCH_SIZE(len) bytes
+ * @param scratch_size the size of the scratch space
+ * @return 0 on success
+ * @return -1 if the verification failed or the scratch space is too small
+ */
+static int ed25519_verify_key_scratch(const unsigned char *data, size_t len,
+                                      const unsigned char signature[crypto_sign_BYTES],
+                                      const unsigned char public_key[crypto_sign_PUBLICKEYBYTES],
+                                      unsigned char *scratch, size_t scratch_size);
+
+inline int ed25519_sign_key_scratch(const unsigned char *data, size_t len, unsigned char signature[crypto_sign_BYTES],
+                                    const unsigned char secret_key[crypto_sign_SECRETKEYBYTES],
+                                    unsigned char *scratch, size_t scratch_size) {
+    // the signed message length must fit the NaCl length type
+    if (len > (crypto_uint16) ~0u - crypto_sign_BYTES) return -1;
+    if (scratch == NULL || scratch_size < ED25519_SIGN_SCRATCH_SIZE(len)) return -1;
+
+#ifdef UBIRCH_ED25519_HOST
+    // the host backend needs no scratch space
+    return ed25519_sign_key(data, len, signature, secret_key);
+#else
+    crypto_uint16 mlen;
+
+    // sign the message
+    crypto_sign(scratch, &mlen, data, (crypto_uint16) len, secret_key);
+    memcpy(signature, scratch, crypto_sign_BYTES);
+
+    return 0;
+#endif
+}
+
+inline int ed25519_verify_key_scratch(const unsigned char *data, size_t len,
+                                      const unsigned char signature[crypto_sign_BYTES],
+                                      const unsigned char public_key[crypto_sign_PUBLICKEYBYTES],
+                                      unsigned char *scratch, size_t scratch_size) {
+    if (len > (crypto_uint16) ~0u - crypto_sign_BYTES) return -1;
+    if (scratch == NULL || scratch_size < ED25519_SCRATCH_SIZE(len)) return -1;
+
+#ifdef UBIRCH_ED25519_HOST
+    // the host backend needs no scratch space
+    return ed25519_verify_key(data, len, signature, public_key);
+#else
+    crypto_uint16 smlen = (crypto_uint16) (crypto_sign_BYTES + len);
+    crypto_uint16 mlen;
+    unsigned char *sm = scratch;
+    unsigned char *m = scratch + smlen;
+
+    // initialize signed message structure
+    memcpy(sm, signature, crypto_sign_BYTES);
+    memcpy(sm + crypto_sign_BYTES, data, len);
+
+    // verify signature
+    return crypto_sign_open(m, &mlen, sm, smlen, public_key);
+#endif
+}
+
 inline int ed25519_sign_key(const unsigned char *data, size_t len, unsigned char signature[crypto_sign_BYTES],
                             const unsigned char secret_key[crypto_sign_SECRETKEYBYTES]) {
-    crypto_uint16 mlen;
-    unsigned char *sm = (unsigned char *) malloc(crypto_sign_BYTES + len);
+#ifdef UBIRCH_ED25519_HOST
+    ed25519_expanded_secret_key key;
+    ed25519_secret_key_expand(&key, secret_key);
+    ed25519_sign_expanded(&key, data, len, signature);
+    memset(&key, 0, sizeof(key));
+
+    return 0;
+#else
+    // small data (hashes) is signed using stack memory
+    if (len <= ED25519_STACK_DATA_SIZE) {
+        unsigned char scratch[ED25519_SIGN_SCRATCH_SIZE(ED25519_STACK_DATA_SIZE)];
+        return ed25519_sign_key_scratch(data, len, signature, secret_key, scratch, sizeof(scratch));
+    }
+
+    unsigned char *sm = (unsigned char *) malloc(ED25519_SIGN_SCRATCH_SIZE(len));
     if (!sm) return -1;
 
-    // sign the message
-    crypto_sign(sm, &mlen, data, (crypto_uint16) len, secret_key);
-    memcpy(signature, sm, crypto_sign_BYTES);
+    int ret = ed25519_sign_key_scratch(data, len, signature, secret_key, sm, ED25519_SIGN_SCRATCH_SIZE(len));
 
     free(sm);
 
-    return 0;
+    return ret;
+#endif
 }
 
 inline int ed25519_sign(const unsigned char *data, size_t len, unsigned char signature[crypto_sign_BYTES]) {
@@ -101,35 +368,118 @@ inline int ed25519_sign(const unsigned char *data, size_t len, unsigned char sig
 
 inline int ed25519_verify_key(const unsigned char *data, size_t len, const unsigned char signature[crypto_sign_BYTES],
                               const unsigned char public_key[crypto_sign_PUBLICKEYBYTES]) {
-    crypto_uint16 smlen = (crypto_uint16) (crypto_sign_BYTES + len);
-    crypto_uint16 mlen;
+#ifdef UBIRCH_ED25519_HOST
+    ed25519_expanded_public_key key;
+    if (ed25519_public_key_expand(&key, public_key)) return -1;
 
-    unsigned char *sm = (unsigned char *) malloc(smlen);
-    if (!sm) return -1;
-
-    unsigned char *m = (unsigned char *) malloc(smlen);
-    if (!m) {
-        free(sm);
-        return -1;
+    return ed25519_verify_expanded(&key, data, len, signature);
+#else
+    // small data (hashes) is verified using stack memory
+    if (len <= ED25519_STACK_DATA_SIZE) {
+        unsigned char scratch[ED25519_SCRATCH_SIZE(ED25519_STACK_DATA_SIZE)];
+        return ed25519_verify_key_scratch(data, len, signature, public_key, scratch, sizeof(scratch));
     }
 
-    // initialize signed message structure
-    memcpy(sm, signature, crypto_sign_BYTES);
-    memcpy(sm + crypto_sign_BYTES, data, len);
+    unsigned char *scratch = (unsigned char *) malloc(ED25519_SCRATCH_SIZE(len));
+    if (!scratch) return -1;
 
-    // verify signature
-    int ret = crypto_sign_open(m, &mlen, sm, smlen, public_key);
+    int ret = ed25519_verify_key_scratch(data, len, signature, public_key, scratch, ED25519_SCRATCH_SIZE(len));
 
-    free(m);
-    free(sm);
+    free(scratch);
 
     return ret;
+#endif
 }
 
 inline int ed25519_verify(const unsigned char *data, size_t len, const unsigned char signature[crypto_sign_BYTES]) {
     return ed25519_verify_key(data, len, signature, ed25519_public_key);
 }
 
+inline int ed25519_sign_ctx(void *key, const unsigned char *data, size_t len, unsigned char signature[crypto_sign_BYTES]) {
+    return ed25519_sign_key(data, len, signature, (const unsigned char *) key);
+}
+
+inline int ed25519_verify_ctx(void *key, const unsigned char *data, size_t len,
+                              const unsigned char signature[crypto_sign_BYTES]) {
+    return ed25519_verify_key(data, len, signature, (const unsigned char *) key);
+}
+
+inline void ed25519_secret_key_cache_init(ed25519_secret_key_cache *key,
+                                          const unsigned char secret_key[crypto_sign_SECRETKEYBYTES]) {
+#ifdef ED25519_MATH_64
+    ed25519_secret_key_expand(&key->expanded, secret_key);
+#else
+    memcpy(key->secret_key, secret_key, crypto_sign_SECRETKEYBYTES);
+#endif
+}
+
+inline int ed25519_sign_cached_key(const ed25519_secret_key_cache *key, const unsigned char *data, size_t len,
+                                   unsigned char signature[crypto_sign_BYTES]) {
+#ifdef ED25519_MATH_64
+    ed25519_sign_expanded(&key->expanded, data, len, signature);
+    return 0;
+#else
+    return ed25519_sign_key(data, len, signature, key->secret_key);
+#endif
+}
+
+inline int ed25519_sign_cached(const unsigned char *data, size_t len, unsigned char signature[crypto_sign_BYTES]) {
+    return ed25519_sign_cached_key(&ed25519_secret_key_cached, data, len, signature);
+}
+
+inline int ed25519_sign_cached_ctx(void *key, const unsigned char *data, size_t len,
+                                   unsigned char signature[crypto_sign_BYTES]) {
+    return ed25519_sign_cached_key((const ed25519_secret_key_cache *) key, data, len, signature);
+}
+
+inline int ed25519_public_key_cache_init(ed25519_public_key_cache *key,
+                                         const unsigned char public_key[crypto_sign_PUBLICKEYBYTES]) {
+#ifdef ED25519_MATH_64
+    return ed25519_public_key_expand(&key->expanded, public_key);
+#else
+    memcpy(key->public_key, public_key, crypto_sign_PUBLICKEYBYTES);
+    return 0;
+#endif
+}
+
+inline int ed25519_verify_cached(const ed25519_public_key_cache *key, const unsigned char *data, size_t len,
+                                 const unsigned char signature[crypto_sign_BYTES]) {
+#if defined(UBIRCH_ED25519_HOST)
+    return ed25519_verify_expanded(&key->expanded, data, len, signature);
+#elif defined(ED25519_MATH_64)
+    return ed25519_verify_key(data, len, signature, key->expanded.key);
+#else
+    return ed25519_verify_key(data, len, signature, key->public_key);
+#endif
+}
+
+inline int ed25519_verify_cached_ctx(void *key, const unsigned char *data, size_t len,
+                                     const unsigned char signature[crypto_sign_BYTES]) {
+    return ed25519_verify_cached((const ed25519_public_key_cache *) key, data, len, signature);
+}
+
+inline int ed25519_verify_batch_ctx(void *const keys[], const unsigned char *const data[],
+                                    const unsigned char *const signatures[], size_t n) {
+    // batches use the equation of the host backend, nacl-cm0 checks one by one
+#ifdef UBIRCH_ED25519_HOST
+    size_t lengths[ED25519_BATCH_MAX];
+    for (size_t i = 0; i < ED25519_BATCH_MAX; i++) lengths[i] = ED25519_STACK_DATA_SIZE;
+
+    for (size_t i = 0; i < n; i += ED25519_BATCH_MAX) {
+        const size_t count = n - i < ED25519_BATCH_MAX ? n - i : ED25519_BATCH_MAX;
+        if (ed25519_verify_batch(data + i, lengths, signatures + i, (const unsigned char *const *) keys + i, count)) {
+            return -1;
+        }
+    }
+    return 0;
+#else
+    for (size_t i = 0; i < n; i++) {
+        if (ed25519_verify_ctx(keys[i], data[i], ED25519_STACK_DATA_SIZE, signatures[i])) return -1;
+    }
+    return 0;
+#endif
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -79,6 +79,7 @@ extern "C" {
 #else
 #include "digest/sha512.h"
 #endif
+#include "digest/sha512_mb.h"
 
 #define UBIRCH_PROTOCOL_VERSION     1       //!< current ubirch protocol version
 #define UBIRCH_PROTOCOL_PLAIN       0x01    //!< plain protocol without signatures (unsafe)
@@ -89,9 +90,16 @@ extern "C" {
 #define UBIRCH_PROTOCOL_SIGN_SIZE   64      //!< our signatures has 64 bytes
 #define UBIRCH_PROTOCOL_HASH_SIZE   64      //!< size of the hash
 #define UBIRCH_PROTOCOL_UUID_SIZE   16      //!< the size of a UUID
+#define UBIRCH_PROTOCOL_SIGN_FIELD_SIZE (UBIRCH_PROTOCOL_SIGN_SIZE + 3) //!< encoded signature (raw16 header + data)
+
+#define UBIRCH_PROTOCOL_HEADER_SIZE 93      //!< max. header size: array, version, uuid, prev. signature, type
+#define UBIRCH_PROTOCOL_HEADER_PREV 24      //!< offset of the previous signature in a chained header
+
+#define UBIRCH_PROTOCOL_VERIFY_BATCH 32     //!< messages hashed and verified together by #ubirch_protocol_verify_batch
 
 #define UBIRCH_PROTOCOL_INITIALIZED 1       //!< protocol is initialized
 #define UBIRCH_PROTOCOL_STARTED     2       //!< protocol has started
+#define UBIRCH_PROTOCOL_PENDING     3       //!< message hashed, waiting for its signature
 
 #define UBIRCH_PROTOCOL_TYPE_BIN 0x00       //!< payload is undefined and binary
 #define UBIRCH_PROTOCOL_TYPE_REG 0x01       //!< payload is defined as key register message
@@ -125,6 +133,45 @@ typedef int (*ubirch_protocol_sign)(const unsigned char *buf, size_t len,
 typedef int (*ubirch_protocol_check)(const unsigned char *buf, size_t len,
                                      const unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]);
 
+/**
+ * The signature function type carrying a key handle, so that independent contexts
+ * can sign with different keys without shared state. This function is called from
+ * #ubirch_protocol_finish if set with #ubirch_protocol_set_signer.
+ *
+ * @param key the opaque key handle given to #ubirch_protocol_set_signer
+ * @param buf the data to sign
+ * @param size_t len the length of the data buffer
+ * @param signature signature output (64 byte)
+ */
+typedef int (*ubirch_protocol_sign_ctx)(void *key, const unsigned char *buf, size_t len,
+                                        unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]);
+
+/**
+ * The verification function type carrying a key handle.
+ * This function is called from #ubirch_protocol_verify_ctx
+ *
+ * @param key the opaque key handle given to #ubirch_protocol_verify_ctx
+ * @param buf the data to verify
+ * @param size_t the length of the data buffer
+ * @param signature the signature to check the data with (64 byte)
+ */
+typedef int (*ubirch_protocol_check_ctx)(void *key, const unsigned char *buf, size_t len,
+                                         const unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]);
+
+/**
+ * The batch verification function type, checking the signatures of many message
+ * hashes at once. It only needs to tell if all signatures are valid.
+ * This function is called from #ubirch_protocol_verify_batch
+ *
+ * @param keys the key handles (i.e. public keys) for each hash
+ * @param hashes the message hashes to verify (UBIRCH_PROTOCOL_HASH_SIZE bytes each)
+ * @param signatures the signatures to check the hashes with (64 byte each)
+ * @param n the number of hashes
+ * @return 0 if all signatures are valid
+ */
+typedef int (*ubirch_protocol_check_batch)(void *const keys[], const unsigned char *const hashes[],
+                                           const unsigned char *const signatures[], size_t n);
+
 /**
  * ubirch protocol context, which holds the underlying packer, the uuid and current and previous signature
  * as well as the current hash.
@@ -132,16 +179,47 @@ typedef int (*ubirch_protocol_check)(const unsigned char *buf, size_t len,
 typedef struct ubirch_protocol {
     msgpack_packer packer;                              //!< the underlying target packer
     ubirch_protocol_sign sign;                          //!< the message signing function
+    ubirch_protocol_sign_ctx sign_ctx;                  //!< the message signing function using a key handle
+    void *sign_key;                                     //!< the key handle passed to sign_ctx
+    msgpack_packer_write write;                         //!< the variant specific writer (hashing or not)
     uint16_t version;                                   //!< the specific used protocol version
     unsigned int type;                                  //!< the payload type (0 - unspecified, app specific)
     unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE];      //!< the uuid of the sender (used to retrieve the keys)
     unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]; //!< the current or previous signature of a message
     mbedtls_sha512_context hash;                        //!< the streaming hash of the data to sign
     unsigned int status;                                //!< amount of bytes packed
+    char *wbuf;                                         //!< optional staging buffer to coalesce small writes
+    size_t wbuf_size;                                   //!< the size of the staging buffer
+    size_t wbuf_len;                                    //!< amount of bytes currently staged
+    unsigned char header[UBIRCH_PROTOCOL_HEADER_SIZE];  //!< the pre-encoded message header
+    size_t header_len;                                  //!< the length of the pre-encoded header (0 - unsupported)
 } ubirch_protocol;
 
+struct ubirch_protocol_pending;
+
+/**
+ * The completion callback of an asynchronously signed message.
+ * This function is called from #ubirch_protocol_complete
+ *
+ * @param pending the pending signature that was completed
+ * @param result 0 if the signature was written, the error code of #ubirch_protocol_complete otherwise
+ */
+typedef void (*ubirch_protocol_done)(struct ubirch_protocol_pending *pending, int result);
+
+/**
+ * A message waiting for its signature, see #ubirch_protocol_finish_hash.
+ */
+typedef struct ubirch_protocol_pending {
+    ubirch_protocol *proto;                             //!< the context the message belongs to
+    unsigned char hash[UBIRCH_PROTOCOL_HASH_SIZE];      //!< the final hash of the message
+    ubirch_protocol_done done;                          //!< called when the signature is written (optional)
+    void *data;                                         //!< application data for the completion callback
+} ubirch_protocol_pending;
+
 /**
  * Initialize a new ubirch protocol context.
+ * The variant, uuid and data type are pre-encoded into the message header,
+ * re-initialize the context to change them.
  *
  * @param proto the ubirch protocol context
  * @param variant protocol variant
@@ -178,14 +256,53 @@ static ubirch_protocol *ubirch_protocol_new(ubirch_protocol_variant variant,
  */
 static void ubirch_protocol_free(ubirch_protocol *proto);
 
+/**
+ * Set a staging buffer used to coalesce the many small writes of the msgpack
+ * packer (array markers, raw headers, ...). Staged data is hashed and forwarded
+ * to the underlying writer in large chunks, when the buffer is full or the
+ * message is finished. The buffer is owned by the caller and must stay valid
+ * while it is set. Any previously staged data is flushed first.
+ *
+ * @param proto the ubirch protocol context
+ * @param buf the staging buffer or NULL to disable staging
+ * @param size the size of the staging buffer
+ * @return 0 if successful
+ * @return the error code of the underlying writer if flushing failed
+ */
+static int ubirch_protocol_set_write_buffer(ubirch_protocol *proto, char *buf, size_t size);
+
+/**
+ * Set a signing function that receives an opaque key handle. It replaces the
+ * plain signing function given at initialization, so that different contexts
+ * (i.e. in different threads) can sign for different identities without
+ * sharing the global key.
+ *
+ * @param proto the ubirch protocol context
+ * @param sign the signing function, or NULL to use the plain signing function again
+ * @param key the key handle passed to the signing function
+ */
+static void ubirch_protocol_set_signer(ubirch_protocol *proto, ubirch_protocol_sign_ctx sign, void *key);
+
+/**
+ * Hash and forward all staged data to the underlying writer.
+ * This is done automatically by #ubirch_protocol_finish.
+ *
+ * @param proto the ubirch protocol context
+ * @return 0 if successful
+ * @return the error code of the underlying writer
+ */
+static int ubirch_protocol_flush(ubirch_protocol *proto);
+
 /**
  * Start a new message. Clears out previous data and re-initialized the signature
- * handler. Also writes the header data.
+ * handler. Also writes the header data, which was pre-encoded by #ubirch_protocol_init,
+ * with a single write.
  * @param proto the ubirch protocol context
  * @param pk the msgpack packer used for serializing data
  * @return -1 if packer or proto are NULL
  * @return -2 if the protocol was not initialized
  * @return -3 if the protocol version is not supported
+ * @return -4 if writing the header failed
  */
 static int ubirch_protocol_start(ubirch_protocol *proto, msgpack_packer *pk);
 
@@ -197,8 +314,47 @@ static int ubirch_protocol_start(ubirch_protocol *proto, msgpack_packer *pk);
  * @return -1 if either packer or protocol are NULL
  * @return -2 if used before ubirch_protocol_start
  * @return -3 if the signing failed
+ * @return -4 if writing staged data failed
  */
 static int ubirch_protocol_finish(ubirch_protocol *proto, msgpack_packer *pk);
+
+/**
+ * Finish a message without signing it yet. This is the first half of
+ * #ubirch_protocol_finish: all staged data is written and the hash is finalized
+ * into the pending signature, which can then be handed to another thread to run
+ * #ubirch_protocol_complete. The context stays busy until then, #ubirch_protocol_start
+ * fails with -2, so signatures are written in the order of the messages and
+ * chained messages see the previous signature.
+ *
+ * The pending signature needs no initialization, its completion callback is
+ * cleared. Set pending->done and pending->data afterwards, before handing it
+ * off, if the producer needs to be notified.
+ *
+ * @param proto the ubirch protocol context
+ * @param pending the pending signature, must stay valid until completed
+ * @return 0 if successful
+ * @return -1 if either pending or protocol are NULL
+ * @return -2 if used before ubirch_protocol_start
+ * @return -4 if writing staged data failed
+ */
+static int ubirch_protocol_finish_hash(ubirch_protocol *proto, ubirch_protocol_pending *pending);
+
+/**
+ * Sign a pending message and write the signature to the underlying writer of its
+ * context. This is the second half of #ubirch_protocol_finish and may run in any
+ * thread, as long as the context is not used otherwise until the completion
+ * callback was called. The context is ready for the next message afterwards,
+ * also if signing failed.
+ *
+ * @param pending the pending signature from #ubirch_protocol_finish_hash
+ * @return 0 if successful
+ * @return -1 if pending is NULL
+ * @return -2 if the message is not pending
+ * @return -3 if the signing failed
+ * @return -4 if writing the signature failed
+ */
+static int ubirch_protocol_complete(ubirch_protocol_pending *pending);
+
 /**
  * Verify a messages signature.
  * This function requires 256 bytes of heap memory to v
@@ -211,19 +367,238 @@ static int ubirch_protocol_finish(ubirch_protocol *proto, msgpack_packer *pk);
 static int ubirch_protocol_verify(msgpack_unpacker *unpacker, ubirch_protocol_check verify);
 
 /**
- * The ubirch protocol msgpack writer. This writer takes care of updating the hash
- * and writing original data to the underlying write callback.
+ * Verify a messages signature using a verification function with a key handle.
+ * @param unpacker the unpacker containing the data
+ * @param verify the verification function
+ * @param key the key handle passed to the verification function (i.e. the public key)
+ * @return 0 if the verification is successful
+ * @return -1 if the signature verification has failed
+ * @return -2 if the message length is wrong (too short to actually to a check)
+ */
+static int ubirch_protocol_verify_ctx(msgpack_unpacker *unpacker, ubirch_protocol_check_ctx verify, void *key);
+
+/**
+ * Verify the signatures of many messages at once. The messages are hashed side
+ * by side and checked with the batch verification function, which is much cheaper
+ * per message than single checks. If the batch fails, the messages are checked one
+ * by one with the per message verification function to find the invalid ones.
+ * @param messages the complete messages
+ * @param sizes the sizes of the messages
+ * @param keys the key handles (i.e. public keys) for each message
+ * @param n the number of messages
+ * @param verify_batch the batch verification function, or NULL to check each message
+ * @param verify the per message verification function
+ * @param results the result for each message as returned by #ubirch_protocol_verify_ctx, may be NULL
+ * @return 0 if all messages are valid
+ * @return -1 if at least one message is invalid (see results)
+ */
+static int ubirch_protocol_verify_batch(const unsigned char *const messages[], const size_t sizes[],
+                                        void *const keys[], size_t n, ubirch_protocol_check_batch verify_batch,
+                                        ubirch_protocol_check_ctx verify, int results[]);
+
+/**
+ * Calculate the exact size of an encoded message, before encoding it.
+ * @param variant protocol variant
+ * @param data_type the payload data type indicator (0 - binary)
+ * @param payload_len the length of the msgpack encoded payload
+ * @return the size of the complete message, including the signature
+ * @return 0 if the protocol variant is not supported
+ */
+static size_t ubirch_protocol_message_size(ubirch_protocol_variant variant, unsigned int data_type,
+                                           size_t payload_len);
+
+/**
+ * Encode a complete message (header, payload and signature) directly into a caller
+ * provided buffer, without going through the write callback. Use
+ * #ubirch_protocol_message_size to size the buffer. The payload must be a single
+ * msgpack encoded element. It may already be placed in the buffer, right after
+ * the header (at `buf + proto->header_len`), to avoid copying it.
+ *
+ * For chained messages the signature is kept in the context, just like
+ * #ubirch_protocol_finish does.
+ *
+ * @param proto the ubirch protocol context
+ * @param payload the msgpack encoded payload
+ * @param payload_len the length of the payload
+ * @param buf the message buffer
+ * @param size the size of the message buffer
+ * @param len the size of the encoded message (output)
+ * @return 0 if successful
+ * @return -1 if proto, buffer or len are NULL
+ * @return -2 if a message was started and not finished
+ * @return -3 if the protocol version is not supported
+ * @return -4 if the buffer is too small
+ * @return -5 if the signing failed
+ */
+static int ubirch_protocol_encode(ubirch_protocol *proto, const unsigned char *payload, size_t payload_len,
+                                  unsigned char *buf, size_t size, size_t *len);
+
+/**
+ * Forward data to the underlying writer, staging it if a write buffer is set.
+ * The hash flag is a constant in the variant specific writers, so each of them
+ * compiles to a straight path.
+ */
+static inline int ubirch_protocol_write_variant(ubirch_protocol *proto, const char *buf, size_t len,
+                                                const int hash) {
+    if (proto->wbuf != NULL) {
+        // stage small writes, everything that does not fit is flushed
+        if (len <= proto->wbuf_size - proto->wbuf_len) {
+            memcpy(proto->wbuf + proto->wbuf_len, buf, len);
+            proto->wbuf_len += len;
+            return 0;
+        }
+        int ret = ubirch_protocol_flush(proto);
+        if (ret) return ret;
+        if (len < proto->wbuf_size) {
+            memcpy(proto->wbuf, buf, len);
+            proto->wbuf_len = len;
+            return 0;
+        }
+    }
+    if (hash) {
+        mbedtls_sha512_update(&proto->hash, (const unsigned char *) buf, len);
+    }
+    return proto->packer.callback(proto->packer.data, buf, len);
+}
+
+/**
+ * The ubirch protocol msgpack writer for plain messages. Writes the original data
+ * to the underlying write callback without hashing it.
+ * @param data the ubirch protocol context
+ * @param buf the data to write
+ * @param len the length of the data
+ * @return 0 if successful
+ */
+static inline int ubirch_protocol_write_plain(void *data, const char *buf, size_t len) {
+    return ubirch_protocol_write_variant((ubirch_protocol *) data, buf, len, 0);
+}
+
+/**
+ * The ubirch protocol msgpack writer for signed and chained messages. This writer
+ * takes care of updating the hash and writing original data to the underlying write callback.
+ * @param data the ubirch protocol context
+ * @param buf the data to write and hash
+ * @param len the length of the data
+ * @return 0 if successful
+ */
+static inline int ubirch_protocol_write_signed(void *data, const char *buf, size_t len) {
+    return ubirch_protocol_write_variant((ubirch_protocol *) data, buf, len, 1);
+}
+
+/**
+ * The ubirch protocol msgpack writer. Dispatches to the variant specific writer
+ * selected by #ubirch_protocol_init. Use #ubirch_protocol_writer to get that writer
+ * directly when creating the packer and avoid the extra call.
  * @param data the ubirch protocol context
  * @param buf the data to writer and hash
  * @param len the length of the data
  * @return 0 if successful
  */
 static inline int ubirch_protocol_write(void *data, const char *buf, size_t len) {
+    return ((ubirch_protocol *) data)->write(data, buf, len);
+}
+
+/**
+ * Get the writer specific to the protocol variant of this context, to be used
+ * with msgpack_packer_new() instead of #ubirch_protocol_write:
+ *
+ * ```
+ * msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_writer(proto));
+ * ```
+ * @param proto the ubirch protocol context
+ * @return the writer for plain or signed/chained messages
+ */
+static inline msgpack_packer_write ubirch_protocol_writer(const ubirch_protocol *proto) {
+    return proto->write;
+}
+
+inline int ubirch_protocol_flush(ubirch_protocol *proto) {
+    if (proto->wbuf == NULL || proto->wbuf_len == 0) return 0;
+
+    const size_t len = proto->wbuf_len;
+    proto->wbuf_len = 0;
+    // the writers are static, their address differs between units, so check the variant
+    if (proto->version == proto_signed || proto->version == proto_chained) {
+        mbedtls_sha512_update(&proto->hash, (const unsigned char *) proto->wbuf, len);
+    }
+    return proto->packer.callback(proto->packer.data, proto->wbuf, len);
+}
+
+/**
+ * Writer used to pre-encode the message header into the context.
+ */
+static inline int ubirch_protocol_header_write(void *data, const char *buf, size_t len) {
     ubirch_protocol *proto = (ubirch_protocol *) data;
-    if (proto->version & proto_signed || proto->version == proto_chained) {
-        mbedtls_sha512_update(&proto->hash, (const unsigned char *) buf, len);
+    if (len > sizeof(proto->header) - proto->header_len) return -1;
+    memcpy(proto->header + proto->header_len, buf, len);
+    proto->header_len += len;
+    return 0;
+}
+
+/**
+ * Pre-encode the constant message header (array marker, version, uuid, the
+ * previous signature slot if chained and the payload type) once, so that
+ * #ubirch_protocol_start emits it with a single write.
+ */
+static inline void ubirch_protocol_header_render(ubirch_protocol *proto) {
+    msgpack_packer pk;
+    msgpack_packer_init(&pk, proto, ubirch_protocol_header_write);
+    proto->header_len = 0;
+
+    // the message consists of 3 header elements, the payload and (not included) the signature
+    switch (proto->version) {
+        case proto_plain:
+            msgpack_pack_array(&pk, 4);
+            break;
+        case proto_signed:
+            msgpack_pack_array(&pk, 5);
+            break;
+        case proto_chained:
+            msgpack_pack_array(&pk, 6);
+            break;
+        default:
+            return;
     }
-    return proto->packer.callback(proto->packer.data, buf, len);
+
+    // 1 - protocol version
+    msgpack_pack_fix_uint16(&pk, proto->version);
+
+    // 2 - device ID
+    msgpack_pack_raw(&pk, 16);
+    msgpack_pack_raw_body(&pk, proto->uuid, sizeof(proto->uuid));
+
+    // 3 the last signature (if chained), filled in by ubirch_protocol_start
+    if (proto->version == proto_chained) {
+        msgpack_pack_raw(&pk, sizeof(proto->signature));
+        msgpack_pack_raw_body(&pk, proto->signature, sizeof(proto->signature));
+    }
+
+    // 4 the payload type
+    msgpack_pack_int(&pk, proto->type);
+}
+
+inline void ubirch_protocol_set_signer(ubirch_protocol *proto, ubirch_protocol_sign_ctx sign, void *key) {
+    proto->sign_ctx = sign;
+    proto->sign_key = key;
+}
+
+/**
+ * Sign the message hash with the configured signing function, keeping the signature.
+ */
+static inline int ubirch_protocol_sign_hash(ubirch_protocol *proto,
+                                            const unsigned char sha512sum[UBIRCH_PROTOCOL_HASH_SIZE]) {
+    if (proto->sign_ctx != NULL) {
+        return proto->sign_ctx(proto->sign_key, sha512sum, UBIRCH_PROTOCOL_HASH_SIZE, proto->signature);
+    }
+    return proto->sign(sha512sum, UBIRCH_PROTOCOL_HASH_SIZE, proto->signature);
+}
+
+inline int ubirch_protocol_set_write_buffer(ubirch_protocol *proto, char *buf, size_t size) {
+    int ret = ubirch_protocol_flush(proto);
+    proto->wbuf = size ? buf : NULL;
+    proto->wbuf_size = size;
+    proto->wbuf_len = 0;
+    return ret;
 }
 
 inline void ubirch_protocol_init(ubirch_protocol *proto, enum ubirch_protocol_variant variant,
@@ -233,10 +608,22 @@ inline void ubirch_protocol_init(ubirch_protocol *proto, enum ubirch_protocol_va
     proto->packer.data = data;
     proto->packer.callback = callback;
     proto->sign = sign;
+    proto->sign_ctx = NULL;
+    proto->sign_key = NULL;
     proto->hash.is384 = -1;
     proto->version = variant;
+    // only signed and chained messages need to hash what is written
+    if (variant == proto_signed || variant == proto_chained) {
+        proto->write = ubirch_protocol_write_signed;
+    } else {
+        proto->write = ubirch_protocol_write_plain;
+    }
     proto->type = data_type;
     memcpy(proto->uuid, uuid, UBIRCH_PROTOCOL_UUID_SIZE);
+    proto->wbuf = NULL;
+    proto->wbuf_size = 0;
+    proto->wbuf_len = 0;
+    ubirch_protocol_header_render(proto);
     proto->status = UBIRCH_PROTOCOL_INITIALIZED;
 }
 
@@ -258,42 +645,20 @@ inline void ubirch_protocol_free(ubirch_protocol *proto) {
 inline int ubirch_protocol_start(ubirch_protocol *proto, msgpack_packer *pk) {
     if (proto == NULL || pk == NULL) return -1;
     if (proto->status != UBIRCH_PROTOCOL_INITIALIZED) return -2;
+    if (proto->header_len == 0) return -3;
 
     if (proto->version == proto_signed || proto->version == proto_chained) {
         mbedtls_sha512_init(&proto->hash);
         mbedtls_sha512_starts(&proto->hash, 0);
     }
 
-    // the message consists of 3 header elements, the payload and (not included) the signature
-    switch (proto->version) {
-        case proto_plain:
-            msgpack_pack_array(pk, 4);
-            break;
-        case proto_signed:
-            msgpack_pack_array(pk, 5);
-            break;
-        case proto_chained:
-            msgpack_pack_array(pk, 6);
-            break;
-        default:
-            return -3;
-    }
-
-    // 1 - protocol version
-    msgpack_pack_fix_uint16(pk, proto->version);
-
-    // 2 - device ID
-    msgpack_pack_raw(pk, 16);
-    msgpack_pack_raw_body(pk, proto->uuid, sizeof(proto->uuid));
-
-    // 3 the last signature (if chained)
+    // update the last signature (if chained) in the pre-encoded header
     if (proto->version == proto_chained) {
-        msgpack_pack_raw(pk, sizeof(proto->signature));
-        msgpack_pack_raw_body(pk, proto->signature, sizeof(proto->signature));
+        memcpy(proto->header + UBIRCH_PROTOCOL_HEADER_PREV, proto->signature, sizeof(proto->signature));
     }
 
-    // 4 the payload type
-    msgpack_pack_int(pk, proto->type);
+    // write the complete header at once
+    if (pk->callback(pk->data, (const char *) proto->header, proto->header_len)) return -4;
 
     proto->status = UBIRCH_PROTOCOL_STARTED;
     return 0;
@@ -305,9 +670,12 @@ inline int ubirch_protocol_finish(ubirch_protocol *proto, msgpack_packer *pk) {
 
     // only add signature if we have a chained or signed message
     if (proto->version == proto_signed || proto->version == proto_chained) {
+        // staged data must be part of the hash
+        if (ubirch_protocol_flush(proto)) return -4;
+
         unsigned char sha512sum[UBIRCH_PROTOCOL_HASH_SIZE];
         mbedtls_sha512_finish(&proto->hash, sha512sum);
-        if (proto->sign(sha512sum, sizeof(sha512sum), proto->signature)) {
+        if (ubirch_protocol_sign_hash(proto, sha512sum)) {
             return -3;
         }
 
@@ -316,12 +684,53 @@ inline int ubirch_protocol_finish(ubirch_protocol *proto, msgpack_packer *pk) {
         msgpack_pack_raw_body(pk, proto->signature, UBIRCH_PROTOCOL_SIGN_SIZE);
     }
 
+    if (ubirch_protocol_flush(proto)) return -4;
     proto->status = UBIRCH_PROTOCOL_INITIALIZED;
 
     return 0;
 }
 
-inline int ubirch_protocol_verify(msgpack_unpacker *unpacker, ubirch_protocol_check verify) {
+inline int ubirch_protocol_finish_hash(ubirch_protocol *proto, ubirch_protocol_pending *pending) {
+    if (proto == NULL || pending == NULL) return -1;
+    if (proto->status != UBIRCH_PROTOCOL_STARTED) return -2;
+
+    // staged data must be part of the hash and precede the signature
+    if (ubirch_protocol_flush(proto)) return -4;
+
+    if (proto->version == proto_signed || proto->version == proto_chained) {
+        mbedtls_sha512_finish(&proto->hash, pending->hash);
+    }
+    pending->proto = proto;
+    pending->done = NULL;
+    pending->data = NULL;
+    proto->status = UBIRCH_PROTOCOL_PENDING;
+
+    return 0;
+}
+
+inline int ubirch_protocol_complete(ubirch_protocol_pending *pending) {
+    if (pending == NULL || pending->proto == NULL) return -1;
+    ubirch_protocol *proto = pending->proto;
+    if (proto->status != UBIRCH_PROTOCOL_PENDING) return -2;
+
+    int ret = 0;
+    if (proto->version == proto_signed || proto->version == proto_chained) {
+        if (ubirch_protocol_sign_hash(proto, pending->hash)) {
+            ret = -3;
+        } else {
+            // 5 add signature hash, directly to the underlying writer (the hash is final)
+            unsigned char field[UBIRCH_PROTOCOL_SIGN_FIELD_SIZE] = {0xda, 0x00, UBIRCH_PROTOCOL_SIGN_SIZE};
+            memcpy(field + 3, proto->signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+            if (proto->packer.callback(proto->packer.data, (const char *) field, sizeof(field))) ret = -4;
+        }
+    }
+    proto->status = UBIRCH_PROTOCOL_INITIALIZED;
+
+    if (pending->done != NULL) pending->done(pending, ret);
+    return ret;
+}
+
+inline int ubirch_protocol_verify_ctx(msgpack_unpacker *unpacker, ubirch_protocol_check_ctx verify, void *key) {
     const size_t msgpack_sig_length = UBIRCH_PROTOCOL_SIGN_SIZE + 3;
     const size_t message_size = msgpack_unpacker_message_size(unpacker);
 
@@ -336,7 +745,143 @@ inline int ubirch_protocol_verify(msgpack_unpacker *unpacker, ubirch_protocol_ch
     // get a pointer to the signature
     unsigned char *signature = data + (message_size - UBIRCH_PROTOCOL_SIGN_SIZE);
 
-    return verify(sha512sum, UBIRCH_PROTOCOL_HASH_SIZE, signature);
+    return verify(key, sha512sum, UBIRCH_PROTOCOL_HASH_SIZE, signature);
+}
+
+/**
+ * Adapter for the plain verification function.
+ */
+static inline int ubirch_protocol_check_plain(void *key, const unsigned char *buf, size_t len,
+                                              const unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]) {
+    return (*(ubirch_protocol_check *) key)(buf, len, signature);
+}
+
+inline int ubirch_protocol_verify(msgpack_unpacker *unpacker, ubirch_protocol_check verify) {
+    return ubirch_protocol_verify_ctx(unpacker, ubirch_protocol_check_plain, &verify);
+}
+
+inline int ubirch_protocol_verify_batch(const unsigned char *const messages[], const size_t sizes[],
+                                        void *const keys[], size_t n, ubirch_protocol_check_batch verify_batch,
+                                        ubirch_protocol_check_ctx verify, int results[]) {
+    const size_t msgpack_sig_length = UBIRCH_PROTOCOL_SIGN_SIZE + 3;
+    unsigned char hashes[UBIRCH_PROTOCOL_VERIFY_BATCH][UBIRCH_PROTOCOL_HASH_SIZE];
+    const unsigned char *data[UBIRCH_PROTOCOL_VERIFY_BATCH];
+    const unsigned char *hash[UBIRCH_PROTOCOL_VERIFY_BATCH];
+    const unsigned char *signatures[UBIRCH_PROTOCOL_VERIFY_BATCH];
+    size_t lengths[UBIRCH_PROTOCOL_VERIFY_BATCH];
+    size_t index[UBIRCH_PROTOCOL_VERIFY_BATCH];
+    void *batch_keys[UBIRCH_PROTOCOL_VERIFY_BATCH];
+    int ret = 0;
+
+    for (size_t offset = 0; offset < n; offset += UBIRCH_PROTOCOL_VERIFY_BATCH) {
+        const size_t count = n - offset < UBIRCH_PROTOCOL_VERIFY_BATCH ? n - offset : UBIRCH_PROTOCOL_VERIFY_BATCH;
+        size_t batch = 0;
+
+        // messages that are too short can't be checked, all others go into the batch
+        for (size_t i = offset; i < offset + count; i++) {
+            if (sizes[i] <= msgpack_sig_length) {
+                if (results) results[i] = -2;
+                ret = -1;
+                continue;
+            }
+            data[batch] = messages[i];
+            lengths[batch] = sizes[i] - msgpack_sig_length;
+            signatures[batch] = messages[i] + (sizes[i] - UBIRCH_PROTOCOL_SIGN_SIZE);
+            hash[batch] = hashes[batch];
+            batch_keys[batch] = keys[i];
+            index[batch++] = i;
+        }
+
+        mbedtls_sha512_mb(data, lengths, hashes, batch, 0);
+
+        if (verify_batch && batch > 1 && !verify_batch(batch_keys, hash, signatures, batch)) {
+            if (results) {
+                for (size_t i = 0; i < batch; i++) results[index[i]] = 0;
+            }
+            continue;
+        }
+
+        // check one by one to find the invalid messages
+        for (size_t i = 0; i < batch; i++) {
+            const int result = verify(batch_keys[i], hash[i], UBIRCH_PROTOCOL_HASH_SIZE, signatures[i]);
+            if (results) results[index[i]] = result;
+            if (result) ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * The size of an int packed with msgpack_pack_int().
+ */
+static inline size_t ubirch_protocol_int_size(int d) {
+    if (d < -(1 << 5)) {
+        if (d < -(1 << 15)) return 5;
+        return d < -(1 << 7) ? 3 : 2;
+    }
+    if (d < (1 << 7)) return 1;
+    if (d < (1 << 8)) return 2;
+    return d < (1 << 16) ? 3 : 5;
+}
+
+inline size_t ubirch_protocol_message_size(ubirch_protocol_variant variant, unsigned int data_type,
+                                           size_t payload_len) {
+    // array marker, version and uuid
+    size_t size = 1 + 3 + 1 + UBIRCH_PROTOCOL_UUID_SIZE;
+
+    switch (variant) {
+        case proto_plain:
+            break;
+        case proto_signed:
+            size += UBIRCH_PROTOCOL_SIGN_FIELD_SIZE;
+            break;
+        case proto_chained:
+            size += 2 * UBIRCH_PROTOCOL_SIGN_FIELD_SIZE;
+            break;
+        default:
+            return 0;
+    }
+
+    return size + ubirch_protocol_int_size((int) data_type) + payload_len;
+}
+
+inline int ubirch_protocol_encode(ubirch_protocol *proto, const unsigned char *payload, size_t payload_len,
+                                  unsigned char *buf, size_t size, size_t *len) {
+    if (proto == NULL || buf == NULL || len == NULL) return -1;
+    if (proto->status != UBIRCH_PROTOCOL_INITIALIZED) return -2;
+    if (proto->header_len == 0) return -3;
+
+    const int signed_message = proto->version == proto_signed || proto->version == proto_chained;
+    const size_t data_len = proto->header_len + payload_len;
+    const size_t message_len = data_len + (signed_message ? UBIRCH_PROTOCOL_SIGN_FIELD_SIZE : 0);
+    if (message_len > size) return -4;
+
+    // header (with the last signature if chained) and payload
+    memcpy(buf, proto->header, proto->header_len);
+    if (proto->version == proto_chained) {
+        memcpy(buf + UBIRCH_PROTOCOL_HEADER_PREV, proto->signature, sizeof(proto->signature));
+    }
+    if (payload_len && payload != buf + proto->header_len) {
+        memmove(buf + proto->header_len, payload, payload_len);
+    }
+
+    if (signed_message) {
+        unsigned char sha512sum[UBIRCH_PROTOCOL_HASH_SIZE];
+        mbedtls_sha512(buf, data_len, sha512sum, 0);
+        if (ubirch_protocol_sign_hash(proto, sha512sum)) {
+            return -5;
+        }
+
+        // raw16 header and signature
+        buf[data_len] = 0xda;
+        buf[data_len + 1] = 0x00;
+        buf[data_len + 2] = UBIRCH_PROTOCOL_SIGN_SIZE;
+        memcpy(buf + data_len + 3, proto->signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+    }
+
+    *len = message_len;
+    return 0;
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,161 @@
+/*!
+ * @file
+ * @brief ubirch protocol message batches
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "ubirch_protocol_batch.h"
+
+/**
+ * Make room for size more bytes in the buffer.
+ */
+static int ubirch_batch_reserve(ubirch_batch *batch, size_t size) {
+    if (size <= batch->size - batch->len) return 0;
+
+    size_t grown = batch->size * 2;
+    while (grown - batch->len < size) grown *= 2;
+    unsigned char *buf = (unsigned char *) realloc(batch->buf, grown);
+    if (!buf) return -1;
+    batch->buf = buf;
+    batch->size = grown;
+
+    return 0;
+}
+
+ubirch_batch *ubirch_batch_new(size_t size, size_t count) {
+    ubirch_batch *batch = (ubirch_batch *) calloc(1, sizeof(ubirch_batch));
+    if (!batch) return NULL;
+
+    batch->size = size ? size : 1;
+    batch->capacity = count ? count : 1;
+    batch->buf = (unsigned char *) malloc(batch->size);
+    batch->entries = (ubirch_batch_entry *) malloc(batch->capacity * sizeof(ubirch_batch_entry));
+    if (!batch->buf || !batch->entries) {
+        ubirch_batch_free(batch);
+        return NULL;
+    }
+
+    return batch;
+}
+
+void ubirch_batch_free(ubirch_batch *batch) {
+    if (batch == NULL) return;
+    free(batch->buf);
+    free(batch->entries);
+    free(batch);
+}
+
+void ubirch_batch_clear(ubirch_batch *batch) {
+    batch->len = 0;
+    batch->count = 0;
+    batch->proto = NULL;
+    batch->error = 0;
+}
+
+int ubirch_batch_start(ubirch_batch *batch, ubirch_protocol *proto) {
+    if (proto == NULL) return -1;
+    if (batch->proto != NULL || proto->status != UBIRCH_PROTOCOL_INITIALIZED) return -2;
+    if (proto->header_len == 0) return -3;
+
+    // the header is written by ubirch_protocol_encode, the payload is packed behind it
+    if (ubirch_batch_reserve(batch, proto->header_len)) return -6;
+    batch->proto = proto;
+    batch->start = batch->len;
+    batch->len += proto->header_len;
+    batch->error = 0;
+
+    return 0;
+}
+
+int ubirch_batch_write(void *data, const char *buf, size_t len) {
+    ubirch_batch *batch = (ubirch_batch *) data;
+    if (batch->proto == NULL || ubirch_batch_reserve(batch, len)) {
+        batch->error = 1;
+        return -1;
+    }
+
+    memcpy(batch->buf + batch->len, buf, len);
+    batch->len += len;
+    return 0;
+}
+
+int ubirch_batch_finish(ubirch_batch *batch) {
+    ubirch_protocol *proto = batch->proto;
+    if (proto == NULL) return -2;
+
+    const size_t start = batch->start;
+    const size_t payload_len = batch->len - start - proto->header_len;
+    const int signed_message = proto->version == proto_signed || proto->version == proto_chained;
+    int ret = -6;
+
+    // drop the message if a part of it is missing
+    if (!batch->error &&
+        !ubirch_batch_reserve(batch, signed_message ? UBIRCH_PROTOCOL_SIGN_FIELD_SIZE : 0)) {
+        if (batch->count == batch->capacity) {
+            ubirch_batch_entry *entries = (ubirch_batch_entry *) realloc(
+                    batch->entries, 2 * batch->capacity * sizeof(ubirch_batch_entry));
+            if (entries) {
+                batch->entries = entries;
+                batch->capacity *= 2;
+            }
+        }
+        if (batch->count < batch->capacity) {
+            size_t len;
+            ret = ubirch_protocol_encode(proto, batch->buf + start + proto->header_len, payload_len,
+                                         batch->buf + start, batch->size - start, &len);
+            if (!ret) {
+                ubirch_batch_entry *entry = &batch->entries[batch->count++];
+                entry->offset = start;
+                entry->len = len;
+                entry->signature = signed_message ? start + len - UBIRCH_PROTOCOL_SIGN_SIZE : 0;
+                batch->len = start + len;
+            }
+        }
+    }
+
+    if (ret) batch->len = start;
+    batch->proto = NULL;
+    batch->error = 0;
+    return ret;
+}
+
+int ubirch_batch_add(ubirch_batch *batch, ubirch_protocol *proto, const unsigned char *payload, size_t payload_len) {
+    int ret = ubirch_batch_start(batch, proto);
+    if (ret) return ret;
+
+    ubirch_batch_write(batch, (const char *) payload, payload_len);
+    return ubirch_batch_finish(batch);
+}
+
+int ubirch_batch_flush(ubirch_batch *batch, msgpack_packer_write writer, void *data) {
+    // a started message is not complete and stays in the batch
+    const size_t len = batch->count ? batch->entries[batch->count - 1].offset + batch->entries[batch->count - 1].len : 0;
+    if (len == 0) return 0;
+
+    const int ret = writer(data, (const char *) batch->buf, len);
+    if (ret) return ret;
+
+    if (batch->proto != NULL) {
+        memmove(batch->buf, batch->buf + len, batch->len - len);
+        batch->start -= len;
+    }
+    batch->len -= len;
+    batch->count = 0;
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*!
+ * @file
+ * @brief ubirch protocol message batches
+ *
+ * Builds many complete messages (of one or more contexts) back to back in one
+ * growing buffer, to send them with a single write. Each message is encoded in
+ * place with #ubirch_protocol_encode: the payload is packed directly behind the
+ * space for the header, so it is not copied. The buffer and the table of
+ * messages are kept when the batch is cleared, a batch of the same size does
+ * not allocate memory again.
+ *
+ * ```
+ * ubirch_batch *batch = ubirch_batch_new(4096, 32);
+ * msgpack_packer *pk = msgpack_packer_new(batch, ubirch_batch_write);
+ * for (int i = 0; i < n; i++) {
+ *     ubirch_batch_start(batch, proto);
+ *     msgpack_pack_int(pk, readings[i]);
+ *     ubirch_batch_finish(batch);
+ * }
+ * ubirch_batch_flush(batch, send_all, socket);
+ * ```
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef UBIRCH_PROTOCOL_BATCH_H
+#define UBIRCH_PROTOCOL_BATCH_H
+
+#include "ubirch_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A message in the batch.
+ */
+typedef struct ubirch_batch_entry {
+    size_t offset;                      //!< the start of the message in the buffer
+    size_t len;                         //!< the length of the message
+    size_t signature;                   //!< the offset of the signature in the buffer (0 if unsigned)
+} ubirch_batch_entry;
+
+/**
+ * A batch of messages.
+ */
+typedef struct ubirch_batch {
+    unsigned char *buf;                 //!< the messages
+    size_t size;                        //!< the allocated size of the buffer
+    size_t len;                         //!< the length of the messages (and the message being built)
+    ubirch_batch_entry *entries;        //!< the messages in the buffer
+    size_t count;                       //!< the number of messages
+    size_t capacity;                    //!< the allocated number of entries
+    ubirch_protocol *proto;             //!< the context of the message being built (NULL if none)
+    size_t start;                       //!< the start of the message being built
+    int error;                          //!< a write of the message being built failed
+} ubirch_batch;
+
+/**
+ * Create an empty batch.
+ * @param size the initial size of the buffer
+ * @param count the initial number of messages
+ * @return the batch
+ * @return NULL if out of memory
+ */
+ubirch_batch *ubirch_batch_new(size_t size, size_t count);
+
+/**
+ * Free a batch.
+ * @param batch the batch
+ */
+void ubirch_batch_free(ubirch_batch *batch);
+
+/**
+ * Remove all messages, the memory is kept.
+ * @param batch the batch
+ */
+void ubirch_batch_clear(ubirch_batch *batch);
+
+/**
+ * Start a message of a context. The context must not be used for other messages
+ * until the message is finished, for chained messages the signature is kept in
+ * the context as with #ubirch_protocol_encode.
+ * @param batch the batch
+ * @param proto the ubirch protocol context
+ * @return 0 if successful
+ * @return -1 if proto is NULL
+ * @return -2 if a message was started and not finished
+ * @return -3 if the protocol version is not supported
+ * @return -6 if out of memory
+ */
+int ubirch_batch_start(ubirch_batch *batch, ubirch_protocol *proto);
+
+/**
+ * The msgpack writer of a batch, used to pack the payload of a started message.
+ * @param data the batch
+ * @param buf the data to write
+ * @param len the length of the data
+ * @return 0 if successful
+ * @return -1 if out of memory
+ */
+int ubirch_batch_write(void *data, const char *buf, size_t len);
+
+/**
+ * Finish the started message (sign it and add it to the batch).
+ * @param batch the batch
+ * @return 0 if successful
+ * @return the error of #ubirch_protocol_encode
+ * @return -6 if out of memory
+ */
+int ubirch_batch_finish(ubirch_batch *batch);
+
+/**
+ * Add a message with an already encoded payload.
+ * @param batch the batch
+ * @param proto the ubirch protocol context
+ * @param payload the msgpack encoded payload
+ * @param payload_len the length of the payload
+ * @return 0 if successful
+ * @return the error of #ubirch_batch_start or #ubirch_batch_finish
+ */
+int ubirch_batch_add(ubirch_batch *batch, ubirch_protocol *proto, const unsigned char *payload, size_t payload_len);
+
+/**
+ * Write all finished messages with a single call of the writer and remove them
+ * from the batch. A started message is kept.
+ * @param batch the batch
+ * @param writer the writer (i.e. msgpack_sbuffer_write or a network send function)
+ * @param data the data passed to the writer
+ * @return 0 if successful (or the batch is empty)
+ * @return the error of the writer, the batch is kept then
+ */
+int ubirch_batch_flush(ubirch_batch *batch, msgpack_packer_write writer, void *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UBIRCH_PROTOCOL_BATCH_H
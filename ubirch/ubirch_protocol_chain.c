@@ -0,0 +1,244 @@
+/*!
+ * @file
+ * @brief ubirch protocol chain state store
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "ubirch_protocol_chain.h"
+
+uint32_t ubirch_chain_hash(const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]) {
+    uint64_t a, b;
+    memcpy(&a, uuid, 8);
+    memcpy(&b, uuid + 8, 8);
+    uint64_t h = (a ^ (b * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+    // 0 marks an empty slot
+    return (uint32_t) h ? (uint32_t) h : 1;
+}
+
+static ubirch_chain_shard *ubirch_chain_select(const ubirch_chain_store *store, uint32_t hash) {
+    return &store->shards[(uint32_t) (((uint64_t) hash * store->shard_count) >> 32)];
+}
+
+/**
+ * Allocate the arrays of a shard in one block.
+ */
+static int ubirch_chain_alloc(ubirch_chain_shard *shard, size_t capacity) {
+    unsigned char *block = (unsigned char *) calloc(capacity, UBIRCH_PROTOCOL_SIGN_SIZE + UBIRCH_PROTOCOL_UUID_SIZE +
+                                                              sizeof(uint32_t) + sizeof(unsigned int));
+    if (!block) return -1;
+
+    shard->signatures = (unsigned char (*)[UBIRCH_PROTOCOL_SIGN_SIZE]) block;
+    shard->uuids = (unsigned char (*)[UBIRCH_PROTOCOL_UUID_SIZE]) (block + capacity * UBIRCH_PROTOCOL_SIGN_SIZE);
+    shard->hashes = (uint32_t *) (block + capacity * (UBIRCH_PROTOCOL_SIGN_SIZE + UBIRCH_PROTOCOL_UUID_SIZE));
+    shard->types = (unsigned int *) (shard->hashes + capacity);
+    shard->capacity = capacity;
+    shard->count = 0;
+
+    return 0;
+}
+
+/**
+ * Find the slot of a uuid.
+ * @return the slot index, or the empty slot where it would be inserted (hashes[i] == 0)
+ */
+static size_t ubirch_chain_find(const ubirch_chain_shard *shard, uint32_t hash,
+                                const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]) {
+    const size_t mask = shard->capacity - 1;
+    size_t i = hash & mask;
+    while (shard->hashes[i] != 0) {
+        if (shard->hashes[i] == hash && !memcmp(shard->uuids[i], uuid, UBIRCH_PROTOCOL_UUID_SIZE)) break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/**
+ * Double the capacity of a shard.
+ */
+static int ubirch_chain_grow(ubirch_chain_shard *shard) {
+    ubirch_chain_shard old = *shard;
+    if (ubirch_chain_alloc(shard, old.capacity * 2)) {
+        *shard = old;
+        return -1;
+    }
+
+    for (size_t j = 0; j < old.capacity; j++) {
+        if (old.hashes[j] == 0) continue;
+        const size_t i = ubirch_chain_find(shard, old.hashes[j], old.uuids[j]);
+        shard->hashes[i] = old.hashes[j];
+        shard->types[i] = old.types[j];
+        memcpy(shard->uuids[i], old.uuids[j], UBIRCH_PROTOCOL_UUID_SIZE);
+        memcpy(shard->signatures[i], old.signatures[j], UBIRCH_PROTOCOL_SIGN_SIZE);
+    }
+    shard->count = old.count;
+    free(old.signatures);
+
+    return 0;
+}
+
+ubirch_chain_store *ubirch_chain_store_new(unsigned int shard_count, size_t capacity) {
+    if (shard_count == 0) return NULL;
+
+    ubirch_chain_store *store = (ubirch_chain_store *) calloc(1, sizeof(ubirch_chain_store) +
+                                                                 shard_count * sizeof(ubirch_chain_shard));
+    if (!store) { return NULL; }
+    store->shards = (ubirch_chain_shard *) (store + 1);
+    store->shard_count = shard_count;
+
+    // keep the load below 3/4 for the expected number of devices
+    size_t shard_capacity = UBIRCH_CHAIN_MIN_CAPACITY;
+    while (shard_capacity * 3 / 4 < capacity / shard_count + 1) shard_capacity *= 2;
+
+    for (unsigned int i = 0; i < shard_count; i++) {
+        if (ubirch_chain_alloc(&store->shards[i], shard_capacity)) {
+            ubirch_chain_store_free(store);
+            return NULL;
+        }
+    }
+
+    return store;
+}
+
+void ubirch_chain_store_free(ubirch_chain_store *store) {
+    if (store == NULL) return;
+    for (unsigned int i = 0; i < store->shard_count; i++) {
+        free(store->shards[i].signatures);
+    }
+    free(store);
+}
+
+unsigned int ubirch_chain_shard_index(const ubirch_chain_store *store, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]) {
+    return (unsigned int) (ubirch_chain_select(store, ubirch_chain_hash(uuid)) - store->shards);
+}
+
+size_t ubirch_chain_count(const ubirch_chain_store *store) {
+    size_t count = 0;
+    for (unsigned int i = 0; i < store->shard_count; i++) {
+        count += store->shards[i].count;
+    }
+    return count;
+}
+
+int ubirch_chain_put(ubirch_chain_store *store, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE],
+                     unsigned int type, const unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]) {
+    const uint32_t hash = ubirch_chain_hash(uuid);
+    ubirch_chain_shard *shard = ubirch_chain_select(store, hash);
+
+    size_t i = ubirch_chain_find(shard, hash, uuid);
+    if (shard->hashes[i] == 0) {
+        if ((shard->count + 1) * 4 > shard->capacity * 3) {
+            if (ubirch_chain_grow(shard)) return -1;
+            i = ubirch_chain_find(shard, hash, uuid);
+        }
+        shard->hashes[i] = hash;
+        memcpy(shard->uuids[i], uuid, UBIRCH_PROTOCOL_UUID_SIZE);
+        shard->count++;
+    }
+    shard->types[i] = type;
+    if (signature != NULL) {
+        memcpy(shard->signatures[i], signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+    } else {
+        memset(shard->signatures[i], 0, UBIRCH_PROTOCOL_SIGN_SIZE);
+    }
+
+    return 0;
+}
+
+int ubirch_chain_get(const ubirch_chain_store *store, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE],
+                     unsigned int *type, unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]) {
+    const uint32_t hash = ubirch_chain_hash(uuid);
+    const ubirch_chain_shard *shard = ubirch_chain_select(store, hash);
+
+    const size_t i = ubirch_chain_find(shard, hash, uuid);
+    if (shard->hashes[i] == 0) return -1;
+    if (type != NULL) *type = shard->types[i];
+    if (signature != NULL) memcpy(signature, shard->signatures[i], UBIRCH_PROTOCOL_SIGN_SIZE);
+
+    return 0;
+}
+
+int ubirch_chain_remove(ubirch_chain_store *store, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]) {
+    const uint32_t hash = ubirch_chain_hash(uuid);
+    ubirch_chain_shard *shard = ubirch_chain_select(store, hash);
+    const size_t mask = shard->capacity - 1;
+
+    size_t i = ubirch_chain_find(shard, hash, uuid);
+    if (shard->hashes[i] == 0) return -1;
+
+    // shift following records back into the gap, so lookups need no tombstones
+    for (size_t j = (i + 1) & mask; shard->hashes[j] != 0; j = (j + 1) & mask) {
+        const size_t home = shard->hashes[j] & mask;
+        // move j into the gap at i, unless its home slot lies cyclically in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            shard->hashes[i] = shard->hashes[j];
+            shard->types[i] = shard->types[j];
+            memcpy(shard->uuids[i], shard->uuids[j], UBIRCH_PROTOCOL_UUID_SIZE);
+            memcpy(shard->signatures[i], shard->signatures[j], UBIRCH_PROTOCOL_SIGN_SIZE);
+            i = j;
+        }
+    }
+    shard->hashes[i] = 0;
+    shard->count--;
+
+    return 0;
+}
+
+void ubirch_chain_switch(ubirch_protocol *proto, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE],
+                         unsigned int type, const unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]) {
+    // the header is re-encoded only if the device or type changes
+    if (proto->type != type || memcmp(proto->uuid, uuid, UBIRCH_PROTOCOL_UUID_SIZE) != 0) {
+        proto->type = type;
+        memcpy(proto->uuid, uuid, UBIRCH_PROTOCOL_UUID_SIZE);
+        ubirch_protocol_header_render(proto);
+    }
+    memcpy(proto->signature, signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+}
+
+int ubirch_chain_start(const ubirch_chain_store *store, ubirch_protocol *proto, msgpack_packer *pk,
+                       const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]) {
+    if (proto == NULL || pk == NULL) return -1;
+    if (proto->version != proto_chained) return -6;
+    // switching a busy context would finish its message as another device
+    if (proto->status != UBIRCH_PROTOCOL_INITIALIZED) return -2;
+
+    const uint32_t hash = ubirch_chain_hash(uuid);
+    const ubirch_chain_shard *shard = ubirch_chain_select(store, hash);
+    const size_t i = ubirch_chain_find(shard, hash, uuid);
+    if (shard->hashes[i] == 0) return -5;
+
+    ubirch_chain_switch(proto, uuid, shard->types[i], shard->signatures[i]);
+    return ubirch_protocol_start(proto, pk);
+}
+
+int ubirch_chain_finish(ubirch_chain_store *store, ubirch_protocol *proto, msgpack_packer *pk) {
+    if (proto == NULL || pk == NULL) return -1;
+
+    // look the device up before the message is emitted and chained
+    const uint32_t hash = ubirch_chain_hash(proto->uuid);
+    ubirch_chain_shard *shard = ubirch_chain_select(store, hash);
+    const size_t i = ubirch_chain_find(shard, hash, proto->uuid);
+    if (shard->hashes[i] == 0) return -5;
+
+    const int ret = ubirch_protocol_finish(proto, pk);
+    if (ret) return ret;
+    memcpy(shard->signatures[i], proto->signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+/*!
+ * @file
+ * @brief ubirch protocol chain state store
+ *
+ * A gateway that creates chained messages for many devices only needs to keep
+ * the last signature (and the payload type) of each device between messages,
+ * not a complete protocol context with its hash state. The store keeps these
+ * records in open addressing hash tables (linear probing), with the hashes,
+ * types, uuids and signatures in separate arrays, so probing only touches the
+ * compact hash array. Messages are created with a few working contexts, which
+ * are switched to a device by #ubirch_chain_start.
+ *
+ * The records are split into shards by uuid, each shard grows on its own. The
+ * store is not synchronized: the application must not use a shard from two
+ * threads at the same time (i.e. one lock or one thread per shard, see
+ * #ubirch_chain_shard_index).
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef UBIRCH_PROTOCOL_CHAIN_H
+#define UBIRCH_PROTOCOL_CHAIN_H
+
+#include <stdint.h>
+#include "ubirch_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UBIRCH_CHAIN_MIN_CAPACITY 16    //!< the initial number of slots of a shard
+
+/**
+ * One shard of the chain state store. Slot i is used if hashes[i] != 0.
+ */
+typedef struct ubirch_chain_shard {
+    uint32_t *hashes;                                   //!< the uuid hashes (never 0 for used slots)
+    unsigned int *types;                                //!< the payload types
+    unsigned char (*uuids)[UBIRCH_PROTOCOL_UUID_SIZE];  //!< the device uuids
+    unsigned char (*signatures)[UBIRCH_PROTOCOL_SIGN_SIZE]; //!< the last signatures
+    size_t capacity;                                    //!< the number of slots (a power of two)
+    size_t count;                                       //!< the number of used slots
+} ubirch_chain_shard;
+
+/**
+ * The chain state store.
+ */
+typedef struct ubirch_chain_store {
+    ubirch_chain_shard *shards;                         //!< the shards
+    unsigned int shard_count;                           //!< the number of shards
+} ubirch_chain_store;
+
+/**
+ * Hash a uuid. UUIDs are mostly random, but some devices use counters or text,
+ * so all bytes are mixed. The upper bits select the shard, the lower bits the slot.
+ * @param uuid the device uuid
+ * @return the hash, never 0
+ */
+uint32_t ubirch_chain_hash(const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]);
+
+/**
+ * Create a new chain state store.
+ * @param shard_count the number of shards
+ * @param capacity the expected number of devices, to avoid growing the shards
+ * @return a new store
+ * @return NULL if out of memory
+ */
+ubirch_chain_store *ubirch_chain_store_new(unsigned int shard_count, size_t capacity);
+
+/**
+ * Free a chain state store.
+ * @param store the store
+ */
+void ubirch_chain_store_free(ubirch_chain_store *store);
+
+/**
+ * The shard of a device, to select the lock or thread responsible for it.
+ * @param store the store
+ * @param uuid the device uuid
+ * @return the shard index
+ */
+unsigned int ubirch_chain_shard_index(const ubirch_chain_store *store, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]);
+
+/**
+ * The number of devices in the store.
+ */
+size_t ubirch_chain_count(const ubirch_chain_store *store);
+
+/**
+ * Add a device or update its record.
+ * @param store the store
+ * @param uuid the device uuid
+ * @param type the payload type of its messages
+ * @param signature the last signature, or NULL to start a new chain (all zero)
+ * @return 0 if successful
+ * @return -1 if out of memory
+ */
+int ubirch_chain_put(ubirch_chain_store *store, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE],
+                     unsigned int type, const unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]);
+
+/**
+ * Get the record of a device.
+ * @param store the store
+ * @param uuid the device uuid
+ * @param type the payload type (may be NULL)
+ * @param signature the last signature (may be NULL)
+ * @return 0 if successful
+ * @return -1 if the device is unknown
+ */
+int ubirch_chain_get(const ubirch_chain_store *store, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE],
+                     unsigned int *type, unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]);
+
+/**
+ * Remove a device.
+ * @param store the store
+ * @param uuid the device uuid
+ * @return 0 if successful
+ * @return -1 if the device is unknown
+ */
+int ubirch_chain_remove(ubirch_chain_store *store, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]);
+
+/**
+ * Switch a working context to a device, keeping its writer and signer.
+ * @param proto the working context (proto_chained)
+ * @param uuid the device uuid
+ * @param type the payload type
+ * @param signature the previous signature of the device
+ */
+void ubirch_chain_switch(ubirch_protocol *proto, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE],
+                         unsigned int type, const unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]);
+
+/**
+ * Start a chained message for a device with a working context. The context must
+ * be initialized as proto_chained (with any uuid), its writer and signer are kept,
+ * uuid, payload type and previous signature are taken from the store.
+ *
+ * @param store the store
+ * @param proto the working context
+ * @param pk the msgpack packer of the working context
+ * @param uuid the device uuid
+ * @return 0 if successful
+ * @return -2 if the context has a message in flight (it is left unchanged)
+ * @return the error of #ubirch_protocol_start
+ * @return -5 if the device is unknown
+ * @return -6 if the context is not a chained context
+ */
+int ubirch_chain_start(const ubirch_chain_store *store, ubirch_protocol *proto, msgpack_packer *pk,
+                       const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]);
+
+/**
+ * Finish a message started with #ubirch_chain_start and keep its signature as the
+ * last signature of the device.
+ *
+ * @param store the store
+ * @param proto the working context
+ * @param pk the msgpack packer of the working context
+ * @return 0 if successful
+ * @return -1 if proto or pk is NULL
+ * @return the error of #ubirch_protocol_finish
+ * @return -5 if the device was removed in the meantime (nothing is written then)
+ */
+int ubirch_chain_finish(ubirch_chain_store *store, ubirch_protocol *proto, msgpack_packer *pk);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UBIRCH_PROTOCOL_CHAIN_H
@@ -0,0 +1,264 @@
+/*!
+ * @file
+ * @brief ubirch protocol persistent chain state
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+#include "ubirch_protocol_chain_file.h"
+
+#ifdef UBIRCH_CHAIN_FILE
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Flush the pages of a memory range to disk.
+ */
+static int ubirch_chain_file_flush(const ubirch_chain_file *file, const void *p, size_t len) {
+    if (!file->durable) return 0;
+
+    const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t offset = (size_t) ((const unsigned char *) p - file->map);
+    const size_t start = offset & ~(page - 1);
+    return msync(file->map + start, offset + len - start, MS_SYNC) ? -1 : 0;
+}
+
+/**
+ * Find the record of a uuid, or the empty record where it would be inserted.
+ */
+static ubirch_chain_record *ubirch_chain_file_find(const ubirch_chain_file *file, uint32_t hash,
+                                                   const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]) {
+    const size_t mask = (size_t) file->header->capacity - 1;
+    size_t i = hash & mask;
+    while (file->records[i].hash != 0) {
+        if (file->records[i].hash == hash && !memcmp(file->records[i].uuid, uuid, UBIRCH_PROTOCOL_UUID_SIZE)) break;
+        i = (i + 1) & mask;
+    }
+    return &file->records[i];
+}
+
+/**
+ * Map an open file and check its header.
+ */
+static ubirch_chain_file *ubirch_chain_file_map(int fd, int durable) {
+    struct stat st;
+    if (fstat(fd, &st) || (size_t) st.st_size < sizeof(ubirch_chain_file_header)) return NULL;
+
+    unsigned char *map = (unsigned char *) mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) return NULL;
+
+    const ubirch_chain_file_header *header = (const ubirch_chain_file_header *) map;
+    const uint64_t capacity = header->capacity;
+    if (memcmp(header->magic, UBIRCH_CHAIN_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != UBIRCH_CHAIN_FILE_VERSION || header->record_size != sizeof(ubirch_chain_record) ||
+        capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        (uint64_t) st.st_size < sizeof(ubirch_chain_file_header) + capacity * sizeof(ubirch_chain_record)) {
+        munmap(map, (size_t) st.st_size);
+        return NULL;
+    }
+
+    ubirch_chain_file *file = (ubirch_chain_file *) calloc(1, sizeof(ubirch_chain_file));
+    if (!file) {
+        munmap(map, (size_t) st.st_size);
+        return NULL;
+    }
+    file->fd = fd;
+    file->map = map;
+    file->map_size = (size_t) st.st_size;
+    file->header = (ubirch_chain_file_header *) map;
+    file->records = (ubirch_chain_record *) (map + sizeof(ubirch_chain_file_header));
+    file->durable = durable;
+
+    return file;
+}
+
+/**
+ * Create an empty file with the given number of records. The records are not
+ * written, the file system allocates them when they are first used.
+ */
+static ubirch_chain_file *ubirch_chain_file_create(const char *path, uint64_t capacity, int durable) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return NULL;
+
+    ubirch_chain_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, UBIRCH_CHAIN_FILE_MAGIC, sizeof(header.magic));
+    header.version = UBIRCH_CHAIN_FILE_VERSION;
+    header.record_size = sizeof(ubirch_chain_record);
+    header.capacity = capacity;
+
+    ubirch_chain_file *file = NULL;
+    if (!ftruncate(fd, (off_t) (sizeof(header) + capacity * sizeof(ubirch_chain_record))) &&
+        pwrite(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header)) {
+        file = ubirch_chain_file_map(fd, durable);
+    }
+    if (!file) close(fd);
+
+    return file;
+}
+
+/**
+ * Rebuild a file with a larger capacity, replacing the original when complete.
+ */
+static ubirch_chain_file *ubirch_chain_file_grow(ubirch_chain_file *file, const char *path, uint64_t capacity) {
+    char *tmp = (char *) malloc(strlen(path) + 5);
+    if (!tmp) return NULL;
+    strcpy(tmp, path);
+    strcat(tmp, ".tmp");
+
+    ubirch_chain_file *grown = ubirch_chain_file_create(tmp, capacity, file->durable);
+    if (grown) {
+        for (uint64_t j = 0; j < file->header->capacity; j++) {
+            const ubirch_chain_record *record = &file->records[j];
+            if (record->hash == 0) continue;
+            *ubirch_chain_file_find(grown, record->hash, record->uuid) = *record;
+            grown->header->count++;
+        }
+        // the new file must be complete on disk before it replaces the old one
+        if (msync(grown->map, grown->map_size, MS_SYNC) || fsync(grown->fd) || rename(tmp, path)) {
+            ubirch_chain_file_close(grown);
+            unlink(tmp);
+            grown = NULL;
+        }
+    }
+    free(tmp);
+
+    return grown;
+}
+
+ubirch_chain_file *ubirch_chain_file_open(const char *path, size_t capacity, int durable) {
+    // keep the load below 3/4
+    uint64_t slots = UBIRCH_CHAIN_MIN_CAPACITY;
+    while (slots * 3 / 4 < (uint64_t) capacity + 1) slots *= 2;
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0) return ubirch_chain_file_create(path, slots, durable);
+
+    ubirch_chain_file *file = ubirch_chain_file_map(fd, durable);
+    if (!file) {
+        close(fd);
+        return NULL;
+    }
+    if (file->header->capacity < slots) {
+        ubirch_chain_file *grown = ubirch_chain_file_grow(file, path, slots);
+        ubirch_chain_file_close(file);
+        file = grown;
+    }
+
+    return file;
+}
+
+void ubirch_chain_file_close(ubirch_chain_file *file) {
+    if (file == NULL) return;
+    munmap(file->map, file->map_size);
+    close(file->fd);
+    free(file);
+}
+
+int ubirch_chain_file_sync(ubirch_chain_file *file) {
+    return msync(file->map, file->map_size, MS_SYNC) ? -1 : 0;
+}
+
+/**
+ * Update the record of a known device: write the unused slot, then switch to it.
+ */
+static int ubirch_chain_file_update(ubirch_chain_file *file, ubirch_chain_record *record,
+                                    unsigned int type, const unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]) {
+    const uint64_t seq = record->seq + 1;
+    memcpy(record->signatures[seq & 1], signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+    if (ubirch_chain_file_flush(file, record->signatures[seq & 1], UBIRCH_PROTOCOL_SIGN_SIZE)) return -2;
+    record->type = type;
+    __atomic_store_n(&record->seq, seq, __ATOMIC_RELEASE);
+    if (ubirch_chain_file_flush(file, record, offsetof(ubirch_chain_record, uuid))) return -2;
+
+    return 0;
+}
+
+int ubirch_chain_file_put(ubirch_chain_file *file, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE],
+                          unsigned int type, const unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]) {
+    static const unsigned char zero[UBIRCH_PROTOCOL_SIGN_SIZE] = {0};
+    if (signature == NULL) signature = zero;
+
+    const uint32_t hash = ubirch_chain_hash(uuid);
+    ubirch_chain_record *record = ubirch_chain_file_find(file, hash, uuid);
+
+    if (record->hash == 0) {
+        if ((file->header->count + 1) * 4 > file->header->capacity * 3) return -1;
+
+        // fill the record, it becomes visible when the hash is set
+        record->type = type;
+        record->seq = 0;
+        memcpy(record->uuid, uuid, UBIRCH_PROTOCOL_UUID_SIZE);
+        memcpy(record->signatures[0], signature, UBIRCH_PROTOCOL_SIGN_SIZE);
+        if (ubirch_chain_file_flush(file, record, sizeof(*record))) return -2;
+        __atomic_store_n(&record->hash, hash, __ATOMIC_RELEASE);
+        file->header->count++;
+        if (ubirch_chain_file_flush(file, record, sizeof(record->hash)) ||
+            ubirch_chain_file_flush(file, &file->header->count, sizeof(file->header->count))) {
+            return -2;
+        }
+        return 0;
+    }
+
+    return ubirch_chain_file_update(file, record, type, signature);
+}
+
+int ubirch_chain_file_get(const ubirch_chain_file *file, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE],
+                          unsigned int *type, unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]) {
+    const ubirch_chain_record *record = ubirch_chain_file_find(file, ubirch_chain_hash(uuid), uuid);
+    if (record->hash == 0) return -1;
+
+    if (type != NULL) *type = record->type;
+    if (signature != NULL) memcpy(signature, record->signatures[record->seq & 1], UBIRCH_PROTOCOL_SIGN_SIZE);
+
+    return 0;
+}
+
+int ubirch_chain_file_start(const ubirch_chain_file *file, ubirch_protocol *proto, msgpack_packer *pk,
+                            const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]) {
+    if (proto == NULL || pk == NULL) return -1;
+    if (proto->version != proto_chained) return -6;
+    // switching a busy context would finish its message as another device
+    if (proto->status != UBIRCH_PROTOCOL_INITIALIZED) return -2;
+
+    const ubirch_chain_record *record = ubirch_chain_file_find(file, ubirch_chain_hash(uuid), uuid);
+    if (record->hash == 0) return -5;
+
+    ubirch_chain_switch(proto, uuid, record->type, record->signatures[record->seq & 1]);
+    return ubirch_protocol_start(proto, pk);
+}
+
+int ubirch_chain_file_finish(ubirch_chain_file *file, ubirch_protocol *proto, msgpack_packer *pk) {
+    if (proto == NULL || pk == NULL) return -1;
+
+    // look the device up before the message is emitted and chained
+    ubirch_chain_record *record = ubirch_chain_file_find(file, ubirch_chain_hash(proto->uuid), proto->uuid);
+    if (record->hash == 0) return -5;
+
+    const int ret = ubirch_protocol_finish(proto, pk);
+    if (ret) return ret;
+
+    return ubirch_chain_file_update(file, record, proto->type, proto->signature) ? -6 : 0;
+}
+
+#endif // UBIRCH_CHAIN_FILE
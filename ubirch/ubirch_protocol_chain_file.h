@@ -0,0 +1,162 @@
+/*!
+ * @file
+ * @brief ubirch protocol persistent chain state
+ *
+ * Keeps the last signature of each device in a memory mapped file, so chains
+ * continue after a restart. The file is an open addressing hash table of
+ * fixed size records (linear probing, like #ubirch_chain_store). Opening it
+ * only maps the file, records are read from disk when they are first used.
+ *
+ * Each record has two signature slots and a sequence number selecting the
+ * current one. An update writes the other slot first and then switches the
+ * sequence number with a single aligned store, so a crash at any point leaves
+ * either the old or the new signature. With the durable flag, both steps are
+ * also flushed to disk (msync) before continuing, which survives power loss.
+ *
+ * Only available on POSIX systems (UBIRCH_CHAIN_FILE is defined then). The
+ * file is not synchronized, use it from one thread (or with a lock).
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef UBIRCH_PROTOCOL_CHAIN_FILE_H
+#define UBIRCH_PROTOCOL_CHAIN_FILE_H
+
+#include "ubirch_protocol_chain.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define UBIRCH_CHAIN_FILE       //!< persistent chain state is available
+#endif
+
+#ifdef UBIRCH_CHAIN_FILE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UBIRCH_CHAIN_FILE_MAGIC     "UBCHAIN"   //!< file magic (8 bytes, including the terminating 0)
+#define UBIRCH_CHAIN_FILE_VERSION   1           //!< file format version
+
+/**
+ * The file header.
+ */
+typedef struct ubirch_chain_file_header {
+    char magic[8];                                      //!< #UBIRCH_CHAIN_FILE_MAGIC
+    uint32_t version;                                   //!< #UBIRCH_CHAIN_FILE_VERSION
+    uint32_t record_size;                               //!< sizeof(ubirch_chain_record)
+    uint64_t capacity;                                  //!< the number of records (a power of two)
+    uint64_t count;                                     //!< the number of used records
+    unsigned char reserved[32];                         //!< reserved, 0
+} ubirch_chain_file_header;
+
+/**
+ * A device record, used if hash != 0.
+ */
+typedef struct ubirch_chain_record {
+    uint32_t hash;                                      //!< the uuid hash, see #ubirch_chain_hash
+    uint32_t type;                                      //!< the payload type
+    uint64_t seq;                                       //!< the number of updates, signatures[seq & 1] is current
+    unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE];      //!< the device uuid
+    unsigned char signatures[2][UBIRCH_PROTOCOL_SIGN_SIZE]; //!< the current and the previous signature
+} ubirch_chain_record;
+
+/**
+ * An open chain state file.
+ */
+typedef struct ubirch_chain_file {
+    int fd;                                             //!< the file descriptor
+    unsigned char *map;                                 //!< the mapped file
+    size_t map_size;                                    //!< the size of the mapping
+    ubirch_chain_file_header *header;                   //!< the file header
+    ubirch_chain_record *records;                       //!< the records following the header
+    int durable;                                        //!< flush every update to disk
+} ubirch_chain_file;
+
+/**
+ * Open or create a chain state file. A file that is too small for the expected
+ * number of devices is rebuilt with a larger capacity (replaced atomically).
+ *
+ * @param path the file name
+ * @param capacity the expected number of devices
+ * @param durable flush every update to disk, not only to the page cache
+ * @return the open file
+ * @return NULL if the file can not be opened, is not a chain state file or out of memory
+ */
+ubirch_chain_file *ubirch_chain_file_open(const char *path, size_t capacity, int durable);
+
+/**
+ * Close a chain state file (unmap, the kernel writes outstanding pages).
+ * @param file the chain state file
+ */
+void ubirch_chain_file_close(ubirch_chain_file *file);
+
+/**
+ * Flush all changes to disk.
+ * @param file the chain state file
+ * @return 0 if successful
+ * @return -1 if msync failed
+ */
+int ubirch_chain_file_sync(ubirch_chain_file *file);
+
+/**
+ * Add a device or update its record.
+ * @param file the chain state file
+ * @param uuid the device uuid
+ * @param type the payload type of its messages
+ * @param signature the last signature, or NULL for a new chain (all zero)
+ * @return 0 if successful
+ * @return -1 if the file is full (open it with a larger capacity)
+ * @return -2 if flushing to disk failed
+ */
+int ubirch_chain_file_put(ubirch_chain_file *file, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE],
+                          unsigned int type, const unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]);
+
+/**
+ * Get the record of a device.
+ * @param file the chain state file
+ * @param uuid the device uuid
+ * @param type the payload type (may be NULL)
+ * @param signature the last signature (may be NULL)
+ * @return 0 if successful
+ * @return -1 if the device is unknown
+ */
+int ubirch_chain_file_get(const ubirch_chain_file *file, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE],
+                          unsigned int *type, unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]);
+
+/**
+ * Start a chained message for a device, see #ubirch_chain_start.
+ */
+int ubirch_chain_file_start(const ubirch_chain_file *file, ubirch_protocol *proto, msgpack_packer *pk,
+                            const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]);
+
+/**
+ * Finish a message started with #ubirch_chain_file_start and persist its signature.
+ * @return 0 if successful
+ * @return -1 if proto or pk is NULL
+ * @return the error of #ubirch_protocol_finish
+ * @return -5 if the device is unknown (nothing is written then)
+ * @return -6 if flushing to disk failed
+ */
+int ubirch_chain_file_finish(ubirch_chain_file *file, ubirch_protocol *proto, msgpack_packer *pk);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UBIRCH_CHAIN_FILE
+
+#endif // UBIRCH_PROTOCOL_CHAIN_FILE_H
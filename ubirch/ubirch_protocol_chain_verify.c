@@ -0,0 +1,100 @@
+/*!
+ * @file
+ * @brief ubirch protocol chain verification
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+#include <string.h>
+#include "ubirch_protocol_chain_verify.h"
+#include "ubirch_protocol_view.h"
+
+void ubirch_chain_verifier_init(ubirch_chain_verifier *verifier, const unsigned char *const messages[],
+                                const size_t sizes[], size_t count, void *key,
+                                ubirch_protocol_check_batch verify_batch, ubirch_protocol_check_ctx verify,
+                                int results[]) {
+    verifier->messages = messages;
+    verifier->sizes = sizes;
+    verifier->count = count;
+    verifier->key = key;
+    verifier->verify_batch = verify_batch;
+    verifier->verify = verify;
+    verifier->results = results;
+    verifier->next = 0;
+}
+
+size_t ubirch_chain_verifier_run(ubirch_chain_verifier *verifier) {
+    void *keys[UBIRCH_PROTOCOL_VERIFY_BATCH];
+    for (size_t i = 0; i < UBIRCH_PROTOCOL_VERIFY_BATCH; i++) keys[i] = verifier->key;
+
+    size_t verified = 0;
+    for (;;) {
+        const size_t offset = __atomic_fetch_add(&verifier->next, UBIRCH_PROTOCOL_VERIFY_BATCH, __ATOMIC_RELAXED);
+        if (offset >= verifier->count) break;
+
+        const size_t n = verifier->count - offset < UBIRCH_PROTOCOL_VERIFY_BATCH
+                         ? verifier->count - offset : UBIRCH_PROTOCOL_VERIFY_BATCH;
+        ubirch_protocol_verify_batch(verifier->messages + offset, verifier->sizes + offset, keys, n,
+                                     verifier->verify_batch, verifier->verify, verifier->results + offset);
+        verified += n;
+    }
+
+    return verified;
+}
+
+int ubirch_chain_verifier_finish(const ubirch_chain_verifier *verifier,
+                                 const unsigned char previous[UBIRCH_PROTOCOL_SIGN_SIZE], size_t *index) {
+    ubirch_protocol_view view;
+    const unsigned char *uuid = NULL;
+    const unsigned char *last = previous;
+    int ret = UBIRCH_CHAIN_VALID;
+    size_t i;
+
+    for (i = 0; i < verifier->count; i++) {
+        const size_t size = verifier->sizes[i];
+
+        // a chained message of the device, with the signature where it was verified
+        if (ubirch_protocol_parse(verifier->messages[i], size, &view) || view.len != size ||
+            view.previous == NULL || view.signed_len != size - UBIRCH_PROTOCOL_SIGN_FIELD_SIZE ||
+            (uuid != NULL && memcmp(uuid, view.uuid, UBIRCH_PROTOCOL_UUID_SIZE) != 0)) {
+            ret = UBIRCH_CHAIN_MALFORMED;
+            break;
+        }
+        if (verifier->results[i]) {
+            ret = UBIRCH_CHAIN_SIGNATURE;
+            break;
+        }
+
+        if (last != NULL && memcmp(view.previous, last, UBIRCH_PROTOCOL_SIGN_SIZE) != 0) {
+            // linking to an earlier message makes a second branch of the chain
+            ret = UBIRCH_CHAIN_BROKEN;
+            for (size_t j = i > 1 ? i - 1 : 0; j-- > 0;) {
+                const unsigned char *signature = verifier->messages[j] + verifier->sizes[j] - UBIRCH_PROTOCOL_SIGN_SIZE;
+                if (!memcmp(view.previous, signature, UBIRCH_PROTOCOL_SIGN_SIZE)) {
+                    ret = UBIRCH_CHAIN_FORK;
+                    break;
+                }
+            }
+            break;
+        }
+
+        uuid = view.uuid;
+        last = view.signature;
+    }
+
+    if (index != NULL) *index = i;
+    return ret;
+}
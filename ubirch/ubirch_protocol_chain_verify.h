@@ -0,0 +1,112 @@
+/*!
+ * @file
+ * @brief ubirch protocol chain verification
+ *
+ * Verifies a complete chain of messages of one device: the signature of every
+ * message and the link of every message to its predecessor (its previous
+ * signature is the signature of the message before it).
+ *
+ * The signatures are independent of each other and are checked in parallel:
+ * the application calls #ubirch_chain_verifier_run from as many threads as it
+ * likes, each of them takes batches of #UBIRCH_PROTOCOL_VERIFY_BATCH messages
+ * and verifies them with #ubirch_protocol_verify_batch. Once all threads have
+ * returned, #ubirch_chain_verifier_finish checks the links in one cheap pass
+ * over the parsed envelopes and reports the first problem in the chain.
+ *
+ * ```
+ * ubirch_chain_verifier verifier;
+ * ubirch_chain_verifier_init(&verifier, messages, sizes, count, public_key,
+ *                            ed25519_verify_batch_ctx, ed25519_verify_ctx, results);
+ * // in each thread
+ * ubirch_chain_verifier_run(&verifier);
+ * // after joining the threads
+ * int ret = ubirch_chain_verifier_finish(&verifier, NULL, &index);
+ * ```
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef UBIRCH_PROTOCOL_CHAIN_VERIFY_H
+#define UBIRCH_PROTOCOL_CHAIN_VERIFY_H
+
+#include "ubirch_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UBIRCH_CHAIN_VALID      0       //!< all signatures and links are valid
+#define UBIRCH_CHAIN_SIGNATURE  -1      //!< a signature is invalid
+#define UBIRCH_CHAIN_MALFORMED  -2      //!< a message is not a chained message of the device
+#define UBIRCH_CHAIN_BROKEN     -3      //!< a message does not link to its predecessor
+#define UBIRCH_CHAIN_FORK       -4      //!< a message links to an earlier message than its predecessor
+
+/**
+ * A chain verification.
+ */
+typedef struct ubirch_chain_verifier {
+    const unsigned char *const *messages;               //!< the messages, in chain order
+    const size_t *sizes;                                //!< the sizes of the messages
+    size_t count;                                       //!< the number of messages
+    void *key;                                          //!< the key handle of the device (i.e. the public key)
+    ubirch_protocol_check_batch verify_batch;           //!< the batch verification function (may be NULL)
+    ubirch_protocol_check_ctx verify;                   //!< the per message verification function
+    int *results;                                       //!< the signature check result of each message
+    size_t next;                                        //!< the first message not yet taken by a thread
+} ubirch_chain_verifier;
+
+/**
+ * Prepare the verification of a chain. The messages must stay unchanged until
+ * #ubirch_chain_verifier_finish returned.
+ * @param verifier the verification
+ * @param messages the messages, in chain order
+ * @param sizes the sizes of the messages
+ * @param count the number of messages
+ * @param key the key handle of the device, passed to the verification functions
+ * @param verify_batch the batch verification function, or NULL to check each message
+ * @param verify the per message verification function
+ * @param results space for the signature check result of each message (count entries)
+ */
+void ubirch_chain_verifier_init(ubirch_chain_verifier *verifier, const unsigned char *const messages[],
+                                const size_t sizes[], size_t count, void *key,
+                                ubirch_protocol_check_batch verify_batch, ubirch_protocol_check_ctx verify,
+                                int results[]);
+
+/**
+ * Verify signatures until all messages are taken. Call it from any number of threads.
+ * @param verifier the verification
+ * @return the number of messages verified by this call
+ */
+size_t ubirch_chain_verifier_run(ubirch_chain_verifier *verifier);
+
+/**
+ * Check the links of the chain, after all calls to #ubirch_chain_verifier_run returned.
+ * @param verifier the verification
+ * @param previous the expected previous signature of the first message, or NULL to accept any
+ * @param index the index of the first invalid message, or the number of messages (output, may be NULL)
+ * @return #UBIRCH_CHAIN_VALID if the chain is valid
+ * @return #UBIRCH_CHAIN_SIGNATURE, #UBIRCH_CHAIN_MALFORMED, #UBIRCH_CHAIN_BROKEN or #UBIRCH_CHAIN_FORK
+ *         for the first invalid message
+ */
+int ubirch_chain_verifier_finish(const ubirch_chain_verifier *verifier,
+                                 const unsigned char previous[UBIRCH_PROTOCOL_SIGN_SIZE], size_t *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UBIRCH_PROTOCOL_CHAIN_VERIFY_H
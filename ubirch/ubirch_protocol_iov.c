@@ -0,0 +1,148 @@
+/*!
+ * @file
+ * @brief ubirch protocol scatter/gather sink
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "ubirch_protocol_iov.h"
+
+/**
+ * Add a segment, growing the segment tables if needed.
+ */
+static ubirch_iov_segment *ubirch_iov_segment_add(ubirch_iov_sink *sink) {
+    if (sink->count == sink->capacity) {
+        const size_t capacity = sink->capacity * 2;
+        ubirch_iov_segment *segments = (ubirch_iov_segment *) realloc(
+                sink->segments, capacity * sizeof(ubirch_iov_segment));
+        if (!segments) return NULL;
+        sink->segments = segments;
+        ubirch_iovec *iov = (ubirch_iovec *) realloc(sink->iov, capacity * sizeof(ubirch_iovec));
+        if (!iov) return NULL;
+        sink->iov = iov;
+        sink->capacity = capacity;
+    }
+
+    return &sink->segments[sink->count++];
+}
+
+ubirch_iov_sink *ubirch_iov_new(size_t size, size_t threshold) {
+    ubirch_iov_sink *sink = (ubirch_iov_sink *) calloc(1, sizeof(ubirch_iov_sink));
+    if (!sink) return NULL;
+
+    sink->size = size ? size : 1;
+    sink->threshold = threshold < UBIRCH_IOV_MIN_THRESHOLD ? UBIRCH_IOV_MIN_THRESHOLD : threshold;
+    sink->capacity = 8;
+    sink->buf = (char *) malloc(sink->size);
+    sink->segments = (ubirch_iov_segment *) malloc(sink->capacity * sizeof(ubirch_iov_segment));
+    sink->iov = (ubirch_iovec *) malloc(sink->capacity * sizeof(ubirch_iovec));
+    if (!sink->buf || !sink->segments || !sink->iov) {
+        ubirch_iov_free(sink);
+        return NULL;
+    }
+
+    return sink;
+}
+
+void ubirch_iov_free(ubirch_iov_sink *sink) {
+    if (sink == NULL) return;
+    free(sink->buf);
+    free(sink->segments);
+    free(sink->iov);
+    free(sink);
+}
+
+void ubirch_iov_reset(ubirch_iov_sink *sink) {
+    sink->len = 0;
+    sink->count = 0;
+    sink->signature = 0;
+    sink->split = 0;
+}
+
+int ubirch_iov_write(void *data, const char *buf, size_t len) {
+    ubirch_iov_sink *sink = (ubirch_iov_sink *) data;
+    if (len == 0) return 0;
+
+    // large writes are referenced, the data is still hashed by the context
+    if (len >= sink->threshold) {
+        ubirch_iov_segment *segment = ubirch_iov_segment_add(sink);
+        if (!segment) return -1;
+        segment->base = buf;
+        segment->offset = 0;
+        segment->len = len;
+        return 0;
+    }
+
+    if (len > sink->size - sink->len) {
+        size_t grown = sink->size * 2;
+        while (grown - sink->len < len) grown *= 2;
+        char *grown_buf = (char *) realloc(sink->buf, grown);
+        if (!grown_buf) return -1;
+        sink->buf = grown_buf;
+        sink->size = grown;
+    }
+    memcpy(sink->buf + sink->len, buf, len);
+
+    // extend the last segment if it ends right here
+    ubirch_iov_segment *segment = sink->count ? &sink->segments[sink->count - 1] : NULL;
+    if (segment == NULL || segment->base != NULL || sink->split) {
+        segment = ubirch_iov_segment_add(sink);
+        if (!segment) return -1;
+        segment->base = NULL;
+        segment->offset = sink->len;
+        segment->len = 0;
+        sink->split = 0;
+    }
+    segment->len += len;
+    sink->len += len;
+
+    return 0;
+}
+
+int ubirch_iov_finish(ubirch_iov_sink *sink, ubirch_protocol *proto, msgpack_packer *pk) {
+    // flushes of a write buffer this large were referenced and overwritten, the message is lost
+    if (proto != NULL && proto->wbuf != NULL && proto->wbuf_size >= sink->threshold) {
+        proto->status = UBIRCH_PROTOCOL_INITIALIZED;
+        proto->wbuf_len = 0;
+        return -5;
+    }
+
+    // staged data belongs to the segments before the signature
+    if (proto != NULL && ubirch_protocol_flush(proto)) return -4;
+
+    const size_t count = sink->count;
+    sink->split = 1;
+    const int ret = ubirch_protocol_finish(proto, pk);
+
+    // the next message starts after the signature segment
+    sink->signature = sink->count > count ? sink->count - 1 : sink->count;
+    sink->split = sink->count > count;
+    return ret;
+}
+
+const ubirch_iovec *ubirch_iov_vector(ubirch_iov_sink *sink, size_t *count) {
+    // the owned buffer may have moved, so the pointers are resolved here
+    for (size_t i = 0; i < sink->count; i++) {
+        const ubirch_iov_segment *segment = &sink->segments[i];
+        sink->iov[i].iov_base = (void *) (segment->base != NULL ? segment->base : sink->buf + segment->offset);
+        sink->iov[i].iov_len = segment->len;
+    }
+
+    *count = sink->count;
+    return sink->iov;
+}
@@ -0,0 +1,162 @@
+/*!
+ * @file
+ * @brief ubirch protocol scatter/gather sink
+ *
+ * A writer for a protocol context that does not copy large payloads. Small
+ * writes (the header, msgpack markers, small fields) are copied into a buffer
+ * owned by the sink, writes of at least `threshold` bytes (the bodies packed with
+ * msgpack_pack_raw_body) are only recorded by reference. The context hashes them
+ * on the way, as usual. #ubirch_iov_finish puts the signature into a segment of
+ * its own. #ubirch_iov_vector returns the message as an array of segments, ready
+ * for writev() or sendmsg().
+ *
+ * The referenced payloads must stay unchanged until the segments are written.
+ * If a write buffer is set (see #ubirch_protocol_set_write_buffer), the threshold
+ * must be larger than its size, as the staged data is written from that buffer
+ * (#ubirch_iov_finish fails otherwise).
+ *
+ * ```
+ * ubirch_iov_sink *sink = ubirch_iov_new(256, 1024);
+ * ubirch_protocol *proto = ubirch_protocol_new(proto_signed, UBIRCH_PROTOCOL_TYPE_BIN,
+ *                                              sink, ubirch_iov_write, ed25519_sign, uuid);
+ * msgpack_packer *pk = msgpack_packer_new(proto, ubirch_protocol_write);
+ * ubirch_protocol_start(proto, pk);
+ * msgpack_pack_raw(pk, snapshot_len);
+ * msgpack_pack_raw_body(pk, snapshot, snapshot_len);
+ * ubirch_iov_finish(sink, proto, pk);
+ * size_t count;
+ * const ubirch_iovec *iov = ubirch_iov_vector(sink, &count);
+ * writev(socket, iov, count);
+ * ```
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef UBIRCH_PROTOCOL_IOV_H
+#define UBIRCH_PROTOCOL_IOV_H
+
+#include "ubirch_protocol.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The smallest threshold. The header and the signature are written from the
+ * context, which changes them for the next message, so they are always copied.
+ */
+#define UBIRCH_IOV_MIN_THRESHOLD (UBIRCH_PROTOCOL_HEADER_SIZE + 1)
+
+#if defined(__unix__) || defined(__APPLE__)
+typedef struct iovec ubirch_iovec;
+#else
+/**
+ * A segment of data, same layout as the POSIX struct iovec.
+ */
+typedef struct ubirch_iovec {
+    void *iov_base;                     //!< the start of the segment
+    size_t iov_len;                     //!< the length of the segment
+} ubirch_iovec;
+#endif
+
+/**
+ * A recorded segment, either in the owned buffer or referenced.
+ */
+typedef struct ubirch_iov_segment {
+    const char *base;                   //!< the referenced data (NULL if in the owned buffer)
+    size_t offset;                      //!< the start in the owned buffer
+    size_t len;                         //!< the length of the segment
+} ubirch_iov_segment;
+
+/**
+ * The scatter/gather sink.
+ */
+typedef struct ubirch_iov_sink {
+    char *buf;                          //!< the owned buffer for small writes
+    size_t size;                        //!< the allocated size of the owned buffer
+    size_t len;                         //!< the amount of data in the owned buffer
+    size_t threshold;                   //!< the minimum length of a write recorded by reference
+    ubirch_iov_segment *segments;       //!< the recorded segments
+    ubirch_iovec *iov;                  //!< the segments as returned by #ubirch_iov_vector
+    size_t count;                       //!< the number of segments
+    size_t capacity;                    //!< the allocated number of segments
+    size_t signature;                   //!< the signature segment of the last finished message (count if none)
+    int split;                          //!< the next write starts a new segment
+} ubirch_iov_sink;
+
+/**
+ * Create a sink.
+ * @param size the initial size of the owned buffer
+ * @param threshold the minimum length of a write that is referenced instead of copied
+ *        (at least #UBIRCH_IOV_MIN_THRESHOLD)
+ * @return the sink
+ * @return NULL if out of memory
+ */
+ubirch_iov_sink *ubirch_iov_new(size_t size, size_t threshold);
+
+/**
+ * Free a sink.
+ * @param sink the sink
+ */
+void ubirch_iov_free(ubirch_iov_sink *sink);
+
+/**
+ * Remove all segments, the memory is kept.
+ * @param sink the sink
+ */
+void ubirch_iov_reset(ubirch_iov_sink *sink);
+
+/**
+ * The msgpack writer of the sink, to be used as the writer of a protocol context.
+ * @param data the sink
+ * @param buf the data to write
+ * @param len the length of the data
+ * @return 0 if successful
+ * @return -1 if out of memory
+ */
+int ubirch_iov_write(void *data, const char *buf, size_t len);
+
+/**
+ * Finish a message (see #ubirch_protocol_finish), with the signature in its own segment.
+ * @param sink the sink
+ * @param proto the ubirch protocol context writing to the sink
+ * @param pk the msgpack packer
+ * @return the result of #ubirch_protocol_finish
+ * @return -4 if writing staged data failed (before the message is finished, see #ubirch_protocol_flush)
+ * @return -5 if the write buffer of the context is not smaller than the threshold, the
+ *         message is dropped and the sink must be reset
+ */
+int ubirch_iov_finish(ubirch_iov_sink *sink, ubirch_protocol *proto, msgpack_packer *pk);
+
+/**
+ * Get the segments of all written messages. The array is valid until the next
+ * write, and refers to the owned buffer and the referenced payloads.
+ * @param sink the sink
+ * @param count the number of segments (output)
+ * @return the segments
+ */
+const ubirch_iovec *ubirch_iov_vector(ubirch_iov_sink *sink, size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UBIRCH_PROTOCOL_IOV_H
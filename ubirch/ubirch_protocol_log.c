@@ -0,0 +1,395 @@
+/*!
+ * @file
+ * @brief ubirch protocol message log
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+#include "ubirch_protocol_log.h"
+
+#ifdef UBIRCH_LOG
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ubirch_protocol_chain.h"
+#include "ubirch_protocol_view.h"
+
+#define UBIRCH_LOG_MIN_SENDERS 16
+
+/**
+ * Get the file name of a segment or its index, the result must be freed.
+ */
+static char *ubirch_log_path(const char *dir, unsigned int segment, const char *ext) {
+    const size_t len = strlen(dir) + 14;
+    char *path = (char *) malloc(len);
+    if (path) snprintf(path, len, "%s/%08u.%s", dir, segment, ext);
+    return path;
+}
+
+static int ubirch_log_exists(const char *dir, unsigned int segment) {
+    struct stat st;
+    char *path = ubirch_log_path(dir, segment, "log");
+    const int exists = path != NULL && stat(path, &st) == 0;
+    free(path);
+    return exists;
+}
+
+static int ubirch_log_write_all(int fd, const void *buf, size_t len) {
+    const unsigned char *p = (const unsigned char *) buf;
+    while (len > 0) {
+        const ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t) n;
+    }
+    return 0;
+}
+
+/**
+ * Get the number of messages of a sender in the log, adding it if necessary.
+ */
+static uint32_t *ubirch_log_counter(ubirch_log *log, const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE]) {
+    if ((log->count + 1) * 4 > log->capacity * 3) {
+        const size_t capacity = log->capacity ? log->capacity * 2 : UBIRCH_LOG_MIN_SENDERS;
+        unsigned char *block = (unsigned char *) calloc(capacity, UBIRCH_PROTOCOL_UUID_SIZE + 2 * sizeof(uint32_t));
+        if (!block) return NULL;
+
+        uint32_t *hashes = (uint32_t *) block;
+        uint32_t *counts = hashes + capacity;
+        unsigned char (*uuids)[UBIRCH_PROTOCOL_UUID_SIZE] = (unsigned char (*)[UBIRCH_PROTOCOL_UUID_SIZE]) (counts + capacity);
+        for (size_t j = 0; j < log->capacity; j++) {
+            if (log->hashes[j] == 0) continue;
+            size_t i = log->hashes[j] & (capacity - 1);
+            while (hashes[i] != 0) i = (i + 1) & (capacity - 1);
+            hashes[i] = log->hashes[j];
+            counts[i] = log->counts[j];
+            memcpy(uuids[i], log->uuids[j], UBIRCH_PROTOCOL_UUID_SIZE);
+        }
+        free(log->hashes);
+        log->hashes = hashes;
+        log->counts = counts;
+        log->uuids = uuids;
+        log->capacity = capacity;
+    }
+
+    const uint32_t hash = ubirch_chain_hash(uuid);
+    const size_t mask = log->capacity - 1;
+    size_t i = hash & mask;
+    while (log->hashes[i] != 0) {
+        if (log->hashes[i] == hash && !memcmp(log->uuids[i], uuid, UBIRCH_PROTOCOL_UUID_SIZE)) {
+            return &log->counts[i];
+        }
+        i = (i + 1) & mask;
+    }
+    log->hashes[i] = hash;
+    log->counts[i] = 0;
+    memcpy(log->uuids[i], uuid, UBIRCH_PROTOCOL_UUID_SIZE);
+    log->count++;
+
+    return &log->counts[i];
+}
+
+/**
+ * Open a segment and its index for appending.
+ */
+static int ubirch_log_open_segment(ubirch_log *log, unsigned int segment) {
+    char *log_path = ubirch_log_path(log->dir, segment, "log");
+    char *idx_path = ubirch_log_path(log->dir, segment, "idx");
+    int ret = -1;
+
+    if (log_path && idx_path) {
+        log->log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        log->idx_fd = open(idx_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        ret = log->log_fd < 0 || log->idx_fd < 0 ? -1 : 0;
+    }
+    log->segment = segment;
+    log->offset = 0;
+    log->entries = 0;
+    free(log_path);
+    free(idx_path);
+
+    return ret;
+}
+
+static void ubirch_log_close_segment(ubirch_log *log) {
+    if (log->log_fd >= 0) close(log->log_fd);
+    if (log->idx_fd >= 0) close(log->idx_fd);
+    log->log_fd = -1;
+    log->idx_fd = -1;
+}
+
+/**
+ * Read all complete entries of an index file (none if it does not exist).
+ * @return the entries (to be freed) or NULL if reading failed
+ */
+static ubirch_log_index *ubirch_log_read_index(const char *path, size_t *entries) {
+    struct stat st;
+    *entries = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0 && !fstat(fd, &st)) *entries = (size_t) st.st_size / sizeof(ubirch_log_index);
+
+    const size_t size = *entries * sizeof(ubirch_log_index);
+    ubirch_log_index *index = (ubirch_log_index *) malloc(size ? size : 1);
+    if (index && size && pread(fd, index, size, 0) != (ssize_t) size) {
+        free(index);
+        index = NULL;
+    }
+    if (fd >= 0) close(fd);
+
+    return index;
+}
+
+/**
+ * Count the messages of each sender in a segment index. The last segment is
+ * repaired: an incomplete index entry, entries of messages that did not reach
+ * the disk and messages without entry are cut off.
+ */
+static int ubirch_log_recover(ubirch_log *log, unsigned int segment, int last) {
+    char *log_path = ubirch_log_path(log->dir, segment, "log");
+    char *idx_path = ubirch_log_path(log->dir, segment, "idx");
+    size_t entries = 0;
+    ubirch_log_index *index = log_path && idx_path ? ubirch_log_read_index(idx_path, &entries) : NULL;
+    int ret = index ? 0 : -1;
+
+    // the index may have reached the disk before the messages it refers to
+    struct stat st;
+    if (!ret && stat(log_path, &st)) ret = -1;
+    while (!ret && entries > 0 &&
+           (uint64_t) index[entries - 1].offset + index[entries - 1].length > (uint64_t) st.st_size) {
+        entries--;
+    }
+
+    for (size_t i = 0; !ret && i < entries; i++) {
+        uint32_t *counter = ubirch_log_counter(log, index[i].uuid);
+        if (!counter) ret = -1;
+        else *counter = index[i].seq + 1;
+    }
+
+    if (!ret && last) {
+        const uint32_t end = entries ? index[entries - 1].offset + index[entries - 1].length : 0;
+        // the index file may not exist yet, if the crash happened right after creating the segment
+        if (truncate(log_path, end) ||
+            (truncate(idx_path, (off_t) (entries * sizeof(ubirch_log_index))) && errno != ENOENT)) {
+            ret = -1;
+        }
+        log->offset = end;
+        log->entries = (uint32_t) entries;
+    }
+
+    free(index);
+    free(log_path);
+    free(idx_path);
+    return ret;
+}
+
+ubirch_log *ubirch_log_open(const char *dir, size_t segment_size) {
+    if (mkdir(dir, 0755) && errno != EEXIST) return NULL;
+
+    ubirch_log *log = (ubirch_log *) calloc(1, sizeof(ubirch_log));
+    if (!log) { return NULL; }
+    log->dir = strdup(dir);
+    log->segment_size = segment_size ? segment_size : UBIRCH_LOG_SEGMENT_SIZE;
+    if (log->segment_size > UINT32_MAX) log->segment_size = UINT32_MAX;
+    log->log_fd = -1;
+    log->idx_fd = -1;
+
+    unsigned int segments = 0;
+    while (log->dir && ubirch_log_exists(dir, segments)) segments++;
+    const unsigned int last = segments ? segments - 1 : 0;
+
+    int ret = log->dir ? 0 : -1;
+    for (unsigned int i = 0; !ret && i < segments; i++) {
+        ret = ubirch_log_recover(log, i, i == last);
+    }
+    if (!ret) {
+        const uint32_t offset = log->offset;
+        const uint32_t entries = log->entries;
+        ret = ubirch_log_open_segment(log, last);
+        log->offset = offset;
+        log->entries = entries;
+    }
+    if (ret) {
+        ubirch_log_close(log);
+        return NULL;
+    }
+
+    return log;
+}
+
+void ubirch_log_close(ubirch_log *log) {
+    if (log == NULL) return;
+    ubirch_log_close_segment(log);
+    free(log->hashes);
+    free(log->buf);
+    free(log->dir);
+    free(log);
+}
+
+int ubirch_log_write(void *data, const char *buf, size_t len) {
+    ubirch_log *log = (ubirch_log *) data;
+
+    if (len > log->buf_size - log->buf_len) {
+        size_t size = log->buf_size ? log->buf_size : 256;
+        while (size - log->buf_len < len) size *= 2;
+        unsigned char *grown = (unsigned char *) realloc(log->buf, size);
+        if (!grown) return -1;
+        log->buf = grown;
+        log->buf_size = size;
+    }
+    memcpy(log->buf + log->buf_len, buf, len);
+    log->buf_len += len;
+
+    return 0;
+}
+
+int ubirch_log_commit(ubirch_log *log) {
+    const int ret = ubirch_log_append(log, log->buf, log->buf_len);
+    log->buf_len = 0;
+    return ret;
+}
+
+int ubirch_log_append(ubirch_log *log, const unsigned char *message, size_t len) {
+    ubirch_protocol_view view;
+    if (ubirch_protocol_parse(message, len, &view) || view.len != len) return -2;
+    if (len > log->segment_size) return -3;
+
+    // start a new segment if the message does not fit
+    if (log->offset > 0 && len > log->segment_size - log->offset) {
+        ubirch_log_close_segment(log);
+        if (ubirch_log_open_segment(log, log->segment + 1)) return -1;
+    }
+
+    uint32_t *counter = ubirch_log_counter(log, view.uuid);
+    if (!counter) return -1;
+
+    ubirch_log_index entry;
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.uuid, view.uuid, UBIRCH_PROTOCOL_UUID_SIZE);
+    entry.seq = *counter;
+    entry.offset = log->offset;
+    entry.length = (uint32_t) len;
+    if (view.signature) memcpy(entry.signature, view.signature, UBIRCH_LOG_SIGN_PREFIX);
+
+    // the message first, an index entry always refers to a complete message
+    if (ubirch_log_write_all(log->log_fd, message, len) ||
+        ubirch_log_write_all(log->idx_fd, &entry, sizeof(entry))) {
+        // drop what was written (a short index write would misalign all later entries)
+        if (ftruncate(log->log_fd, log->offset)) {}
+        if (ftruncate(log->idx_fd, (off_t) (log->entries * sizeof(ubirch_log_index)))) {}
+        return -1;
+    }
+    log->offset += (uint32_t) len;
+    log->entries++;
+    (*counter)++;
+
+    return 0;
+}
+
+int ubirch_log_sync(ubirch_log *log) {
+    return fsync(log->log_fd) || fsync(log->idx_fd) ? -1 : 0;
+}
+
+/**
+ * Map a file read-only, empty files are not mapped.
+ */
+static const unsigned char *ubirch_log_map(const char *path, size_t *size) {
+    struct stat st;
+    const unsigned char *map = NULL;
+    *size = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    if (!fstat(fd, &st) && st.st_size > 0) {
+        void *p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            map = (const unsigned char *) p;
+            *size = (size_t) st.st_size;
+        }
+    }
+    close(fd);
+
+    return map;
+}
+
+ubirch_log_reader *ubirch_log_reader_open(const char *dir) {
+    unsigned int segments = 0;
+    while (ubirch_log_exists(dir, segments)) segments++;
+
+    ubirch_log_reader *reader = (ubirch_log_reader *) calloc(1, sizeof(ubirch_log_reader) +
+                                                                segments * sizeof(ubirch_log_segment));
+    if (!reader) { return NULL; }
+    reader->segments = (ubirch_log_segment *) (reader + 1);
+    reader->segment_count = segments;
+
+    for (unsigned int i = 0; i < segments; i++) {
+        ubirch_log_segment *segment = &reader->segments[i];
+        char *log_path = ubirch_log_path(dir, i, "log");
+        char *idx_path = ubirch_log_path(dir, i, "idx");
+        if (log_path && idx_path) {
+            segment->data = ubirch_log_map(log_path, &segment->size);
+            segment->index = (const ubirch_log_index *) ubirch_log_map(idx_path, &segment->index_size);
+            segment->entries = segment->index_size / sizeof(ubirch_log_index);
+        }
+        free(log_path);
+        free(idx_path);
+    }
+
+    return reader;
+}
+
+void ubirch_log_reader_close(ubirch_log_reader *reader) {
+    if (reader == NULL) return;
+    for (unsigned int i = 0; i < reader->segment_count; i++) {
+        ubirch_log_segment *segment = &reader->segments[i];
+        if (segment->data) munmap((void *) segment->data, segment->size);
+        if (segment->index) munmap((void *) segment->index, segment->index_size);
+    }
+    free(reader);
+}
+
+int ubirch_log_next(const ubirch_log_reader *reader, ubirch_log_cursor *cursor,
+                    const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE], uint32_t from, ubirch_log_view *view) {
+    for (; cursor->segment < reader->segment_count; cursor->segment++, cursor->entry = 0) {
+        const ubirch_log_segment *segment = &reader->segments[cursor->segment];
+        while (cursor->entry < segment->entries) {
+            const ubirch_log_index *entry = &segment->index[cursor->entry++];
+            if (uuid != NULL && (entry->seq < from || memcmp(entry->uuid, uuid, UBIRCH_PROTOCOL_UUID_SIZE) != 0)) {
+                continue;
+            }
+            // the segment may have been cut off after a crash
+            if ((size_t) entry->offset + entry->length > segment->size) continue;
+
+            view->message = segment->data + entry->offset;
+            view->len = entry->length;
+            view->index = entry;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+#endif // UBIRCH_LOG
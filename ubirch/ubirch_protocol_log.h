@@ -0,0 +1,212 @@
+/*!
+ * @file
+ * @brief ubirch protocol message log
+ *
+ * An append-only archive of messages in size bounded segment files in one
+ * directory (00000000.log, 00000001.log, ...). Each segment has an index file
+ * (00000000.idx, ...) with one fixed size entry per message: uuid, position of
+ * the message in the chain of its device, offset, length and signature prefix.
+ * Audit queries only scan the compact indexes and read matching messages from
+ * the memory mapped segments, without copying them.
+ *
+ * Produced messages are written with #ubirch_log_write (the writer used in
+ * place of msgpack_sbuffer_write) and archived by #ubirch_log_commit after
+ * #ubirch_protocol_finish, received messages are added with #ubirch_log_append.
+ *
+ * A message is written to its segment before its index entry. On open, a
+ * segment tail without index entry (i.e. after a crash) is cut off.
+ *
+ * Only available on POSIX systems (UBIRCH_LOG is defined then). The log is not
+ * synchronized, use it from one thread (or with a lock).
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef UBIRCH_PROTOCOL_LOG_H
+#define UBIRCH_PROTOCOL_LOG_H
+
+#include <stdint.h>
+#include "ubirch_protocol.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define UBIRCH_LOG              //!< the message log is available
+#endif
+
+#ifdef UBIRCH_LOG
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UBIRCH_LOG_SEGMENT_SIZE (64 * 1024 * 1024)  //!< default max. size of a segment file
+#define UBIRCH_LOG_SIGN_PREFIX  8                   //!< signature bytes kept in the index
+
+/**
+ * Index entry of a message.
+ */
+typedef struct ubirch_log_index {
+    unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE];      //!< the uuid of the sender
+    uint32_t seq;                                       //!< the number of earlier messages of this uuid in the log
+    uint32_t offset;                                    //!< the offset of the message in the segment
+    uint32_t length;                                    //!< the length of the message
+    unsigned char signature[UBIRCH_LOG_SIGN_PREFIX];    //!< the first bytes of the signature (0 if unsigned)
+    uint32_t reserved;                                  //!< reserved, 0
+} ubirch_log_index;
+
+/**
+ * The log writer.
+ */
+typedef struct ubirch_log {
+    char *dir;                                          //!< the log directory
+    size_t segment_size;                                //!< the max. size of a segment
+    unsigned int segment;                               //!< the current segment number
+    int log_fd;                                         //!< the current segment file
+    int idx_fd;                                         //!< the current index file
+    uint32_t offset;                                    //!< the size of the current segment
+    uint32_t entries;                                   //!< the number of entries in the current index
+    unsigned char *buf;                                 //!< the message written since the last commit
+    size_t buf_len;                                     //!< the length of the staged message
+    size_t buf_size;                                    //!< the allocated size of the staging buffer
+    uint32_t *hashes;                                   //!< uuid hashes of the known senders (0 - unused)
+    unsigned char (*uuids)[UBIRCH_PROTOCOL_UUID_SIZE];  //!< the uuids of the known senders
+    uint32_t *counts;                                   //!< the number of messages of each sender
+    size_t capacity;                                    //!< the number of sender slots (a power of two)
+    size_t count;                                       //!< the number of known senders
+} ubirch_log;
+
+/**
+ * Open a log directory for appending (created if necessary).
+ * @param dir the log directory
+ * @param segment_size the max. size of a segment file (0 - #UBIRCH_LOG_SEGMENT_SIZE)
+ * @return the log writer
+ * @return NULL if the directory or its files can not be opened, or out of memory
+ */
+ubirch_log *ubirch_log_open(const char *dir, size_t segment_size);
+
+/**
+ * Close a log writer.
+ * @param log the log writer
+ */
+void ubirch_log_close(ubirch_log *log);
+
+/**
+ * The msgpack writer of the log, collects the message until #ubirch_log_commit.
+ * @param data the log writer
+ * @param buf the data to write
+ * @param len the length of the data
+ * @return 0 if successful
+ * @return -1 if out of memory
+ */
+int ubirch_log_write(void *data, const char *buf, size_t len);
+
+/**
+ * Archive the message written since the last commit.
+ * @param log the log writer
+ * @return 0 if successful
+ * @return the error of #ubirch_log_append
+ */
+int ubirch_log_commit(ubirch_log *log);
+
+/**
+ * Archive a complete message.
+ * @param log the log writer
+ * @param message the message
+ * @param len the length of the message
+ * @return 0 if successful
+ * @return -1 if writing failed
+ * @return -2 if the message is not a ubirch protocol message
+ * @return -3 if the message is larger than a segment
+ */
+int ubirch_log_append(ubirch_log *log, const unsigned char *message, size_t len);
+
+/**
+ * Flush the current segment and index to disk.
+ * @param log the log writer
+ * @return 0 if successful
+ */
+int ubirch_log_sync(ubirch_log *log);
+
+/**
+ * A memory mapped segment.
+ */
+typedef struct ubirch_log_segment {
+    const unsigned char *data;                          //!< the messages
+    size_t size;                                        //!< the size of the segment
+    const ubirch_log_index *index;                      //!< the index entries
+    size_t entries;                                     //!< the number of index entries
+    size_t index_size;                                  //!< the size of the index mapping
+} ubirch_log_segment;
+
+/**
+ * The log reader, maps all segments existing when it was opened.
+ */
+typedef struct ubirch_log_reader {
+    ubirch_log_segment *segments;                       //!< the segments
+    unsigned int segment_count;                         //!< the number of segments
+} ubirch_log_reader;
+
+/**
+ * Position of a query in the log, start with all zero.
+ */
+typedef struct ubirch_log_cursor {
+    unsigned int segment;                               //!< the segment to continue with
+    size_t entry;                                       //!< the index entry to continue with
+} ubirch_log_cursor;
+
+/**
+ * A message in the log, pointing into the mapped segment.
+ */
+typedef struct ubirch_log_view {
+    const unsigned char *message;                       //!< the message
+    size_t len;                                         //!< the length of the message
+    const ubirch_log_index *index;                      //!< the index entry of the message
+} ubirch_log_view;
+
+/**
+ * Open a log directory for reading.
+ * @param dir the log directory
+ * @return the log reader
+ * @return NULL if the directory can not be read or out of memory
+ */
+ubirch_log_reader *ubirch_log_reader_open(const char *dir);
+
+/**
+ * Close a log reader, views into it become invalid.
+ * @param reader the log reader
+ */
+void ubirch_log_reader_close(ubirch_log_reader *reader);
+
+/**
+ * Find the next message of a sender, in log order.
+ * @param reader the log reader
+ * @param cursor the query position, updated
+ * @param uuid the sender, or NULL for all messages
+ * @param from the first position in the chain of the sender to return
+ * @param view the message found
+ * @return 0 if a message was found
+ * @return -1 if there are no more messages
+ */
+int ubirch_log_next(const ubirch_log_reader *reader, ubirch_log_cursor *cursor,
+                    const unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE], uint32_t from, ubirch_log_view *view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UBIRCH_LOG
+
+#endif // UBIRCH_PROTOCOL_LOG_H
@@ -0,0 +1,225 @@
+/*!
+ * @file
+ * @brief ubirch protocol signer pool
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include "ubirch_protocol_pool.h"
+
+#ifdef UBIRCH_POOL_ATOMIC
+
+int ubirch_queue_init(ubirch_queue *queue, ubirch_queue_cell *cells, size_t size) {
+    if (size < 2 || (size & (size - 1)) != 0) return -1;
+
+    for (size_t i = 0; i < size; i++) {
+        cells[i].seq = i;
+    }
+    queue->cells = cells;
+    queue->mask = size - 1;
+    queue->tail = 0;
+    queue->head = 0;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    return 0;
+}
+
+int ubirch_queue_push(ubirch_queue *queue, const ubirch_pool_item *item) {
+    ubirch_queue_cell *cell;
+    size_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        const size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        const intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+            // the slot is free, claim it
+            if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the slot still holds an item from the previous round
+            return -1;
+        } else {
+            pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->item = *item;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+size_t ubirch_queue_pop(ubirch_queue *queue, ubirch_pool_item *items, size_t max) {
+    size_t n = 0;
+
+    while (n < max) {
+        ubirch_queue_cell *cell;
+        size_t pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+        for (;;) {
+            cell = &queue->cells[pos & queue->mask];
+            const size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+            const intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&queue->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // empty
+                return n;
+            } else {
+                pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+            }
+        }
+
+        items[n++] = cell->item;
+        // free the slot for the next round
+        __atomic_store_n(&cell->seq, pos + queue->mask + 1, __ATOMIC_RELEASE);
+    }
+
+    return n;
+}
+
+size_t ubirch_queue_depth(const ubirch_queue *queue) {
+    const size_t head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    const size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    // both are read at different times, the difference may be off temporarily
+    const intptr_t depth = (intptr_t) (tail - head);
+    if (depth < 0) return 0;
+    if ((size_t) depth > queue->mask + 1) return queue->mask + 1;
+    return (size_t) depth;
+}
+
+ubirch_pool *ubirch_pool_new(ubirch_protocol **contexts, unsigned int context_count,
+                             unsigned int worker_count, size_t queue_size) {
+    if (contexts == NULL || context_count == 0 || worker_count == 0) return NULL;
+    if (queue_size < 2 || (queue_size & (queue_size - 1)) != 0) return NULL;
+
+    // pool, workers and all queue slots in a single allocation
+    const size_t cells_offset = sizeof(ubirch_pool) + worker_count * sizeof(ubirch_pool_worker);
+    ubirch_pool *pool = (ubirch_pool *) calloc(1, cells_offset + worker_count * queue_size * sizeof(ubirch_queue_cell));
+    if (!pool) { return NULL; }
+
+    ubirch_queue_cell *cells = (ubirch_queue_cell *) ((unsigned char *) pool + cells_offset);
+    pool->contexts = contexts;
+    pool->context_count = context_count;
+    pool->workers = (ubirch_pool_worker *) (pool + 1);
+    pool->worker_count = worker_count;
+    pool->high_water = queue_size - queue_size / 4;
+    for (unsigned int i = 0; i < worker_count; i++) {
+        ubirch_queue_init(&pool->workers[i].queue, cells + i * queue_size, queue_size);
+    }
+
+    return pool;
+}
+
+void ubirch_pool_set_callbacks(ubirch_pool *pool, ubirch_pool_notify notify, ubirch_pool_wait wait,
+                               ubirch_pool_done done, void *arg) {
+    pool->notify = notify;
+    pool->wait = wait;
+    pool->done = done;
+    pool->arg = arg;
+}
+
+void ubirch_pool_free(ubirch_pool *pool) {
+    free(pool);
+}
+
+/**
+ * Wake up a worker if it is (about to start) waiting.
+ */
+static void ubirch_pool_wake(ubirch_pool *pool, unsigned int worker) {
+    // pairs with the fence in ubirch_pool_run, either the worker sees the new
+    // item or we see that it is sleeping
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&pool->workers[worker].sleeping, 0, __ATOMIC_SEQ_CST) && pool->notify != NULL) {
+        pool->notify(pool->arg, worker);
+    }
+}
+
+int ubirch_pool_submit(ubirch_pool *pool, const ubirch_pool_item *item) {
+    if (item->context >= pool->context_count) return -2;
+
+    const unsigned int worker = item->context % pool->worker_count;
+    ubirch_queue *queue = &pool->workers[worker].queue;
+    if (ubirch_queue_push(queue, item)) return -1;
+    ubirch_pool_wake(pool, worker);
+
+    return ubirch_queue_depth(queue) > pool->high_water ? 1 : 0;
+}
+
+size_t ubirch_pool_depth(const ubirch_pool *pool, unsigned int worker) {
+    return ubirch_queue_depth(&pool->workers[worker].queue);
+}
+
+size_t ubirch_pool_poll(ubirch_pool *pool, unsigned int worker) {
+    ubirch_pool_item items[UBIRCH_POOL_DRAIN];
+    const size_t n = ubirch_queue_pop(&pool->workers[worker].queue, items, UBIRCH_POOL_DRAIN);
+
+    for (size_t i = 0; i < n; i++) {
+        ubirch_protocol *proto = pool->contexts[items[i].context];
+        msgpack_packer pk;
+        msgpack_packer_init(&pk, proto, ubirch_protocol_writer(proto));
+
+        int ret = ubirch_protocol_start(proto, &pk);
+        if (!ret && items[i].payload_len) {
+            ret = pk.callback(pk.data, (const char *) items[i].payload, items[i].payload_len) ? -5 : 0;
+        }
+        if (!ret) ret = ubirch_protocol_finish(proto, &pk);
+        if (ret) {
+            // a failed message must not block the context, nor precede the next one with staged data
+            proto->status = UBIRCH_PROTOCOL_INITIALIZED;
+            proto->wbuf_len = 0;
+        }
+
+        if (pool->done != NULL) pool->done(pool->arg, &items[i], ret);
+    }
+
+    return n;
+}
+
+void ubirch_pool_run(ubirch_pool *pool, unsigned int worker) {
+    ubirch_pool_worker *w = &pool->workers[worker];
+
+    for (;;) {
+        if (ubirch_pool_poll(pool, worker)) continue;
+        if (__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) return;
+        if (pool->wait == NULL) continue;
+
+        // announce that we are going to sleep, then check the queue again
+        __atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (ubirch_queue_depth(&w->queue) || __atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) {
+            // a producer may have cleared the flag and notified us already,
+            // which only causes a spurious wakeup later
+            __atomic_store_n(&w->sleeping, 0, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        pool->wait(pool->arg, worker);
+    }
+}
+
+void ubirch_pool_stop(ubirch_pool *pool) {
+    for (unsigned int i = 0; i < pool->worker_count; i++) {
+        __atomic_store_n(&pool->workers[i].stop, 1, __ATOMIC_RELEASE);
+        ubirch_pool_wake(pool, i);
+    }
+}
+
+#endif // UBIRCH_POOL_ATOMIC
@@ -0,0 +1,252 @@
+/*!
+ * @file
+ * @brief ubirch protocol signer pool
+ *
+ * Many producer threads submit payloads for a set of protocol contexts
+ * without taking a lock. Each context is owned by exactly one worker, which
+ * drains its bounded lock-free queue in batches and creates the messages
+ * (start, payload, finish) in submission order. Contexts of different workers
+ * are signed in parallel.
+ *
+ * The pool does not create threads: the application runs #ubirch_pool_run
+ * (or #ubirch_pool_poll) in one thread per worker and provides the wait/notify
+ * functions of its platform (i.e. a semaphore per worker).
+ *
+ * The queues use the GCC __atomic builtins on word sized values. The pool is
+ * only available where these are lock-free (UBIRCH_POOL_ATOMIC), so no libatomic
+ * is needed: 64 bit hosts, the ESP32 and Cortex-M3/M4 (XDK110), not Cortex-M0.
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef UBIRCH_PROTOCOL_POOL_H
+#define UBIRCH_PROTOCOL_POOL_H
+
+#include "ubirch_protocol.h"
+
+#if defined(__GCC_ATOMIC_INT_LOCK_FREE) && __GCC_ATOMIC_INT_LOCK_FREE == 2 && __GCC_ATOMIC_POINTER_LOCK_FREE == 2
+#define UBIRCH_POOL_ATOMIC      //!< lock-free word sized atomics are available
+#endif
+
+#ifdef UBIRCH_POOL_ATOMIC
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UBIRCH_POOL_CACHE_LINE  64      //!< separates fields written by producers and consumers
+#define UBIRCH_POOL_DRAIN       16      //!< max. payloads a worker takes from its queue at once
+
+/**
+ * A payload submitted to the pool.
+ */
+typedef struct ubirch_pool_item {
+    unsigned int context;               //!< the index of the target protocol context
+    const unsigned char *payload;       //!< the msgpack encoded payload
+    size_t payload_len;                 //!< the length of the payload
+    void *data;                         //!< application data, passed to the completion function
+} ubirch_pool_item;
+
+/**
+ * A queue slot, the sequence number tells producers and consumers whose turn it is.
+ */
+typedef struct ubirch_queue_cell {
+    size_t seq;                         //!< the sequence number of the slot
+    ubirch_pool_item item;              //!< the queued item
+} ubirch_queue_cell;
+
+/**
+ * Bounded lock-free multi-producer/multi-consumer queue (Vyukov).
+ */
+typedef struct ubirch_queue {
+    ubirch_queue_cell *cells;           //!< the slots
+    size_t mask;                        //!< the number of slots - 1
+    char pad0[UBIRCH_POOL_CACHE_LINE];
+    size_t tail;                        //!< the next enqueue position
+    char pad1[UBIRCH_POOL_CACHE_LINE];
+    size_t head;                        //!< the next dequeue position
+    char pad2[UBIRCH_POOL_CACHE_LINE];
+} ubirch_queue;
+
+/**
+ * Initialize a queue.
+ * @param queue the queue
+ * @param cells the slots of the queue
+ * @param size the number of slots, must be a power of two
+ * @return 0 if successful
+ * @return -1 if the size is not a power of two
+ */
+int ubirch_queue_init(ubirch_queue *queue, ubirch_queue_cell *cells, size_t size);
+
+/**
+ * Add an item to the queue, without blocking.
+ * @param queue the queue
+ * @param item the item to add (copied)
+ * @return 0 if successful
+ * @return -1 if the queue is full
+ */
+int ubirch_queue_push(ubirch_queue *queue, const ubirch_pool_item *item);
+
+/**
+ * Take up to max items from the queue, without blocking.
+ * @param queue the queue
+ * @param items the items taken
+ * @param max the max. number of items to take
+ * @return the number of items taken
+ */
+size_t ubirch_queue_pop(ubirch_queue *queue, ubirch_pool_item *items, size_t max);
+
+/**
+ * The approximate number of queued items.
+ */
+size_t ubirch_queue_depth(const ubirch_queue *queue);
+
+/**
+ * Wake up a waiting worker (i.e. release its semaphore).
+ * @param arg the argument given to #ubirch_pool_new
+ * @param worker the worker index
+ */
+typedef void (*ubirch_pool_notify)(void *arg, unsigned int worker);
+
+/**
+ * Block a worker until it is notified (i.e. acquire its semaphore). A notification
+ * that happened before waiting must not be lost.
+ * @param arg the argument given to #ubirch_pool_new
+ * @param worker the worker index
+ */
+typedef void (*ubirch_pool_wait)(void *arg, unsigned int worker);
+
+/**
+ * Called by a worker after a message was written to the writer of its context,
+ * the payload is not used by the pool anymore.
+ * @param arg the argument given to #ubirch_pool_new
+ * @param item the submitted item
+ * @param result 0 if successful, the error of #ubirch_protocol_start or #ubirch_protocol_finish,
+ *        or -5 if the payload could not be written
+ */
+typedef void (*ubirch_pool_done)(void *arg, const ubirch_pool_item *item, int result);
+
+/**
+ * A pool worker and its queue.
+ */
+typedef struct ubirch_pool_worker {
+    ubirch_queue queue;                 //!< the payloads for the contexts of this worker
+    int sleeping;                       //!< the worker waits for a notification
+    int stop;                           //!< the worker should return from #ubirch_pool_run
+    char pad[UBIRCH_POOL_CACHE_LINE];
+} ubirch_pool_worker;
+
+/**
+ * The signer pool. Context i is owned by worker i % workers.
+ */
+typedef struct ubirch_pool {
+    ubirch_protocol **contexts;         //!< the protocol contexts
+    unsigned int context_count;         //!< the number of contexts
+    ubirch_pool_worker *workers;        //!< the workers
+    unsigned int worker_count;          //!< the number of workers
+    size_t high_water;                  //!< queue depth from which #ubirch_pool_submit signals backpressure
+    ubirch_pool_notify notify;          //!< wakes up a worker (optional)
+    ubirch_pool_wait wait;              //!< blocks a worker (optional, workers spin without)
+    ubirch_pool_done done;              //!< completion function (optional)
+    void *arg;                          //!< the argument of the callbacks
+} ubirch_pool;
+
+/**
+ * Create a new signer pool. The contexts must be initialized and are only used by
+ * their worker from now on.
+ *
+ * @param contexts the protocol contexts, the array must stay valid
+ * @param context_count the number of contexts
+ * @param worker_count the number of workers
+ * @param queue_size the queue size per worker, must be a power of two
+ * @return a new pool, the high water mark is set to 3/4 of the queue size
+ * @return NULL if out of memory or the parameters are invalid
+ */
+ubirch_pool *ubirch_pool_new(ubirch_protocol **contexts, unsigned int context_count,
+                             unsigned int worker_count, size_t queue_size);
+
+/**
+ * Set the callbacks of the pool, before starting the workers.
+ * @param pool the signer pool
+ * @param notify wakes up a worker
+ * @param wait blocks a worker
+ * @param done called after each message
+ * @param arg the argument of the callbacks
+ */
+void ubirch_pool_set_callbacks(ubirch_pool *pool, ubirch_pool_notify notify, ubirch_pool_wait wait,
+                               ubirch_pool_done done, void *arg);
+
+/**
+ * Free a signer pool, after all workers returned.
+ * @param pool the signer pool
+ */
+void ubirch_pool_free(ubirch_pool *pool);
+
+/**
+ * Submit a payload for a context, without blocking. The payload must stay valid
+ * until the completion function is called for it.
+ *
+ * @param pool the signer pool
+ * @param item the payload descriptor (copied)
+ * @return 0 if successful
+ * @return 1 if successful, but the queue of the worker is above the high water mark
+ * @return -1 if the queue of the worker is full (the payload was not submitted)
+ * @return -2 if the context index is invalid
+ */
+int ubirch_pool_submit(ubirch_pool *pool, const ubirch_pool_item *item);
+
+/**
+ * The number of payloads queued for a worker.
+ */
+size_t ubirch_pool_depth(const ubirch_pool *pool, unsigned int worker);
+
+/**
+ * Take up to #UBIRCH_POOL_DRAIN payloads from the queue of a worker and create
+ * their messages, without blocking.
+ *
+ * If a message fails, the part of it already written (at least its header, and
+ * its payload if the signing failed) stays in the writer of the context as a
+ * truncated message; the application discards what was written since the last
+ * successful completion. Staged data of the failed message is dropped and the
+ * context is ready for the next message.
+ * @param pool the signer pool
+ * @param worker the worker index
+ * @return the number of messages created
+ */
+size_t ubirch_pool_poll(ubirch_pool *pool, unsigned int worker);
+
+/**
+ * Run a worker until #ubirch_pool_stop is called. Waits for a notification
+ * when the queue is empty.
+ * @param pool the signer pool
+ * @param worker the worker index
+ */
+void ubirch_pool_run(ubirch_pool *pool, unsigned int worker);
+
+/**
+ * Stop all workers after they drained their queues.
+ * @param pool the signer pool
+ */
+void ubirch_pool_stop(ubirch_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UBIRCH_POOL_ATOMIC
+
+#endif // UBIRCH_PROTOCOL_POOL_H
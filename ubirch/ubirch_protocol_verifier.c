@@ -0,0 +1,96 @@
+/*!
+ * @file
+ * @brief ubirch protocol message verifier
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "ubirch_protocol_verifier.h"
+
+ubirch_verifier *ubirch_verifier_new(size_t size, ubirch_protocol_check_ctx verify, void *key) {
+    ubirch_verifier *verifier = (ubirch_verifier *) calloc(1, sizeof(ubirch_verifier));
+    if (!verifier) return NULL;
+
+    verifier->size = size ? size : 1;
+    verifier->buf = (unsigned char *) malloc(verifier->size);
+    if (!verifier->buf) {
+        free(verifier);
+        return NULL;
+    }
+    verifier->verify = verify;
+    verifier->key = key;
+
+    return verifier;
+}
+
+void ubirch_verifier_free(ubirch_verifier *verifier) {
+    if (verifier == NULL) return;
+    free(verifier->buf);
+    free(verifier);
+}
+
+void ubirch_verifier_reset(ubirch_verifier *verifier) {
+    verifier->len = 0;
+    verifier->off = 0;
+}
+
+unsigned char *ubirch_verifier_reserve(ubirch_verifier *verifier, size_t size) {
+    // move the data not yet verified to the front, usually nothing or a partial message
+    if (verifier->off > 0) {
+        memmove(verifier->buf, verifier->buf + verifier->off, verifier->len - verifier->off);
+        verifier->len -= verifier->off;
+        verifier->off = 0;
+    }
+
+    if (size > verifier->size - verifier->len) {
+        size_t grown = verifier->size * 2;
+        while (grown - verifier->len < size) grown *= 2;
+        unsigned char *buf = (unsigned char *) realloc(verifier->buf, grown);
+        if (!buf) return NULL;
+        verifier->buf = buf;
+        verifier->size = grown;
+    }
+
+    return verifier->buf + verifier->len;
+}
+
+void ubirch_verifier_consumed(ubirch_verifier *verifier, size_t size) {
+    verifier->len += size;
+}
+
+int ubirch_verifier_feed(ubirch_verifier *verifier, const unsigned char *data, size_t len) {
+    unsigned char *buf = ubirch_verifier_reserve(verifier, len);
+    if (!buf) return -1;
+
+    memcpy(buf, data, len);
+    verifier->len += len;
+    return 0;
+}
+
+int ubirch_verifier_next(ubirch_verifier *verifier, ubirch_protocol_view *view) {
+    const int ret = ubirch_protocol_parse(verifier->buf + verifier->off, verifier->len - verifier->off, view);
+    if (ret == UBIRCH_PROTOCOL_INCOMPLETE) return -3;
+    if (ret) {
+        // the data is out of sync, nothing after it can be trusted
+        ubirch_verifier_reset(verifier);
+        return -2;
+    }
+    verifier->off += view->len;
+
+    return ubirch_protocol_check_view(view, verifier->verify, verifier->key);
+}
@@ -0,0 +1,126 @@
+/*!
+ * @file
+ * @brief ubirch protocol message verifier
+ *
+ * A long lived verifier for received messages. It owns a receive buffer that
+ * grows to the largest message seen and is reused for all following messages,
+ * and parses messages in place (see #ubirch_protocol_parse) instead of
+ * unpacking them, so verifying a message does not allocate memory. The
+ * buffer may hold a single message or a stream of back to back messages.
+ *
+ * ```
+ * ubirch_verifier *verifier = ubirch_verifier_new(256, ed25519_verify_ctx, public_key);
+ * ubirch_protocol_view view;
+ * while ((len = recv(socket, ubirch_verifier_reserve(verifier, 1024), 1024, 0)) > 0) {
+ *     ubirch_verifier_consumed(verifier, len);
+ *     while ((ret = ubirch_verifier_next(verifier, &view)) != -3) {
+ *         if (ret == 0) handle(view.payload, view.payload_len);
+ *     }
+ * }
+ * ```
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef UBIRCH_PROTOCOL_VERIFIER_H
+#define UBIRCH_PROTOCOL_VERIFIER_H
+
+#include "ubirch_protocol_view.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The verifier and its receive buffer.
+ */
+typedef struct ubirch_verifier {
+    unsigned char *buf;                 //!< the receive buffer
+    size_t size;                        //!< the allocated size of the buffer
+    size_t len;                         //!< the amount of data received
+    size_t off;                         //!< the start of the data not yet verified
+    ubirch_protocol_check_ctx verify;   //!< the verification function
+    void *key;                          //!< the key handle passed to verify (may be changed between messages)
+} ubirch_verifier;
+
+/**
+ * Create a verifier.
+ * @param size the initial size of the receive buffer
+ * @param verify the verification function
+ * @param key the key handle passed to the verification function (i.e. the public key)
+ * @return the verifier
+ * @return NULL if out of memory
+ */
+ubirch_verifier *ubirch_verifier_new(size_t size, ubirch_protocol_check_ctx verify, void *key);
+
+/**
+ * Free a verifier.
+ * @param verifier the verifier
+ */
+void ubirch_verifier_free(ubirch_verifier *verifier);
+
+/**
+ * Drop all received data, the buffer is kept.
+ * @param verifier the verifier
+ */
+void ubirch_verifier_reset(ubirch_verifier *verifier);
+
+/**
+ * Get space for at least size bytes of received data. Verified messages are
+ * removed from the buffer, views returned before become invalid.
+ * @param verifier the verifier
+ * @param size the amount of data to receive
+ * @return the space to receive into
+ * @return NULL if out of memory
+ */
+unsigned char *ubirch_verifier_reserve(ubirch_verifier *verifier, size_t size);
+
+/**
+ * Add data received into the space returned by #ubirch_verifier_reserve.
+ * @param verifier the verifier
+ * @param size the amount of data received
+ */
+void ubirch_verifier_consumed(ubirch_verifier *verifier, size_t size);
+
+/**
+ * Copy received data into the buffer.
+ * @param verifier the verifier
+ * @param data the received data
+ * @param len the length of the data
+ * @return 0 if successful
+ * @return -1 if out of memory
+ */
+int ubirch_verifier_feed(ubirch_verifier *verifier, const unsigned char *data, size_t len);
+
+/**
+ * Verify the next received message. The view points into the receive buffer and
+ * is valid until the next call to #ubirch_verifier_reserve or #ubirch_verifier_feed.
+ * @param verifier the verifier
+ * @param view the message (output)
+ * @return 0 if the message is valid
+ * @return -1 if the signature verification has failed
+ * @return -2 if the message is not signed, or the data is not a ubirch protocol message (the received
+ *         data is dropped then)
+ * @return -3 if no complete message was received
+ */
+int ubirch_verifier_next(ubirch_verifier *verifier, ubirch_protocol_view *view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UBIRCH_PROTOCOL_VERIFIER_H
@@ -0,0 +1,460 @@
+/*!
+ * @file
+ * @brief ubirch protocol message view
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+#include "ubirch_protocol_view.h"
+
+/**
+ * Read a big endian number of n bytes.
+ */
+static uint64_t ubirch_view_be(const unsigned char *p, size_t n) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+/**
+ * Decode the msgpack header at buf[pos]: the length of the header, the length of
+ * the data following it (raw, bin, ext and numbers) and the number of elements
+ * contained in it (array and map).
+ */
+static int ubirch_view_header(const unsigned char *buf, size_t len, size_t pos,
+                              size_t *header, uint64_t *body, uint64_t *children) {
+    if (pos >= len) return UBIRCH_PROTOCOL_INCOMPLETE;
+    const unsigned char b = buf[pos];
+    size_t n = 0;       // length of the size field following the type byte
+    size_t fixed = 0;   // fixed length data following the type byte
+    *body = 0;
+    *children = 0;
+
+    if (b <= 0x7f || b >= 0xe0 || b == 0xc0 || b == 0xc2 || b == 0xc3) {
+        *header = 1;
+        return 0;
+    }
+    if (b <= 0x8f) {
+        *header = 1;
+        *children = 2 * (uint64_t) (b & 0x0f);
+        return 0;
+    }
+    if (b <= 0x9f) {
+        *header = 1;
+        *children = b & 0x0f;
+        return 0;
+    }
+    if (b <= 0xbf) {
+        *header = 1;
+        *body = b & 0x1f;
+        return 0;
+    }
+
+    switch (b) {
+        case 0xc4: case 0xd9: n = 1; break;                         // bin8, str8
+        case 0xc5: case 0xda: n = 2; break;                         // bin16, raw16
+        case 0xc6: case 0xdb: n = 4; break;                         // bin32, raw32
+        case 0xc7: n = 1; fixed = 1; break;                         // ext8 (+ type)
+        case 0xc8: n = 2; fixed = 1; break;                         // ext16
+        case 0xc9: n = 4; fixed = 1; break;                         // ext32
+        case 0xcc: case 0xd0: fixed = 1; break;                     // 8 bit int
+        case 0xcd: case 0xd1: fixed = 2; break;                     // 16 bit int
+        case 0xca: case 0xce: case 0xd2: fixed = 4; break;          // float, 32 bit int
+        case 0xcb: case 0xcf: case 0xd3: fixed = 8; break;          // double, 64 bit int
+        case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:      // fixext 1 - 16 (+ type)
+            fixed = 1 + ((size_t) 1 << (b - 0xd4));
+            break;
+        case 0xdc: case 0xde: n = 2; break;                         // array16, map16
+        case 0xdd: case 0xdf: n = 4; break;                         // array32, map32
+        default:
+            return UBIRCH_PROTOCOL_MALFORMED;
+    }
+    if (len - pos < 1 + n) return UBIRCH_PROTOCOL_INCOMPLETE;
+
+    const uint64_t count = ubirch_view_be(buf + pos + 1, n);
+    *header = 1 + n;
+    if (b == 0xdc || b == 0xdd) {
+        *children = count;
+    } else if (b == 0xde || b == 0xdf) {
+        *children = 2 * count;
+    } else {
+        *body = count + fixed;
+    }
+    return 0;
+}
+
+int ubirch_protocol_skip(const unsigned char *buf, size_t len, size_t *size) {
+    size_t pos = 0;
+    uint64_t remaining = 1;
+
+    while (remaining > 0) {
+        size_t header;
+        uint64_t body, children;
+        const int ret = ubirch_view_header(buf, len, pos, &header, &body, &children);
+        if (ret) return ret;
+        if (body > len - pos - header) return UBIRCH_PROTOCOL_INCOMPLETE;
+        pos += header + (size_t) body;
+
+        // every element takes at least one byte, which also keeps the count from overflowing
+        remaining = remaining - 1 + children;
+        if (remaining > len - pos) return UBIRCH_PROTOCOL_INCOMPLETE;
+    }
+
+    *size = pos;
+    return 0;
+}
+
+/**
+ * Check for an integer type marker.
+ */
+static int ubirch_view_is_int(unsigned char b) {
+    return b <= 0x7f || b >= 0xe0 || (b >= 0xcc && b <= 0xd3);
+}
+
+/**
+ * Check for a raw (str) or bin type marker.
+ */
+static int ubirch_view_is_bytes(unsigned char b) {
+    return (b >= 0xa0 && b <= 0xbf) || (b >= 0xc4 && b <= 0xc6) || (b >= 0xd9 && b <= 0xdb);
+}
+
+/**
+ * Read an integer element (positive or negative).
+ */
+static int ubirch_view_int(const unsigned char *buf, size_t len, size_t *pos, int64_t *value) {
+    size_t header;
+    uint64_t body, children;
+    const int ret = ubirch_view_header(buf, len, *pos, &header, &body, &children);
+    if (ret) return ret;
+
+    const unsigned char b = buf[*pos];
+    if (b <= 0x7f) {
+        *value = b;
+    } else if (b >= 0xe0) {
+        *value = (int8_t) b;
+    } else if (b >= 0xcc && b <= 0xcf) {
+        if (len - *pos < 1 + body) return UBIRCH_PROTOCOL_INCOMPLETE;
+        const uint64_t v = ubirch_view_be(buf + *pos + 1, (size_t) body);
+        if (v > INT64_MAX) return UBIRCH_PROTOCOL_MALFORMED;
+        *value = (int64_t) v;
+    } else if (b >= 0xd0 && b <= 0xd3) {
+        if (len - *pos < 1 + body) return UBIRCH_PROTOCOL_INCOMPLETE;
+        // sign extend from the encoded width
+        const unsigned int shift = (unsigned int) (64 - 8 * body);
+        *value = (int64_t) (ubirch_view_be(buf + *pos + 1, (size_t) body) << shift) >> shift;
+    } else {
+        return UBIRCH_PROTOCOL_MALFORMED;
+    }
+
+    *pos += header + (size_t) body;
+    return 0;
+}
+
+/**
+ * Read a raw (str) or bin element of the expected size.
+ */
+static int ubirch_view_bytes(const unsigned char *buf, size_t len, size_t *pos, size_t size,
+                             const unsigned char **data) {
+    size_t header;
+    uint64_t body, children;
+    const int ret = ubirch_view_header(buf, len, *pos, &header, &body, &children);
+    if (ret) return ret;
+
+    if (!ubirch_view_is_bytes(buf[*pos]) || body != size) return UBIRCH_PROTOCOL_MALFORMED;
+    if (len - *pos - header < size) return UBIRCH_PROTOCOL_INCOMPLETE;
+
+    *data = buf + *pos + header;
+    *pos += header + size;
+    return 0;
+}
+
+int ubirch_protocol_parse(const unsigned char *buf, size_t len, ubirch_protocol_view *view) {
+    size_t pos = 0, header, payload_len;
+    uint64_t body, elements;
+    int64_t value;
+    int ret;
+
+    // the envelope array
+    ret = ubirch_view_header(buf, len, pos, &header, &body, &elements);
+    if (ret) return ret;
+    if (!(buf[0] >= 0x90 && buf[0] <= 0x9f) && buf[0] != 0xdc && buf[0] != 0xdd) return UBIRCH_PROTOCOL_MALFORMED;
+    if (elements < 4 || elements > 6) return UBIRCH_PROTOCOL_MALFORMED;
+    pos += header;
+
+    // 1 - protocol version, which also tells the number of elements
+    ret = ubirch_view_int(buf, len, &pos, &value);
+    if (ret) return ret;
+    if (value < 0 || value > UINT16_MAX) return UBIRCH_PROTOCOL_MALFORMED;
+    view->version = (uint16_t) value;
+    switch (view->version & 0x0f) {
+        case UBIRCH_PROTOCOL_PLAIN:
+            if (elements != 4) return UBIRCH_PROTOCOL_MALFORMED;
+            break;
+        case UBIRCH_PROTOCOL_SIGNED:
+            if (elements != 5) return UBIRCH_PROTOCOL_MALFORMED;
+            break;
+        case UBIRCH_PROTOCOL_CHAINED:
+            if (elements != 6) return UBIRCH_PROTOCOL_MALFORMED;
+            break;
+        default:
+            return UBIRCH_PROTOCOL_MALFORMED;
+    }
+
+    // 2 - device ID
+    ret = ubirch_view_bytes(buf, len, &pos, UBIRCH_PROTOCOL_UUID_SIZE, &view->uuid);
+    if (ret) return ret;
+
+    // 3 - the last signature (if chained)
+    view->previous = NULL;
+    if (elements == 6) {
+        ret = ubirch_view_bytes(buf, len, &pos, UBIRCH_PROTOCOL_SIGN_SIZE, &view->previous);
+        if (ret) return ret;
+    }
+
+    // 4 - the payload type
+    ret = ubirch_view_int(buf, len, &pos, &value);
+    if (ret) return ret;
+    if (value < INT32_MIN || value > UINT32_MAX) return UBIRCH_PROTOCOL_MALFORMED;
+    view->type = (unsigned int) value;
+
+    // 5 - the payload
+    ret = ubirch_protocol_skip(buf + pos, len - pos, &payload_len);
+    if (ret) return ret;
+    view->payload = buf + pos;
+    view->payload_len = payload_len;
+    pos += payload_len;
+
+    // 6 - the signature (if signed), the data in front of its header is signed
+    view->signature = NULL;
+    view->signed_len = 0;
+    if (elements > 4) {
+        view->signed_len = pos;
+        ret = ubirch_view_bytes(buf, len, &pos, UBIRCH_PROTOCOL_SIGN_SIZE, &view->signature);
+        if (ret) return ret;
+    }
+
+    view->message = buf;
+    view->len = pos;
+    return 0;
+}
+
+int ubirch_protocol_scan(const unsigned char *buf, size_t len, const unsigned char *messages[], size_t sizes[],
+                         size_t signed_lens[], size_t max, size_t *count, size_t *used) {
+    ubirch_protocol_view view;
+    size_t pos = 0, n = 0;
+    int ret = 0;
+
+    while (n < max) {
+        ret = ubirch_protocol_parse(buf + pos, len - pos, &view);
+        if (ret) break;
+        messages[n] = view.message;
+        sizes[n] = view.len;
+        if (signed_lens != NULL) signed_lens[n] = view.signed_len;
+        pos += view.len;
+        n++;
+    }
+
+    *count = n;
+    *used = pos;
+    return ret == UBIRCH_PROTOCOL_MALFORMED ? ret : 0;
+}
+
+int ubirch_protocol_check_view(const ubirch_protocol_view *view, ubirch_protocol_check_ctx verify, void *key) {
+    if (view->signature == NULL) return -2;
+
+    unsigned char sha512sum[UBIRCH_PROTOCOL_HASH_SIZE];
+    mbedtls_sha512(view->message, view->signed_len, sha512sum, 0);
+
+    return verify(key, sha512sum, UBIRCH_PROTOCOL_HASH_SIZE, view->signature) ? -1 : 0;
+}
+
+int ubirch_protocol_verify_view(const unsigned char *buf, size_t len, ubirch_protocol_check_ctx verify, void *key,
+                                ubirch_protocol_view *view) {
+    // the envelope first, garbage is rejected before hashing
+    const int ret = ubirch_protocol_parse(buf, len, view);
+    if (ret == UBIRCH_PROTOCOL_INCOMPLETE) return -3;
+    if (ret) return -2;
+
+    return ubirch_protocol_check_view(view, verify, key);
+}
+
+/**
+ * The envelope fields, in the order they are received.
+ */
+enum ubirch_stream_field {
+    UBIRCH_STREAM_ARRAY,
+    UBIRCH_STREAM_VERSION,
+    UBIRCH_STREAM_UUID,
+    UBIRCH_STREAM_PREVIOUS,
+    UBIRCH_STREAM_TYPE,
+    UBIRCH_STREAM_PAYLOAD,
+    UBIRCH_STREAM_SIGNATURE,
+    UBIRCH_STREAM_DONE
+};
+
+void ubirch_protocol_stream_init(ubirch_protocol_stream *stream) {
+    mbedtls_sha512_init(&stream->hash);
+    mbedtls_sha512_starts(&stream->hash, 0);
+    stream->field = UBIRCH_STREAM_ARRAY;
+    stream->elements = 0;
+    stream->element_len = 0;
+    stream->body = 0;
+    stream->remaining = 0;
+    stream->len = 0;
+    stream->signed_len = 0;
+    stream->version = 0;
+    stream->type = 0;
+}
+
+/**
+ * Continue with the next field after an element is complete.
+ */
+static void ubirch_stream_next(ubirch_protocol_stream *stream) {
+    switch (stream->field) {
+        case UBIRCH_STREAM_UUID:
+            stream->field = stream->elements == 6 ? UBIRCH_STREAM_PREVIOUS : UBIRCH_STREAM_TYPE;
+            break;
+        case UBIRCH_STREAM_PAYLOAD:
+            if (stream->remaining == 0) {
+                stream->field = stream->elements > 4 ? UBIRCH_STREAM_SIGNATURE : UBIRCH_STREAM_DONE;
+            }
+            break;
+        default:
+            stream->field++;
+            break;
+    }
+}
+
+/**
+ * Handle a complete element header (and the value of an integer).
+ */
+static int ubirch_stream_element(ubirch_protocol_stream *stream, uint64_t body, uint64_t children) {
+    const unsigned char b = stream->element[0];
+    size_t pos = 0;
+    int64_t value;
+
+    switch (stream->field) {
+        case UBIRCH_STREAM_ARRAY:
+            if (!((b >= 0x90 && b <= 0x9f) || b == 0xdc || b == 0xdd)) return UBIRCH_PROTOCOL_MALFORMED;
+            if (children < 4 || children > 6) return UBIRCH_PROTOCOL_MALFORMED;
+            stream->elements = (unsigned int) children;
+            break;
+        case UBIRCH_STREAM_VERSION:
+            if (ubirch_view_int(stream->element, stream->element_len, &pos, &value)) return UBIRCH_PROTOCOL_MALFORMED;
+            if (value < 0 || value > UINT16_MAX) return UBIRCH_PROTOCOL_MALFORMED;
+            stream->version = (uint16_t) value;
+            // plain, signed and chained messages have 4, 5 and 6 elements
+            if ((stream->version & 0x0f) + 3u != stream->elements) return UBIRCH_PROTOCOL_MALFORMED;
+            break;
+        case UBIRCH_STREAM_UUID:
+            if (!ubirch_view_is_bytes(b) || body != UBIRCH_PROTOCOL_UUID_SIZE) return UBIRCH_PROTOCOL_MALFORMED;
+            stream->body = body;
+            return 0;
+        case UBIRCH_STREAM_PREVIOUS:
+        case UBIRCH_STREAM_SIGNATURE:
+            if (!ubirch_view_is_bytes(b) || body != UBIRCH_PROTOCOL_SIGN_SIZE) return UBIRCH_PROTOCOL_MALFORMED;
+            stream->body = body;
+            return 0;
+        case UBIRCH_STREAM_TYPE:
+            if (ubirch_view_int(stream->element, stream->element_len, &pos, &value)) return UBIRCH_PROTOCOL_MALFORMED;
+            if (value < INT32_MIN || value > UINT32_MAX) return UBIRCH_PROTOCOL_MALFORMED;
+            stream->type = (unsigned int) value;
+            stream->remaining = 1;
+            break;
+        case UBIRCH_STREAM_PAYLOAD:
+            if (children > UINT64_MAX - stream->remaining) return UBIRCH_PROTOCOL_MALFORMED;
+            stream->remaining = stream->remaining - 1 + children;
+            stream->body = body;
+            if (body > 0) return 0;
+            break;
+        default:
+            return UBIRCH_PROTOCOL_MALFORMED;
+    }
+
+    ubirch_stream_next(stream);
+    return 0;
+}
+
+int ubirch_protocol_stream_feed(ubirch_protocol_stream *stream, const unsigned char *buf, size_t len, size_t *used) {
+    size_t pos = 0;
+    if (stream->field == UBIRCH_STREAM_DONE) {
+        *used = 0;
+        return 1;
+    }
+
+    // plain messages (4 elements) are not hashed
+    int hashing = stream->field < UBIRCH_STREAM_SIGNATURE;
+
+    while (pos < len && stream->field != UBIRCH_STREAM_DONE) {
+        if (stream->body > 0) {
+            // element data, only the fixed size fields are kept
+            const size_t n = stream->body < len - pos ? (size_t) stream->body : len - pos;
+            unsigned char *target = NULL;
+            size_t size = 0;
+            if (stream->field == UBIRCH_STREAM_UUID) {
+                target = stream->uuid;
+                size = sizeof(stream->uuid);
+            } else if (stream->field == UBIRCH_STREAM_PREVIOUS) {
+                target = stream->previous;
+                size = sizeof(stream->previous);
+            } else if (stream->field == UBIRCH_STREAM_SIGNATURE) {
+                target = stream->signature;
+                size = sizeof(stream->signature);
+            }
+            if (target) memcpy(target + (size - (size_t) stream->body), buf + pos, n);
+            pos += n;
+            stream->body -= n;
+            if (stream->body == 0) ubirch_stream_next(stream);
+        } else {
+            // collect the header, integers of the envelope also with their value
+            stream->element[stream->element_len++] = buf[pos++];
+            size_t header;
+            uint64_t body, children;
+            const int ret = ubirch_view_header(stream->element, stream->element_len, 0, &header, &body, &children);
+            if (ret == UBIRCH_PROTOCOL_INCOMPLETE) continue;
+            if (ret) return ret;
+            if (stream->field == UBIRCH_STREAM_VERSION || stream->field == UBIRCH_STREAM_TYPE) {
+                if (!ubirch_view_is_int(stream->element[0])) return UBIRCH_PROTOCOL_MALFORMED;
+                if (stream->element_len < header + body) continue;
+            }
+            if (ubirch_stream_element(stream, body, children)) return UBIRCH_PROTOCOL_MALFORMED;
+            stream->element_len = 0;
+        }
+
+        // the signed data ends in front of the signature header
+        if (hashing && stream->field >= UBIRCH_STREAM_SIGNATURE) {
+            if (stream->elements != 4) {
+                mbedtls_sha512_update(&stream->hash, buf, pos);
+                stream->signed_len = stream->len + pos;
+            }
+            hashing = 0;
+        }
+    }
+    if (hashing && stream->elements != 4) mbedtls_sha512_update(&stream->hash, buf, pos);
+
+    *used = pos;
+    stream->len += pos;
+    if (stream->field != UBIRCH_STREAM_DONE) return 0;
+
+    if (stream->elements != 4) mbedtls_sha512_finish(&stream->hash, stream->digest);
+    return 1;
+}
+
+int ubirch_protocol_stream_verify(ubirch_protocol_stream *stream, ubirch_protocol_check_ctx verify, void *key) {
+    if (stream->field != UBIRCH_STREAM_DONE || stream->elements == 4) return -2;
+
+    return verify(key, stream->digest, UBIRCH_PROTOCOL_HASH_SIZE, stream->signature) ? -1 : 0;
+}
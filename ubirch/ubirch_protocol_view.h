@@ -0,0 +1,208 @@
+/*!
+ * @file
+ * @brief ubirch protocol message view
+ *
+ * Parses the envelope of a ubirch protocol message in place, without
+ * unpacking it into msgpack objects: the view points into the original
+ * buffer, nothing is allocated or copied. Only the envelope is checked
+ * (array length, version, uuid, previous signature, type and signature),
+ * the payload is skipped over its msgpack headers and must be unpacked
+ * by the application if it needs it.
+ *
+ * ```
+ * ubirch_protocol_view view;
+ * if (!ubirch_protocol_parse(buf, len, &view)) {
+ *     route(view.uuid, view.signature);
+ * }
+ * ```
+ *
+ * #ubirch_protocol_verify_view checks the envelope before the message is hashed
+ * and verified, so malformed data never costs a hash or a signature check. The
+ * envelope check only reads msgpack headers, the payload data is read once, by
+ * the hash.
+ *
+ * A #ubirch_protocol_stream verifies a message while it is received: it is fed
+ * the data in chunks of any size, follows the envelope, hashes the signed data
+ * as it arrives and keeps the uuid and signatures. It needs no message buffer.
+ *
+ * ```
+ * ubirch_protocol_stream stream;
+ * ubirch_protocol_stream_init(&stream);
+ * while ((len = recv(socket, buf, sizeof(buf), 0)) > 0) {
+ *     int ret = ubirch_protocol_stream_feed(&stream, buf, len, &used);
+ *     if (ret == 1) return ubirch_protocol_stream_verify(&stream, ed25519_verify_ctx, public_key);
+ *     if (ret < 0) return ret;
+ * }
+ * ```
+ *
+ * @copyright &copy; 2018 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef UBIRCH_PROTOCOL_VIEW_H
+#define UBIRCH_PROTOCOL_VIEW_H
+
+#include <stdint.h>
+#include "ubirch_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UBIRCH_PROTOCOL_INCOMPLETE  -1      //!< the data ends before the message
+#define UBIRCH_PROTOCOL_MALFORMED   -2      //!< the data is not a ubirch protocol message
+
+/**
+ * A parsed message, all pointers point into the parsed buffer.
+ */
+typedef struct ubirch_protocol_view {
+    const unsigned char *message;           //!< the start of the message
+    size_t len;                             //!< the length of the message
+    uint16_t version;                       //!< the protocol version (see #ubirch_protocol_variant)
+    const unsigned char *uuid;              //!< the uuid of the sender (#UBIRCH_PROTOCOL_UUID_SIZE bytes)
+    const unsigned char *previous;          //!< the previous signature (chained only, else NULL)
+    unsigned int type;                      //!< the payload type
+    const unsigned char *payload;           //!< the msgpack encoded payload
+    size_t payload_len;                     //!< the length of the encoded payload
+    const unsigned char *signature;         //!< the signature (signed and chained only, else NULL)
+    size_t signed_len;                      //!< the length of the signed data at the start of the message
+} ubirch_protocol_view;
+
+/**
+ * The state of a streaming verification.
+ */
+typedef struct ubirch_protocol_stream {
+    mbedtls_sha512_context hash;                        //!< the hash of the signed data
+    unsigned int field;                                 //!< the envelope field being received
+    unsigned int elements;                              //!< the number of envelope elements
+    unsigned char element[9];                           //!< the header (and value of integers) being received
+    size_t element_len;                                 //!< the number of bytes in element
+    uint64_t body;                                      //!< the remaining data bytes of the current element
+    uint64_t remaining;                                 //!< the number of payload elements still to come
+    size_t len;                                         //!< the number of bytes received
+    size_t signed_len;                                  //!< the length of the signed data
+    uint16_t version;                                   //!< the protocol version
+    unsigned int type;                                  //!< the payload type
+    unsigned char uuid[UBIRCH_PROTOCOL_UUID_SIZE];      //!< the uuid of the sender
+    unsigned char previous[UBIRCH_PROTOCOL_SIGN_SIZE];  //!< the previous signature (chained only)
+    unsigned char signature[UBIRCH_PROTOCOL_SIGN_SIZE]; //!< the signature (signed and chained only)
+    unsigned char digest[UBIRCH_PROTOCOL_HASH_SIZE];    //!< the hash of the signed data, when complete
+} ubirch_protocol_stream;
+
+/**
+ * Get the size of the msgpack element at the start of a buffer, including all
+ * elements it contains, by reading their headers only.
+ * @param buf the data
+ * @param len the length of the data
+ * @param size the size of the element (output)
+ * @return 0 if successful
+ * @return #UBIRCH_PROTOCOL_INCOMPLETE if the element does not end in the data
+ * @return #UBIRCH_PROTOCOL_MALFORMED if the data is not msgpack
+ */
+int ubirch_protocol_skip(const unsigned char *buf, size_t len, size_t *size);
+
+/**
+ * Parse the message at the start of a buffer. The buffer may continue after
+ * the message, view->len is the length of the message.
+ * @param buf the data
+ * @param len the length of the data
+ * @param view the parsed message (output)
+ * @return 0 if successful
+ * @return #UBIRCH_PROTOCOL_INCOMPLETE if the message does not end in the data
+ * @return #UBIRCH_PROTOCOL_MALFORMED if the data is not a ubirch protocol message
+ */
+int ubirch_protocol_parse(const unsigned char *buf, size_t len, ubirch_protocol_view *view);
+
+/**
+ * Find the complete messages in a buffer of back to back messages, by reading
+ * their msgpack headers only. The results can be passed to
+ * #ubirch_protocol_verify_batch directly.
+ * @param buf the data
+ * @param len the length of the data
+ * @param messages the start of each message (output)
+ * @param sizes the length of each message (output)
+ * @param signed_lens the length of the signed data of each message, 0 if unsigned (output, may be NULL)
+ * @param max the max. number of messages to find
+ * @param count the number of messages found (output)
+ * @param used the length of the messages found, where scanning continues (output)
+ * @return 0 if successful, the data after the messages is an incomplete message (or there are more than max)
+ * @return #UBIRCH_PROTOCOL_MALFORMED if the data after the messages is not a ubirch protocol message
+ */
+int ubirch_protocol_scan(const unsigned char *buf, size_t len, const unsigned char *messages[], size_t sizes[],
+                         size_t signed_lens[], size_t max, size_t *count, size_t *used);
+
+/**
+ * Verify the signature of a parsed message.
+ * @param view the parsed message
+ * @param verify the verification function
+ * @param key the key handle passed to the verification function (i.e. the public key)
+ * @return 0 if the verification is successful
+ * @return -1 if the signature verification has failed
+ * @return -2 if the message is not signed
+ */
+int ubirch_protocol_check_view(const ubirch_protocol_view *view, ubirch_protocol_check_ctx verify, void *key);
+
+/**
+ * Parse and verify a message. Use #ubirch_protocol_parse and #ubirch_protocol_check_view
+ * if the key depends on the sender.
+ * @param buf the data
+ * @param len the length of the data
+ * @param verify the verification function
+ * @param key the key handle passed to the verification function (i.e. the public key)
+ * @param view the parsed message (output)
+ * @return 0 if the verification is successful
+ * @return -1 if the signature verification has failed
+ * @return -2 if the data is not a signed ubirch protocol message
+ * @return -3 if the message does not end in the data
+ */
+int ubirch_protocol_verify_view(const unsigned char *buf, size_t len, ubirch_protocol_check_ctx verify, void *key,
+                                ubirch_protocol_view *view);
+
+/**
+ * Start receiving a message.
+ * @param stream the stream state
+ */
+void ubirch_protocol_stream_init(ubirch_protocol_stream *stream);
+
+/**
+ * Receive the next chunk of a message. The chunk may end in the middle of an
+ * element, data after the end of the message is not used.
+ * @param stream the stream state
+ * @param buf the data
+ * @param len the length of the data
+ * @param used the number of bytes of the chunk belonging to the message (output)
+ * @return 0 if the message continues after the chunk
+ * @return 1 if the message is complete
+ * @return #UBIRCH_PROTOCOL_MALFORMED if the data is not a ubirch protocol message
+ */
+int ubirch_protocol_stream_feed(ubirch_protocol_stream *stream, const unsigned char *buf, size_t len, size_t *used);
+
+/**
+ * Verify the signature of a completely received message.
+ * @param stream the stream state
+ * @param verify the verification function
+ * @param key the key handle passed to the verification function (i.e. the public key)
+ * @return 0 if the verification is successful
+ * @return -1 if the signature verification has failed
+ * @return -2 if the message is not signed or not complete
+ */
+int ubirch_protocol_stream_verify(ubirch_protocol_stream *stream, ubirch_protocol_check_ctx verify, void *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UBIRCH_PROTOCOL_VIEW_H